@@ -11,6 +11,7 @@ struct _IBusRimeEngine {
   /* members */
   RimeSessionId session_id;
   IBusLookupTable *table;
+  guint refine_source_id;
 };
 
 struct _IBusRimeEngineClass {
@@ -55,6 +56,7 @@ static void ibus_rime_engine_property_hide
  const gchar            *prop_name);
 
 static void ibus_rime_engine_update      (IBusRimeEngine      *rime);
+static gboolean ibus_rime_engine_refine  (gpointer             data);
 
 G_DEFINE_TYPE (IBusRimeEngine, ibus_rime_engine, IBUS_TYPE_ENGINE)
 
@@ -76,11 +78,18 @@ ibus_rime_engine_init (IBusRimeEngine *rime)
 
   rime->table = ibus_lookup_table_new(9, 0, TRUE, FALSE);
   g_object_ref_sink(rime->table);
+
+  rime->refine_source_id = 0;
 }
 
 static void
 ibus_rime_engine_destroy (IBusRimeEngine *rime)
 {
+  if (rime->refine_source_id) {
+    g_source_remove(rime->refine_source_id);
+    rime->refine_source_id = 0;
+  }
+
   if (rime->session_id) {
     RimeDestroySession(rime->session_id);
     rime->session_id = 0;
@@ -203,5 +212,22 @@ ibus_rime_engine_process_key_event (IBusEngine *engine,
   }
   gboolean result = RimeProcessKey(rime->session_id, keyval, modifiers);
   ibus_rime_engine_update(rime);
+  // sentences made in a hurry are refined when there are no more keys
+  if (!rime->refine_source_id) {
+    rime->refine_source_id = g_idle_add(ibus_rime_engine_refine, rime);
+  }
   return result;
 }
+
+static gboolean
+ibus_rime_engine_refine (gpointer data)
+{
+  IBusRimeEngine *rime = (IBusRimeEngine *)data;
+  if (!rime->session_id ||
+      !RimeRefineComposition(rime->session_id)) {
+    rime->refine_source_id = 0;
+    return FALSE;
+  }
+  ibus_rime_engine_update(rime);
+  return TRUE;  // another step
+}
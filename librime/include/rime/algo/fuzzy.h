@@ -0,0 +1,70 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+
+#ifndef RIME_FUZZY_H_
+#define RIME_FUZZY_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <rime/common.h>
+#include <rime/config.h>
+#include <rime/dict/prism.h>
+
+namespace rime {
+
+// a fuzzy rule accepts typed input in place of a fragment of the spelling.
+// fuzz/zh/z/   -- 'zh' in a spelling can be typed as 'z'
+// fuzz/^n/l/   -- only at the beginning of a syllable
+// fuzz/ng$/n/  -- only at the end of a syllable
+struct FuzzyRule {
+  std::string key;
+  std::string typed;
+  bool at_start;
+  bool at_end;
+  FuzzyRule() : at_start(false), at_end(false) {}
+};
+
+// FuzzyMatcher compiles the typed fragments of the rules into a trie,
+// which is walked in parallel with the prism's double array trie so that
+// fuzzy spellings are matched at run time instead of being expanded into
+// the prism by spelling algebra.
+class FuzzyMatcher {
+ public:
+  FuzzyMatcher();
+  bool Load(ConfigListPtr settings);
+  bool AddRule(const std::string &formula);
+  void Clear();
+  bool empty() const { return rules_.empty(); }
+
+  // like Prism::CommonPrefixSearch, but applies fuzzy rules;
+  // fuzzy, if given, tells for each match whether a rule was applied
+  size_t CommonPrefixSearch(Prism &prism, const std::string &key,
+                            std::vector<Prism::Match> *result,
+                            std::vector<bool> *fuzzy = NULL) const;
+
+ protected:
+  struct Node {
+    std::map<char, size_t> next;
+    std::vector<size_t> rules;
+  };
+  struct SearchState;
+
+  void Search(SearchState *state, Prism::NodePos node_pos,
+              size_t key_pos, bool fuzzy) const;
+  bool Step(SearchState *state, const std::string &key,
+            Prism::NodePos *node_pos, int *value) const;
+
+  std::vector<FuzzyRule> rules_;
+  std::vector<Node> nodes_;
+};
+
+}  // namespace rime
+
+#endif  // RIME_FUZZY_H_
@@ -12,58 +12,459 @@
 #ifndef RIME_POET_H_
 #define RIME_POET_H_
 
+#include <algorithm>
 #include <map>
+#include <queue>
+#include <utility>
 #include <vector>
 #include <boost/foreach.hpp>
 #include <rime/common.h>
 #include <rime/candidate.h>
+#include <rime/dict/bigram_model.h>
 #include <rime/dict/vocabulary.h>
 #include <rime/dict/user_dictionary.h>
 
 namespace rime {
 
-typedef std::map<int, UserDictEntryCollector> WordGraph;
+// lattice operations allowed for making a sentence in one go
+const int kDefaultSentenceWorkBudget = 10000;
+
+// homophones of a word tried in a sentence, the best ones first;
+// without a bigram model, the best of them always wins.
+const size_t kMaxHomophones = 3;
+
+// the best paths found for the last input, kept across keystrokes.
+// when the input is edited at the end, most of the word graph stays the
+// same, and the search only has to go on from where words have changed.
+struct SentenceMemo {
+  // the best path to a position ending with a word
+  struct Node {
+    double weight;
+    size_t start_pos;
+    size_t prev;  // the node at start_pos the path goes through
+    size_t homophone;  // of the last word, in its group of homophones
+    const DictEntry *entry;  // the last word; NULL at the start
+    Node() : weight(0.0), start_pos(0), prev(0), homophone(0), entry(NULL) {}
+  };
+  // paths are told apart by their last word if there is a bigram model,
+  // for it scores the next word after it; empty if the position is not
+  // reached
+  typedef std::vector<Node> NodeList;
+  shared_ptr<const WordGraph> graph;
+  shared_ptr<BigramModel> bigram_model;
+  size_t total_length;
+  size_t settled_length;  // best paths are known up to this position
+  std::vector<NodeList> nodes;
+  SentenceMemo() : total_length(0), settled_length(0) {}
+};
 
 template<class Sentence>
 class Poet {
  public:
+  Poet() : graph_(NULL), total_length_(0), recalled_length_(0),
+           searching_(false) {}
+
+  // Viterbi search keeping a score and a backpointer per position and
+  // last word; the sentence is built once along the best path.
+  // the work can be bounded by a budget of lattice operations (0 for no
+  // limit); when it runs out, the best path found so far is completed with
+  // the shortest words, and the search is to be finished by Resume().
+  // given the memo of the last input, best paths through the unchanged
+  // part of the word graph are taken over rather than searched again.
   shared_ptr<Sentence> MakeSentence(const WordGraph& graph,
-                                    size_t total_length) {
-    const int kMaxHomophonesInMind = 1;
-    std::map<int, shared_ptr<Sentence> > sentences;
-    sentences[0] = make_shared<Sentence>();
+                                    size_t total_length,
+                                    size_t budget = 0,
+                                    const SentenceMemo *memo = NULL) {
+    graph_ = &graph;
+    total_length_ = total_length;
+    nodes_.assign(total_length + 1, NodeList());
+    Node start;
+    start.weight = Sentence().weight();
+    nodes_[0].push_back(start);
+    recalled_length_ = memo ? Recall(*memo) : 0;
+    if (recalled_length_) {
+      EZDBGONLYLOGGERPRINT("recalled best paths to %d of %d.",
+                           recalled_length_, total_length_);
+    }
+    frontier_ = graph.begin();
+    arcs_.clear();
+    states_.clear();
+    queue_ = StateQueue();
+    searching_ = false;
+    return Resume(budget);
+  }
+
+  // continues the search where the budget ran out; returns the best
+  // sentence found by then.
+  shared_ptr<Sentence> Resume(size_t budget = 0) {
+    if (!graph_)
+      return shared_ptr<Sentence>();
     // dynamic programming
-    BOOST_FOREACH(const WordGraph::value_type& w, graph) {
-      size_t start_pos = w.first;
+    size_t operations = 0;
+    for (; frontier_ != graph_->end(); ++frontier_) {
+      if (budget && operations >= budget)
+        break;
+      size_t start_pos = frontier_->first;
       EZDBGONLYLOGGERVAR(start_pos);
-      if (sentences.find(start_pos) == sentences.end())
+      if (start_pos >= total_length_ || nodes_[start_pos].empty())
         continue;
-      BOOST_FOREACH(const UserDictEntryCollector::value_type& x, w.second) {
-        size_t end_pos = x.first;
-        if (start_pos == 0 && end_pos == total_length)
-          continue;  // exclude single words from the result
-        EZDBGONLYLOGGERVAR(end_pos);
-        const DictEntryList &entries(x.second);
-        for (size_t i = 0; i < kMaxHomophonesInMind && i < entries.size(); ++i) {
-          const shared_ptr<DictEntry> &e(entries[i]);
-          shared_ptr<Sentence> new_sentence = make_shared<Sentence>(*sentences[start_pos]);
-          new_sentence->Extend(*e, end_pos);
-          if (sentences.find(end_pos) == sentences.end() ||
-              sentences[end_pos]->weight() < new_sentence->weight()) {
-            EZDBGONLYLOGGERPRINT("updated sentences[%d] with '%s', %g",
-                                 end_pos,
-                                 new_sentence->text().c_str(),
-                                 new_sentence->weight());
-            sentences[end_pos] = new_sentence;
-          }
+      // words ending within the recalled part are known
+      UserDictEntryCollector::const_iterator x =
+          frontier_->second.upper_bound(recalled_length_);
+      for (; x != frontier_->second.end(); ++x) {
+        operations += Relax(start_pos, *x);
+      }
+    }
+    if (!finished()) {
+      EZLOGGERPRINT("out of budget for sentence making at %d of %d.",
+                    frontier_->first, total_length_);
+      WordGraph::const_iterator w = frontier_;
+      for (; w != graph_->end(); ++w) {
+        size_t start_pos = w->first;
+        if (start_pos >= total_length_ || nodes_[start_pos].empty())
+          continue;
+        UserDictEntryCollector::const_iterator x =
+            w->second.upper_bound(recalled_length_);
+        for (; x != w->second.end(); ++x) {
+          if (Relax(start_pos, *x))
+            break;
         }
       }
     }
-    if (sentences.find(total_length) == sentences.end())
+    const NodeList &last(nodes_[total_length_]);
+    if (last.empty())
+      return shared_ptr<Sentence>();
+    size_t k = 0;
+    for (size_t i = 1; i < last.size(); ++i) {
+      if (last[i].weight > last[k].weight)
+        k = i;
+    }
+    // follow the backpointers
+    typedef std::pair<size_t, size_t> Step;  // (position, node)
+    std::vector<Step> path;
+    for (size_t pos = total_length_; pos > 0; ) {
+      path.push_back(std::make_pair(pos, k));
+      const Node &n(nodes_[pos][k]);
+      pos = n.start_pos;
+      k = n.prev;
+    }
+    shared_ptr<Sentence> sentence = make_shared<Sentence>();
+    BOOST_REVERSE_FOREACH(const Step &s, path) {
+      sentence->Extend(*nodes_[s.first][s.second].entry, s.first);
+    }
+    return sentence;
+  }
+
+  // true if the best sentence has been found
+  bool finished() const {
+    return graph_ && frontier_ == graph_->end();
+  }
+
+  // keeps the settled part of the search in the memo for the next input.
+  // the memo holds on to the word graph, to be compared with the next one.
+  void Memorize(const shared_ptr<const WordGraph> &graph,
+                SentenceMemo *memo) const {
+    if (!memo || !graph_ || graph.get() != graph_)
+      return;
+    size_t settled = total_length_;
+    if (!finished()) {
+      settled = (std::min)(static_cast<size_t>(frontier_->first),
+                           total_length_);
+      settled = (std::max)(settled, recalled_length_);
+    }
+    memo->graph = graph;
+    memo->bigram_model = bigram_model_;
+    memo->total_length = total_length_;
+    memo->settled_length = settled;
+    memo->nodes.assign(nodes_.begin(), nodes_.begin() + settled + 1);
+  }
+
+  // yields sentences along the best paths in descending order of weight,
+  // one at a time, starting again from the best one.
+  // to be called after MakeSentence(), while the word graph is kept alive.
+  // it runs an A* search backwards from the end of input, guided by the
+  // best weights to each position found by the Viterbi search.
+  // with a bigram model, the guide is no longer exact at word boundaries,
+  // so that the order of the sentences is approximate.
+  shared_ptr<Sentence> NextSentence() {
+    const size_t kMaxSearchStates = 10000;
+    if (!graph_ || nodes_.empty())
+      return shared_ptr<Sentence>();
+    if (!finished())
+      Resume();
+    if (nodes_[total_length_].empty())
       return shared_ptr<Sentence>();
-    else
-      return sentences[total_length];
+    if (!searching_)
+      StartSearch();
+    while (!queue_.empty()) {
+      size_t k = queue_.top().second;
+      queue_.pop();
+      if (states_[k].pos == 0)
+        return BuildSentence(k);
+      if (states_.size() >= kMaxSearchStates)
+        continue;
+      BOOST_FOREACH(const Arc &a, arcs_[states_[k].pos]) {
+        if (nodes_[a.start_pos].empty())
+          continue;
+        SearchState t;
+        t.pos = a.start_pos;
+        t.end_pos = states_[k].pos;
+        t.weight = Sentence::ExtendWeight(states_[k].weight, *a.entry) *
+            Bigram(a.entry, states_[k].entry);
+        t.entry = a.entry;
+        t.next = k;
+        // estimated by the best prefix joined with the path
+        double estimate = BestPrefix(t.pos, t.entry) * t.weight;
+        queue_.push(std::make_pair(estimate, states_.size()));
+        states_.push_back(t);
+      }
+    }
+    return shared_ptr<Sentence>();
+  }
+
+  // the score of a path is corrected by the association of adjacent words
+  void set_bigram_model(const shared_ptr<BigramModel> &model) {
+    bigram_model_ = model;
+  }
+
+ protected:
+  typedef SentenceMemo::Node Node;
+  typedef SentenceMemo::NodeList NodeList;
+  struct Arc {
+    size_t start_pos;
+    const DictEntry *entry;
+  };
+  // a path from pos to the end of input
+  struct SearchState {
+    size_t pos;
+    size_t end_pos;  // of the word starting at pos
+    double weight;
+    const DictEntry *entry;
+    size_t next;  // the state at end_pos
+  };
+  typedef std::priority_queue<std::pair<double, size_t> > StateQueue;
+
+  // the number of homophones to try in a sentence
+  size_t NumHomophones(
+      size_t start_pos, const UserDictEntryCollector::value_type& x) const {
+    size_t end_pos = x.first;
+    if (start_pos == 0 && end_pos == total_length_)
+      return 0;  // exclude single words from the result
+    if (end_pos > total_length_ || x.second.empty())
+      return 0;
+    // the word after does not matter without a bigram model
+    if (!bigram_model_)
+      return 1;
+    return (std::min)(x.second.size(), kMaxHomophones);
+  }
+
+  // extends the paths to start_pos with each homophone;
+  // returns the number of lattice operations, 0 if the word can't be
+  // part of a sentence
+  size_t Relax(size_t start_pos, const UserDictEntryCollector::value_type& x) {
+    size_t end_pos = x.first;
+    size_t num_homophones = NumHomophones(start_pos, x);
+    if (!num_homophones)
+      return 0;
+    EZDBGONLYLOGGERVAR(end_pos);
+    const NodeList &from(nodes_[start_pos]);
+    NodeList &to(nodes_[end_pos]);
+    for (size_t h = 0; h < num_homophones; ++h) {
+      const DictEntry *e = x.second[h].get();
+      // the path ending with the word
+      size_t k = 0;
+      if (bigram_model_) {
+        while (k < to.size() && to[k].entry != e)
+          ++k;
+      }
+      for (size_t i = 0; i < from.size(); ++i) {
+        double weight = Sentence::ExtendWeight(from[i].weight, *e) *
+            Bigram(from[i].entry, e);
+        if (k == to.size())
+          to.push_back(Node());
+        else if (to[k].weight >= weight)
+          continue;
+        EZDBGONLYLOGGERPRINT("updated nodes[%d] with '%s', %g",
+                             end_pos, e->text.c_str(), weight);
+        Node &n(to[k]);
+        n.weight = weight;
+        n.start_pos = start_pos;
+        n.prev = i;
+        n.homophone = h;
+        n.entry = e;
+      }
+    }
+    return num_homophones * from.size();
   }
+
+  // the best weight of a path to pos, followed by the word
+  double BestPrefix(size_t pos, const DictEntry *next) const {
+    double best = 0.0;
+    BOOST_FOREACH(const Node &n, nodes_[pos]) {
+      best = (std::max)(best, n.weight * Bigram(n.entry, next));
+    }
+    return best;
+  }
+
+  // groups of homophones are interchangeable in a sentence if those tried
+  // score the same
+  static bool SameWord(const UserDictEntryCollector::value_type& x,
+                       const UserDictEntryCollector::value_type& y) {
+    if (x.first != y.first)
+      return false;
+    size_t n = (std::min)(x.second.size(), kMaxHomophones);
+    if (n != (std::min)(y.second.size(), kMaxHomophones))
+      return false;
+    for (size_t i = 0; i < n; ++i) {
+      const DictEntry &a(*x.second[i]);
+      const DictEntry &b(*y.second[i]);
+      if (!(a.text == b.text && a.weight == b.weight && a.code == b.code))
+        return false;
+    }
+    return true;
+  }
+
+  // returns the end of the first word that differs between the groups
+  // of words, or the limit if there is none before it.
+  static size_t FirstChange(const UserDictEntryCollector *x,
+                            const UserDictEntryCollector *y, size_t limit) {
+    if (!x || !y) {
+      const UserDictEntryCollector *z = x ? x : y;
+      return z->empty() ? limit : (std::min)(z->begin()->first, limit);
+    }
+    UserDictEntryCollector::const_iterator i = x->begin();
+    UserDictEntryCollector::const_iterator j = y->begin();
+    for (; i != x->end() && j != y->end(); ++i, ++j) {
+      if (!SameWord(*i, *j))
+        return (std::min)((std::min)(i->first, j->first), limit);
+    }
+    if (i != x->end())
+      return (std::min)(i->first, limit);
+    if (j != y->end())
+      return (std::min)(j->first, limit);
+    return limit;
+  }
+
+  // takes over the best paths to positions that only words unchanged
+  // since the last input lead to; returns the last of such positions.
+  size_t Recall(const SentenceMemo &memo) {
+    if (!memo.graph || memo.nodes.empty() ||
+        memo.bigram_model != bigram_model_)
+      return 0;
+    size_t limit = (std::min)(memo.settled_length, total_length_);
+    if (memo.total_length != total_length_) {
+      // a single word spanning the whole input is left out of either search
+      limit = (std::min)(limit,
+                         (std::min)(memo.total_length, total_length_) - 1);
+    }
+    // nodes up to the end of the first changed word minus one are intact
+    WordGraph::const_iterator i = memo.graph->begin();
+    WordGraph::const_iterator j = graph_->begin();
+    while (limit > 0) {
+      bool has_i = i != memo.graph->end() &&
+          static_cast<size_t>(i->first) < limit;
+      bool has_j = j != graph_->end() &&
+          static_cast<size_t>(j->first) < limit;
+      if (!has_i && !has_j)
+        break;
+      size_t end_pos;
+      if (has_i && has_j && i->first == j->first) {
+        end_pos = FirstChange(&i->second, &j->second, limit + 1);
+        ++i;
+        ++j;
+      }
+      else if (has_i && (!has_j || i->first < j->first)) {
+        end_pos = FirstChange(&i->second, NULL, limit + 1);
+        ++i;
+      }
+      else {
+        end_pos = FirstChange(NULL, &j->second, limit + 1);
+        ++j;
+      }
+      limit = (std::min)(limit, end_pos - 1);
+    }
+    if (limit == 0)
+      return 0;
+    // the words are the same, but are to be found in the new word graph
+    for (size_t pos = 1; pos <= limit; ++pos) {
+      NodeList nodes(memo.nodes[pos]);
+      BOOST_FOREACH(Node &n, nodes) {
+        n.entry = FindWord(n.start_pos, pos, n.homophone);
+        if (!n.entry) {
+          EZLOGGERPRINT("Warning: word [%d, %d) is missing from the graph.",
+                        n.start_pos, pos);
+          return pos - 1;
+        }
+      }
+      nodes_[pos].swap(nodes);
+    }
+    return limit;
+  }
+
+  const DictEntry* FindWord(size_t start_pos, size_t end_pos,
+                            size_t homophone) const {
+    WordGraph::const_iterator w = graph_->find(start_pos);
+    if (w == graph_->end())
+      return NULL;
+    UserDictEntryCollector::const_iterator x = w->second.find(end_pos);
+    if (x == w->second.end() || homophone >= x->second.size())
+      return NULL;
+    return x->second[homophone].get();
+  }
+
+  double Bigram(const DictEntry *left, const DictEntry *right) const {
+    if (!bigram_model_ || !left || !right)
+      return 1.0;
+    return bigram_model_->Query(left->text, right->text);
+  }
+
+  void StartSearch() {
+    arcs_.assign(total_length_ + 1, std::vector<Arc>());
+    BOOST_FOREACH(const WordGraph::value_type& w, *graph_) {
+      size_t start_pos = w.first;
+      if (start_pos >= total_length_)
+        continue;
+      BOOST_FOREACH(const UserDictEntryCollector::value_type& x, w.second) {
+        size_t num_homophones = NumHomophones(start_pos, x);
+        for (size_t h = 0; h < num_homophones; ++h) {
+          Arc a;
+          a.start_pos = start_pos;
+          a.entry = x.second[h].get();
+          arcs_[x.first].push_back(a);
+        }
+      }
+    }
+    SearchState end;
+    end.pos = total_length_;
+    end.end_pos = total_length_;
+    end.weight = Sentence().weight();
+    end.entry = NULL;
+    end.next = 0;
+    states_.push_back(end);
+    queue_.push(std::make_pair(BestPrefix(total_length_, NULL), 0));
+    searching_ = true;
+  }
+
+  shared_ptr<Sentence> BuildSentence(size_t k) const {
+    shared_ptr<Sentence> sentence = make_shared<Sentence>();
+    for (; states_[k].entry; k = states_[k].next) {
+      sentence->Extend(*states_[k].entry, states_[k].end_pos);
+    }
+    return sentence;
+  }
+
+  shared_ptr<BigramModel> bigram_model_;
+  const WordGraph *graph_;
+  size_t total_length_;
+  std::vector<NodeList> nodes_;
+  // the part of nodes_ taken over from the memo
+  size_t recalled_length_;
+  // the next group of words to explore
+  WordGraph::const_iterator frontier_;
+  bool searching_;
+  std::vector<std::vector<Arc> > arcs_;
+  std::vector<SearchState> states_;
+  StateQueue queue_;
 };  
 
 }  // namespace rime
@@ -12,46 +12,181 @@
 
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <rime/common.h>
 #include "spelling.h"
 
 namespace rime {
 
+class FuzzyMatcher;
 class Prism;
 
 typedef int SyllableId;
 
-typedef std::map<SyllableId, SpellingProperties> SpellingMap;
-typedef std::map<size_t, SpellingType> VertexMap;
-typedef std::map<size_t, SpellingMap> EndVertexMap;
-typedef std::map<size_t, EndVertexMap> EdgeMap;
+struct SyllableEdge {
+  size_t start;
+  size_t end;
+  SyllableEdge(size_t _start, size_t _end) : start(_start), end(_end) {}
+};
 
-typedef std::vector<const SpellingProperties*> SpellingPropertiesList;
-typedef std::map<SyllableId, SpellingPropertiesList> SpellingIndex;
-typedef std::map<size_t, SpellingIndex> SpellingIndices;
+struct SyllableSpelling {
+  SyllableId syllable_id;
+  SpellingProperties properties;
+  SyllableSpelling(SyllableId id, const SpellingProperties &props)
+      : syllable_id(id), properties(props) {}
+};
 
+// the graph is laid out in flat arrays indexed by position:
+// edges starting at vertex i are edges[edge_offsets[i], edge_offsets[i + 1])
+// ordered by end position; spellings on edge e are
+// spellings[spelling_offsets[e], spelling_offsets[e + 1]) ordered by syllable id;
+// the transposed index lists spellings on edges starting at vertex i as
+// index[index_offsets[i], index_offsets[i + 1]), ordered by syllable id
+// and then by end position, longer spellings first.
 struct SyllableGraph {
   size_t input_length;
   size_t interpreted_length;
-  VertexMap vertices;
-  EdgeMap edges;
-  SpellingIndices indices;
+  std::vector<SpellingType> vertices;  // kInvalidSpelling if not a vertex
+  std::vector<size_t> edge_offsets;
+  std::vector<SyllableEdge> edges;
+  std::vector<size_t> spelling_offsets;
+  std::vector<SyllableSpelling> spellings;
+  std::vector<size_t> index_offsets;
+  std::vector<size_t> index;  // positions in spellings
   SyllableGraph() : input_length(0), interpreted_length(0) {}
+
+  // builds the transposed index for vertices from pos on,
+  // following what is indexed for vertices before it
+  void Transpose(size_t pos = 0);
+  // empties the graph, keeping its storage for reuse
+  void Clear();
+
+  bool HasVertex(size_t pos) const {
+    return pos < vertices.size() && vertices[pos] != kInvalidSpelling;
+  }
+  size_t num_vertices() const;
+  size_t edges_begin(size_t pos) const {
+    return pos + 1 < edge_offsets.size() ? edge_offsets[pos] : 0;
+  }
+  size_t edges_end(size_t pos) const {
+    return pos + 1 < edge_offsets.size() ? edge_offsets[pos + 1] : 0;
+  }
+  size_t num_edges(size_t pos) const {
+    return edges_end(pos) - edges_begin(pos);
+  }
+  size_t spellings_begin(size_t edge) const { return spelling_offsets[edge]; }
+  size_t spellings_end(size_t edge) const { return spelling_offsets[edge + 1]; }
+  size_t index_begin(size_t pos) const {
+    return pos + 1 < index_offsets.size() ? index_offsets[pos] : 0;
+  }
+  size_t index_end(size_t pos) const {
+    return pos + 1 < index_offsets.size() ? index_offsets[pos + 1] : 0;
+  }
+  const SyllableSpelling& indexed_spelling(size_t k) const {
+    return spellings[index[k]];
+  }
+  const SyllableEdge* FindEdge(size_t start, size_t end) const;
+  const SpellingProperties* FindSpelling(size_t start, size_t end,
+                                         SyllableId syllable_id) const;
+};
+
+// syllable graphs built for a segment, keyed by prism and input span,
+// so that translators of the segment share a single build.
+// translators sharing a prism are expected to syllabify in the same way.
+class SyllableGraphCache {
+ public:
+  shared_ptr<SyllableGraph> Find(const Prism *prism,
+                                 size_t start, size_t end) const;
+  void Add(const Prism *prism, size_t start, size_t end,
+           const shared_ptr<SyllableGraph> &graph);
+
+ private:
+  typedef std::pair<const Prism*, std::pair<size_t, size_t> > Key;
+  std::map<Key, shared_ptr<SyllableGraph> > graphs_;
 };
 
+// limits on the work done for pathological input; zero means unlimited.
+// an edge here counts as one syllable spelled between two vertices.
+const size_t kDefaultMaxEdgesPerVertex = 256;
+const size_t kDefaultMaxTotalEdges = 4096;
+const size_t kDefaultMaxInputLength = 128;
+
 class Syllabifier {
  public:
-  Syllabifier() : enable_completion_(false) {}
+  Syllabifier()
+      : enable_completion_(false), fuzzy_matcher_(NULL),
+        max_edges_per_vertex_(kDefaultMaxEdgesPerVertex),
+        max_total_edges_(kDefaultMaxTotalEdges),
+        max_input_length_(kDefaultMaxInputLength),
+        last_prism_(NULL), last_prism_revision_(0),
+        last_type_(kNormalSpelling) {}
   explicit Syllabifier(const std::string &delimiters, bool enable_completion = false)
-      : delimiters_(delimiters), enable_completion_(enable_completion) {}
+      : delimiters_(delimiters), enable_completion_(enable_completion),
+        fuzzy_matcher_(NULL),
+        max_edges_per_vertex_(kDefaultMaxEdgesPerVertex),
+        max_total_edges_(kDefaultMaxTotalEdges),
+        max_input_length_(kDefaultMaxInputLength),
+        last_prism_(NULL), last_prism_revision_(0),
+        last_type_(kNormalSpelling) {}
   
+  // when called again with input that shares a prefix with the last one,
+  // only vertices affected by the change are explored in the prism,
+  // and the pruned graph of the last input is reused up to a vertex
+  // where nothing has changed.
+  // when the limits are hit, the graph covers only the beginning of the input.
   int BuildSyllableGraph(const std::string &input, Prism &prism, SyllableGraph *graph);
 
+  void set_fuzzy_matcher(const FuzzyMatcher *fuzzy_matcher) {
+    fuzzy_matcher_ = fuzzy_matcher;
+    Reset();
+  }
+  // most favored edges are kept: normal spellings first, then longer ones
+  void set_max_edges_per_vertex(size_t limit) {
+    max_edges_per_vertex_ = limit;
+    Reset();
+  }
+  void set_max_total_edges(size_t limit) {
+    max_total_edges_ = limit;
+    Reset();
+  }
+  // longer input is analyzed only up to the limit
+  void set_max_input_length(size_t limit) { max_input_length_ = limit; }
+
  protected:
+  struct ExploredVertex {
+    bool explored;
+    size_t reach;  // the spellings depend on input[0, reach)
+    // syllables spelled from the vertex, ordered by end position
+    // and then by syllable id
+    std::vector<SyllableSpelling> spellings;
+    ExploredVertex() : explored(false), reach(0) {}
+  };
+
+  // forgets what is known of the last input
+  void Reset();
+  // returns the position before which explored vertices are unchanged
+  size_t DiscardStaleVertices(const std::string &input, Prism &prism);
+  const std::vector<SyllableSpelling>& Explore(const std::string &input,
+                                               Prism &prism, size_t pos);
   void CheckOverlappedSpellings(SyllableGraph *graph, size_t start, size_t end);
-  void Transpose(SyllableGraph* graph);
   
   std::string delimiters_;
   bool enable_completion_;
+  const FuzzyMatcher *fuzzy_matcher_;
+  size_t max_edges_per_vertex_;
+  size_t max_total_edges_;
+  size_t max_input_length_;
+
+  // unpruned results of the forward pass on the last input, by position
+  std::vector<ExploredVertex> explored_;
+  std::string last_input_;
+  const Prism *last_prism_;
+  uint32_t last_prism_revision_;
+  // pruned graph built for the last input, and the type of its paths
+  SyllableGraph last_graph_;
+  SpellingType last_type_;
 };
 
 }  // namespace rime
@@ -54,6 +54,10 @@ class Context {
   bool ReopenPreviousSelection();
   bool ClearNonConfirmedComposition();
   bool RefreshNonConfirmedComposition();
+  // to be called at idle time; updates candidates without notification.
+  // returns true if the composition may have changed, while more steps
+  // may follow.
+  bool RefineComposition();
 
   void set_input(const std::string &value);
   const std::string& input() const { return input_; }
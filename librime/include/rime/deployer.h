@@ -38,11 +38,14 @@ class Deployer {
   std::string distribution_name;
   std::string distribution_code_name;
   std::string distribution_version;
+  // storage engine for user dbs, set in installation.yaml
+  std::string user_db_engine;
   // }
 
   Deployer() : shared_data_dir("."),
                user_data_dir("."),
-               user_id("unknown") {}
+               user_id("unknown"),
+               user_db_engine("kyotocabinet") {}
 
   void ScheduleTask(const shared_ptr<DeploymentTask>& task);
   shared_ptr<DeploymentTask> NextTask();
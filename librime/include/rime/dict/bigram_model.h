@@ -0,0 +1,104 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#ifndef RIME_BIGRAM_MODEL_H_
+#define RIME_BIGRAM_MODEL_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <rime/common.h>
+#include <rime/dict/mapped_file.h>
+
+namespace rime {
+
+namespace bigram {
+
+// an occupied slot holds the fingerprint of a word pair in the high 56 bits
+// and the quantized log2 of its association factor in the low 8 bits;
+// zero marks an empty slot.
+typedef uint64_t Slot;
+
+struct Metadata {
+  static const int kFormatMaxLength = 32;
+  char format[kFormatMaxLength];
+  uint32_t source_checksum;
+  uint32_t num_pairs;
+  uint32_t num_slots;  // a power of 2
+  OffsetPtr<Slot> slots;
+};
+
+struct Record {
+  std::string left;
+  std::string right;
+  double factor;
+};
+
+typedef std::vector<Record> Records;
+
+}  // namespace bigram
+
+// BigramCollector estimates how strongly adjacent words are associated,
+// from phrases split into the words of a weighted vocabulary.
+// the factor of a word pair (a, b) is P(b|a) / P(b), by which the score
+// of a sentence made of unigrams is corrected.
+class BigramCollector {
+ public:
+  BigramCollector() : total_weight_(0.0) {}
+
+  // adds a word and its frequency to the vocabulary;
+  // words of more than one character are also taken as phrases.
+  void AddWord(const std::string &word, double weight);
+  // adds a phrase from another source, e.g. the user's commit history
+  void AddPhrase(const std::string &phrase, double weight);
+  // collects the most frequent word pairs that are more likely than chance
+  void Collect(size_t max_pairs, bigram::Records *result);
+
+  size_t vocabulary_size() const { return vocabulary_.size(); }
+  double average_weight() const;
+
+ protected:
+  typedef std::map<std::string, double> WeightMap;
+
+  bool Segment(const std::string &phrase, std::vector<std::string> *words);
+  void Count(const std::string &phrase, double weight);
+
+  WeightMap vocabulary_;
+  double total_weight_;
+  std::vector<std::pair<std::string, double> > phrases_;
+  WeightMap unigram_counts_;
+  WeightMap bigram_counts_;  // keyed by "left\tright"
+};
+
+// a compact bigram model mapped into memory, shared by all processes.
+// pairs are looked up by fingerprint in an open addressing hash table;
+// false positives are possible but unlikely.
+class BigramModel : public MappedFile {
+ public:
+  BigramModel(const std::string &file_name)
+      : MappedFile(file_name), metadata_(NULL), slots_(NULL), mask_(0) {}
+
+  bool Load();
+  bool Save();
+  bool Build(const bigram::Records &records, uint32_t source_checksum = 0);
+
+  // returns the association factor of the adjacent words, 1.0 if unknown
+  double Query(const std::string &left, const std::string &right) const;
+
+  size_t num_pairs() const;
+  uint32_t source_checksum() const;
+
+ private:
+  bigram::Metadata *metadata_;
+  const bigram::Slot *slots_;
+  uint64_t mask_;
+};
+
+}  // namespace rime
+
+#endif  // RIME_BIGRAM_MODEL_H_
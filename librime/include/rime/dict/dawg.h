@@ -0,0 +1,61 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+
+#ifndef RIME_DAWG_H_
+#define RIME_DAWG_H_
+
+#include <stdint.h>
+#include <vector>
+
+namespace rime {
+
+namespace dawg {
+
+// bit fields: label (8) | final (1) | last (1) | target (22)
+struct Transition {
+  uint32_t base;
+  // number of keys reachable by preceding transitions of the same node
+  uint32_t rank;
+};
+
+}  // namespace dawg
+
+// A minimized directed acyclic word graph.
+// Common suffixes of the keys are shared; the value of a key is its
+// ordinal in the sorted key set, which is computed while traversing the
+// graph from the ranks stored in transitions (as Darts does by default).
+class Dawg {
+ public:
+  // traversal state: node (31) | final (1) | rank (32); zero at the root
+  typedef uint64_t State;
+
+  Dawg() : array_(NULL), size_(0) {}
+
+  // keys must be sorted and unique
+  bool Build(size_t num_keys, const char * const *keys);
+  void set_array(const dawg::Transition *array, size_t size);
+  void clear();
+
+  // same as Darts::DoubleArray::traverse() except that a state is passed
+  int Traverse(const char *key, size_t length, State *state) const;
+  int ExactMatchSearch(const char *key, size_t length) const;
+
+  const dawg::Transition *array() const { return array_; }
+  size_t size() const { return size_; }
+  size_t total_size() const { return size_ * sizeof(dawg::Transition); }
+
+ private:
+  std::vector<dawg::Transition> buffer_;
+  const dawg::Transition *array_;
+  size_t size_;
+};
+
+}  // namespace rime
+
+#endif  // RIME_DAWG_H_
@@ -19,6 +19,12 @@ class Prism;
 class Table;
 class TreeDb;
 
+namespace dictionary {
+
+uint32_t checksum(const std::string &file_name);
+
+}  // namespace dictionary
+
 class DictCompiler {
  public:
   DictCompiler(Dictionary *dictionary);
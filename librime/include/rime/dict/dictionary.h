@@ -9,12 +9,13 @@
 #ifndef RIME_DICTIONARY_H_
 #define RIME_DICTIONARY_H_
 
-#include <list>
 #include <map>
 #include <string>
 #include <vector>
 #include <rime/common.h>
 #include <rime/component.h>
+#include <rime/dict/bigram_model.h>
+#include <rime/dict/position_map.h>
 #include <rime/dict/prism.h>
 #include <rime/dict/table.h>
 #include <rime/dict/vocabulary.h>
@@ -42,46 +43,92 @@ struct Chunk {
   size_t cursor;
   std::string remaining_code;  // for predictive queries
   double credibility;
+  int rank;  // breaks ties between head elements; the lower goes first
 
-  Chunk() : entries(NULL), size(0), cursor(0), credibility(1.0) {}
+  Chunk() : entries(NULL), size(0), cursor(0), credibility(1.0), rank(0) {}
   Chunk(const Code &c, const table::Entry *e, double cr = 1.0)
-      : code(c), entries(e), size(1), cursor(0), credibility(cr) {}
+      : code(c), entries(e), size(1), cursor(0), credibility(cr), rank(0) {}
   Chunk(const TableAccessor &a, double cr = 1.0)
       : code(a.index_code()), entries(a.entry()),
-        size(a.remaining()), cursor(0), credibility(cr) {}
+        size(a.remaining()), cursor(0), credibility(cr), rank(0) {}
   Chunk(const TableAccessor &a, const std::string &r, double cr = 1.0)
       : code(a.index_code()), entries(a.entry()),
-        size(a.remaining()), cursor(0), remaining_code(r), credibility(cr) {}
+        size(a.remaining()), cursor(0), remaining_code(r), credibility(cr),
+        rank(0) {}
+
+  void swap(Chunk &other);
 };
 
-bool compare_chunk_by_leading_element(const Chunk &a, const Chunk &b);
+bool compare_chunk_by_head_element(const Chunk &a, const Chunk &b);
 
 }  // namespace dictionary
 
-class DictEntryIterator : protected std::list<dictionary::Chunk> {
+// a table entry looked at in place, without being copied out of the
+// mapped file; valid until the iterator presenting it moves on.
+struct DictEntryView {
+  const char *text;
+  size_t text_length;
+  double weight;
+  const int *code;  // syllable ids
+  size_t code_length;
+  const std::string *remaining_code;  // for predictive queries
+
+  DictEntryView() : text(NULL), text_length(0), weight(0.0),
+                    code(NULL), code_length(0), remaining_code(NULL) {}
+  // as would be set to DictEntry::comment
+  const std::string comment() const;
+  // copies the entry out, reusing the storage of the given dict entry
+  void CopyTo(DictEntry *entry) const;
+};
+
+// merges chunks of entries, each sorted by weight, into one sequence.
+// chunks are kept in a binary heap by their head elements once sorted,
+// so that advancing to the next entry takes O(log n) time.
+// chunks added after Sort() are merged in as the iterator advances.
+class DictEntryIterator : protected std::vector<dictionary::Chunk> {
  public:
-  typedef std::list<dictionary::Chunk> Base;
+  typedef std::vector<dictionary::Chunk> Base;
 
   DictEntryIterator();
   DictEntryIterator(const DictEntryIterator &other);
-  DictEntryIterator& operator= (DictEntryIterator &other);
+  DictEntryIterator& operator= (const DictEntryIterator &other);
 
   void AddChunk(const dictionary::Chunk &chunk);
   void Sort();
+  // makes a copy of the next entry, kept until the iterator moves on
   shared_ptr<DictEntry> Peek();
+  // looks at the next entry without making a copy
+  bool Peek(DictEntryView *view) const;
   bool Next();
   bool Skip(size_t num_entries);
   bool exhausted() const;
   size_t entry_count() const { return entry_count_; }
+  // drops all chunks, keeping the storage for reuse
+  void clear();
 
 private:
+  void PopFront();
+  void MergePending();
+  void SiftUp(size_t i);
+  void SiftDown(size_t i);
+
   shared_ptr<DictEntry> entry_;
   size_t entry_count_;
+  // chunks are in the order added until sorted
+  bool sorted_;
+  // the number of chunks in the heap; the rest are pending
+  size_t heap_size_;
+  int head_rank_;
+  int tail_rank_;
 };
 
-struct DictEntryCollector : std::map<size_t, DictEntryIterator> {
+// entries indexed by end position
+struct DictEntryCollector : PositionMap<DictEntryIterator> {
 };
 
+// collected entries indexed by start position
+typedef PositionMap<DictEntryCollector> DictEntryLattice;
+
 class Config;
 class Schema;
 struct SyllableGraph;
@@ -90,7 +137,9 @@ class Dictionary : public Class<Dictionary, Schema*> {
  public:
   Dictionary(const std::string &name,
              const shared_ptr<Table> &table,
-             const shared_ptr<Prism> &prism);
+             const shared_ptr<Prism> &prism,
+             const shared_ptr<BigramModel> &bigram_model =
+             shared_ptr<BigramModel>());
   virtual ~Dictionary();
 
   bool Exists() const;
@@ -100,6 +149,19 @@ class Dictionary : public Class<Dictionary, Schema*> {
   shared_ptr<DictEntryCollector> Lookup(const SyllableGraph &syllable_graph,
                                         size_t start_pos,
                                         double initial_credibility = 1.0);
+  // collects into the given result, whose storage may be reused;
+  // returns false if no words start at the position
+  bool Lookup(const SyllableGraph &syllable_graph,
+              size_t start_pos,
+              double initial_credibility,
+              DictEntryCollector *result);
+  // looks up words starting at every vertex of the syllable graph in one
+  // call, which saves the setup of a lookup per vertex; see Table::Query().
+  // initial_credibility[i], if given, applies to words starting at
+  // position i.
+  bool Lookup(const SyllableGraph &syllable_graph,
+              const std::vector<double> &initial_credibility,
+              DictEntryLattice *result);
   // if predictive is true, do an expand search with limit,
   // otherwise do an exact match.
   // return num of matching keys.
@@ -114,11 +176,14 @@ class Dictionary : public Class<Dictionary, Schema*> {
   
   shared_ptr<Table> table() { return table_; }
   shared_ptr<Prism> prism() { return prism_; }
+  // optional; available if it has been built at deployment
+  shared_ptr<BigramModel> bigram_model() { return bigram_model_; }
 
  private:
   std::string name_;
   shared_ptr<Table> table_;
   shared_ptr<Prism> prism_;
+  shared_ptr<BigramModel> bigram_model_;
 };
 
 class DictionaryComponent : public Dictionary::Component {
@@ -133,6 +198,7 @@ class DictionaryComponent : public Dictionary::Component {
  private:
   std::map<std::string, weak_ptr<Prism> > prism_map_;
   std::map<std::string, weak_ptr<Table> > table_map_;
+  weak_ptr<BigramModel> bigram_model_;
 };
 
 }  // namespace rime
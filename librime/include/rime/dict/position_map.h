@@ -0,0 +1,176 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#ifndef RIME_POSITION_MAP_H_
+#define RIME_POSITION_MAP_H_
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include <boost/foreach.hpp>
+#include <boost/iterator/filter_iterator.hpp>
+#include <rime/common.h>
+
+namespace rime {
+
+template <class T>
+struct PositionMapSlot {
+  size_t first;  // the position
+  T second;
+  bool occupied;
+  PositionMapSlot() : first(0), second(), occupied(false) {}
+};
+
+// maps positions in the input to values, like std::map<size_t, T>, but the
+// values are laid out flat in a vector indexed by position, which is sized
+// to the input.  values of cleared positions keep their storage, so that a
+// map can be reused with no allocation for positions it has seen before.
+// T is required to have clear().
+template <class T>
+class PositionMap {
+ public:
+  typedef size_t key_type;
+  typedef T mapped_type;
+  typedef PositionMapSlot<T> value_type;
+
+ private:
+  typedef std::vector<value_type> Slots;
+  struct IsOccupied {
+    bool operator() (const value_type &x) const { return x.occupied; }
+  };
+
+ public:
+  typedef boost::filter_iterator<IsOccupied,
+                                 typename Slots::iterator> iterator;
+  typedef boost::filter_iterator<IsOccupied,
+                                 typename Slots::const_iterator> const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  PositionMap() : size_(0) {}
+
+  iterator begin() { return iterator(slots_.begin(), slots_.end()); }
+  iterator end() { return iterator(slots_.end(), slots_.end()); }
+  const_iterator begin() const {
+    return const_iterator(slots_.begin(), slots_.end());
+  }
+  const_iterator end() const {
+    return const_iterator(slots_.end(), slots_.end());
+  }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  T& operator[] (size_t pos) {
+    if (pos >= slots_.size())
+      reserve(pos + 1);
+    value_type &x(slots_[pos]);
+    if (!x.occupied) {
+      x.occupied = true;
+      ++size_;
+    }
+    return x.second;
+  }
+  iterator find(size_t pos) {
+    if (pos >= slots_.size() || !slots_[pos].occupied)
+      return end();
+    return iterator(slots_.begin() + pos, slots_.end());
+  }
+  const_iterator find(size_t pos) const {
+    if (pos >= slots_.size() || !slots_[pos].occupied)
+      return end();
+    return const_iterator(slots_.begin() + pos, slots_.end());
+  }
+  // the first position after pos
+  iterator upper_bound(size_t pos) {
+    if (pos + 1 >= slots_.size())
+      return end();
+    return iterator(slots_.begin() + pos + 1, slots_.end());
+  }
+  const_iterator upper_bound(size_t pos) const {
+    if (pos + 1 >= slots_.size())
+      return end();
+    return const_iterator(slots_.begin() + pos + 1, slots_.end());
+  }
+
+  size_t erase(size_t pos) {
+    if (pos >= slots_.size() || !slots_[pos].occupied)
+      return 0;
+    Release(&slots_[pos]);
+    --size_;
+    return 1;
+  }
+  // empties the map, while the storage is kept for reuse
+  void clear() {
+    BOOST_FOREACH(value_type &x, slots_) {
+      if (x.occupied)
+        Release(&x);
+    }
+    size_ = 0;
+  }
+  // makes room for positions below num_positions; better done before
+  // filling the map, as growing it copies the values.
+  void reserve(size_t num_positions) {
+    size_t k = slots_.size();
+    if (num_positions <= k)
+      return;
+    slots_.resize(num_positions);
+    for (; k < num_positions; ++k)
+      slots_[k].first = k;
+  }
+  void swap(PositionMap &other) {
+    slots_.swap(other.slots_);
+    std::swap(size_, other.size_);
+  }
+
+ private:
+  static void Release(value_type *x) {
+    x->occupied = false;
+    x->second.clear();
+  }
+
+  Slots slots_;
+  size_t size_;
+};
+
+// keeps a few maps whose storage is recycled across keystrokes.
+// a map is handed out again once it is no longer referred to elsewhere.
+template <class M>
+class PositionMapPool {
+ public:
+  explicit PositionMapPool(size_t capacity = 4) : capacity_(capacity) {}
+
+  shared_ptr<M> Get() {
+    BOOST_FOREACH(const shared_ptr<M> &m, pool_) {
+      if (m.unique()) {
+        m->clear();
+        return m;
+      }
+    }
+    shared_ptr<M> m = make_shared<M>();
+    if (pool_.size() < capacity_)
+      pool_.push_back(m);
+    return m;
+  }
+
+ private:
+  size_t capacity_;
+  std::vector<shared_ptr<M> > pool_;
+};
+
+}  // namespace rime
+
+#endif  // RIME_POSITION_MAP_H_
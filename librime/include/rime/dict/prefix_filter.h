@@ -0,0 +1,53 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#ifndef RIME_PREFIX_FILTER_H_
+#define RIME_PREFIX_FILTER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace rime {
+
+// a bloom filter that tells whether some code starts with a given prefix.
+// codes are made of fixed-width units, and the prefixes of every code are
+// added up to max_depth units; a longer prefix is always let through.
+// there are no false negatives, while about 1% of absent prefixes pass.
+class PrefixFilter {
+ public:
+  PrefixFilter(size_t unit_width, size_t max_depth);
+
+  // empties the filter, making room for the prefixes of num_codes codes
+  void Reset(size_t num_codes);
+  // marks the filter to be rebuilt
+  void Clear();
+  void Add(const std::string &code);
+  bool MayContain(const std::string &prefix) const;
+
+  // once it has been built
+  bool ready() const { return !bits_.empty(); }
+  // when over capacity, the filter lets through more than it should
+  bool full() const { return num_prefixes_ > capacity_; }
+  size_t max_depth() const { return max_depth_; }
+
+ private:
+  bool Test(const char *p, size_t n) const;
+  void Set(const char *p, size_t n);
+
+  size_t unit_width_;
+  size_t max_depth_;
+  size_t capacity_;
+  size_t num_prefixes_;
+  uint64_t mask_;
+  std::vector<uint64_t> bits_;
+};
+
+}  // namespace rime
+
+#endif  // RIME_PREFIX_FILTER_H_
@@ -0,0 +1,57 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2011 RIME Developers
+// License: GPLv3
+//
+// 2011-11-27 GONG Chen <chen.sst@gmail.com>
+//
+#ifndef RIME_PRESET_VOCABULARY_H_
+#define RIME_PRESET_VOCABULARY_H_
+
+#if defined(_MSC_VER)
+#pragma warning(disable: 4244)
+#pragma warning(disable: 4351)
+#endif
+#include <kchashdb.h>
+#if defined(_MSC_VER)
+#pragma warning(default: 4351)
+#pragma warning(default: 4244)
+#endif
+
+#include <string>
+#include <rime/common.h>
+
+namespace rime {
+
+// the essay: a vocabulary of words and phrases with their frequencies
+class PresetVocabulary {
+ public:
+  static PresetVocabulary *Create();
+  // random access
+  bool GetWeightForEntry(const std::string &key, double *weight);
+  // traversing
+  void Reset();
+  bool GetNextEntry(std::string *key, std::string *value);
+  bool IsQualifiedPhrase(const std::string& phrase,
+                         const std::string& weight_str);
+  
+  void set_max_phrase_length(int length) { max_phrase_length_ = length; }
+  void set_min_phrase_weight(double weight) { min_phrase_weight_ = weight; }
+
+  static std::string file_name();
+
+ protected:
+  PresetVocabulary(const shared_ptr<kyotocabinet::TreeDB>& db)
+      : db_(db), cursor_(db->cursor()),
+        max_phrase_length_(0), min_phrase_weight_(0.0) {}
+  
+  shared_ptr<kyotocabinet::TreeDB> db_;
+  scoped_ptr<kyotocabinet::DB::Cursor> cursor_;
+  int max_phrase_length_;
+  double min_phrase_weight_;
+};
+
+}  // namespace rime
+
+#endif  // RIME_PRESET_VOCABULARY_H_
@@ -17,6 +17,7 @@
 #include <darts.h>
 #include <rime/common.h>
 #include <rime/algo/spelling.h>
+#include <rime/dict/dawg.h>
 #include <rime/dict/mapped_file.h>
 #include <rime/dict/vocabulary.h>
 
@@ -47,6 +48,9 @@ struct Metadata {
   OffsetPtr<char> double_array;
   OffsetPtr<SpellingMap> spelling_map;
   char alphabet[256];
+  // 1.0-dawg
+  uint32_t dawg_size;
+  OffsetPtr<dawg::Transition> dawg;
 };
 
 }  // namespace prism
@@ -70,10 +74,20 @@ class Script;
 class Prism : public MappedFile {
  public:
   typedef Darts::DoubleArray::result_pair_type Match;
+  // position of a node in the trie; 0 is the root
+  typedef uint64_t NodePos;
+
+  enum Backend { kDoubleArray, kDawg };
+  // selected by the build option ENABLE_DAWG_PRISM
+  static const Backend kDefaultBackend;
+  // version of the file format; older files number spelling types
+  // without kFuzzySpelling, and are to be rebuilt
+  static const double kFormat;
 
   Prism(const std::string &file_name)
       : MappedFile(file_name), trie_(new Darts::DoubleArray),
-        metadata_(NULL), spelling_map_(NULL), format_(0.0) {}
+        dawg_(new Dawg), backend_(kDefaultBackend),
+        metadata_(NULL), spelling_map_(NULL), format_(0.0), revision_(0) {}
 
   bool Load();
   bool Save();
@@ -84,20 +98,36 @@ class Prism : public MappedFile {
   
   bool HasKey(const std::string &key);
   bool GetValue(const std::string &key, int *value);
-  void CommonPrefixSearch(const std::string &key, std::vector<Match> *result);
+  size_t CommonPrefixSearch(const std::string &key, std::vector<Match> *result);
   void ExpandSearch(const std::string &key, std::vector<Match> *result, size_t limit);
+  // walks down the trie from *node_pos (0 for the root) along key;
+  // returns the value of the key reached, -1 if it's not a key,
+  // or -2 if there is no such path.
+  int Traverse(const std::string &key, NodePos *node_pos);
   const SpellingAccessor QuerySpelling(int spelling_id);
 
   size_t array_size() const;
+  // size in bytes of the trie image
+  size_t image_size() const;
+
+  double format() const { return format_; }
+  // changes whenever the prism is loaded or built again
+  uint32_t revision() const { return revision_; }
+  Backend backend() const { return backend_; }
+  // takes effect on Build()
+  void set_backend(Backend backend) { backend_ = backend; }
 
   uint32_t dict_file_checksum() const;
   uint32_t schema_file_checksum() const;
 
  private:
   scoped_ptr<Darts::DoubleArray> trie_;
+  scoped_ptr<Dawg> dawg_;
+  Backend backend_;
   prism::Metadata* metadata_;
   prism::SpellingMap* spelling_map_;
   double format_;
+  uint32_t revision_;
 };
 
 }  // namespace rime
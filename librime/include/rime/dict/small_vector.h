@@ -0,0 +1,203 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#ifndef RIME_SMALL_VECTOR_H_
+#define RIME_SMALL_VECTOR_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/utility/enable_if.hpp>
+
+namespace rime {
+
+// a vector of plain old data with room for N elements inside the object;
+// it only takes memory from the heap when it grows longer than that.
+// the interface follows std::vector.
+template <class T, size_t N>
+class SmallVector {
+ public:
+  typedef T value_type;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  SmallVector() : data_(buffer_), size_(0), capacity_(N) {}
+  explicit SmallVector(size_t n, const T &value = T())
+      : data_(buffer_), size_(0), capacity_(N) {
+    assign(n, value);
+  }
+  template <class InputIterator>
+  SmallVector(InputIterator first, InputIterator last,
+              typename boost::disable_if<
+              boost::is_integral<InputIterator> >::type* = 0)
+      : data_(buffer_), size_(0), capacity_(N) {
+    assign(first, last);
+  }
+  SmallVector(const SmallVector &other)
+      : data_(buffer_), size_(0), capacity_(N) {
+    assign(other.begin(), other.end());
+  }
+  ~SmallVector() {
+    if (data_ != buffer_)
+      delete[] data_;
+  }
+  SmallVector& operator= (const SmallVector &other) {
+    if (this != &other)
+      assign(other.begin(), other.end());
+    return *this;
+  }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  size_t max_size() const { return size_t(-1) / sizeof(T); }
+  bool empty() const { return size_ == 0; }
+
+  T& operator[] (size_t i) { return data_[i]; }
+  const T& operator[] (size_t i) const { return data_[i]; }
+  T& at(size_t i) {
+    if (i >= size_)
+      throw std::out_of_range("SmallVector::at");
+    return data_[i];
+  }
+  const T& at(size_t i) const {
+    if (i >= size_)
+      throw std::out_of_range("SmallVector::at");
+    return data_[i];
+  }
+  T& front() { return data_[0]; }
+  const T& front() const { return data_[0]; }
+  T& back() { return data_[size_ - 1]; }
+  const T& back() const { return data_[size_ - 1]; }
+
+  void reserve(size_t n) {
+    if (n <= capacity_)
+      return;
+    T *p = new T[n];
+    std::copy(data_, data_ + size_, p);
+    if (data_ != buffer_)
+      delete[] data_;
+    data_ = p;
+    capacity_ = n;
+  }
+  void resize(size_t n, const T &value = T()) {
+    if (n > size_) {
+      Grow(n);
+      std::fill(data_ + size_, data_ + n, value);
+    }
+    size_ = n;
+  }
+  void clear() { size_ = 0; }
+
+  void push_back(const T &value) {
+    if (size_ == capacity_) {
+      T x(value);  // might refer to an element
+      Grow(size_ + 1);
+      data_[size_++] = x;
+    }
+    else {
+      data_[size_++] = value;
+    }
+  }
+  void pop_back() { --size_; }
+
+  void assign(size_t n, const T &value) {
+    clear();
+    resize(n, value);
+  }
+  template <class InputIterator>
+  typename boost::disable_if<boost::is_integral<InputIterator> >::type
+  assign(InputIterator first, InputIterator last) {
+    clear();
+    insert(end(), first, last);
+  }
+
+  iterator insert(iterator pos, const T &value) {
+    size_t k = pos - data_;
+    T x(value);
+    Grow(size_ + 1);
+    std::copy_backward(data_ + k, data_ + size_, data_ + size_ + 1);
+    data_[k] = x;
+    ++size_;
+    return data_ + k;
+  }
+  void insert(iterator pos, size_t n, const T &value) {
+    size_t k = pos - data_;
+    T x(value);
+    Grow(size_ + n);
+    std::copy_backward(data_ + k, data_ + size_, data_ + size_ + n);
+    std::fill(data_ + k, data_ + k + n, x);
+    size_ += n;
+  }
+  template <class InputIterator>
+  typename boost::disable_if<boost::is_integral<InputIterator> >::type
+  insert(iterator pos, InputIterator first, InputIterator last) {
+    // the range might be within this vector
+    SmallVector tmp;
+    for (; first != last; ++first)
+      tmp.push_back(*first);
+    size_t k = pos - data_;
+    size_t n = tmp.size();
+    Grow(size_ + n);
+    std::copy_backward(data_ + k, data_ + size_, data_ + size_ + n);
+    std::copy(tmp.begin(), tmp.end(), data_ + k);
+    size_ += n;
+  }
+
+  iterator erase(iterator pos) {
+    return erase(pos, pos + 1);
+  }
+  iterator erase(iterator first, iterator last) {
+    std::copy(last, end(), first);
+    size_ -= last - first;
+    return first;
+  }
+
+  void swap(SmallVector &other) {
+    SmallVector tmp(*this);
+    *this = other;
+    other = tmp;
+  }
+
+ private:
+  void Grow(size_t n) {
+    if (n > capacity_)
+      reserve((std::max)(n, capacity_ * 2));
+  }
+
+  T buffer_[N];
+  T *data_;
+  size_t size_;
+  size_t capacity_;
+};
+
+}  // namespace rime
+
+#endif  // RIME_SMALL_VECTOR_H_
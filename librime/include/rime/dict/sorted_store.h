@@ -0,0 +1,136 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#ifndef RIME_SORTED_STORE_H_
+#define RIME_SORTED_STORE_H_
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <boost/thread.hpp>
+#include <rime/common.h>
+#include <rime/dict/mapped_file.h>
+#include <rime/dict/user_db.h>
+
+namespace rime {
+
+namespace sorted {
+
+struct Record {
+  OffsetPtr<char> key;
+  uint32_t key_length;
+  OffsetPtr<char> value;
+  uint32_t value_length;
+};
+
+typedef Array<Record> RecordArray;
+
+struct Metadata {
+  static const int kFormatMaxLength = 32;
+  char format[kFormatMaxLength];
+  // the log of updates made on the table bears the same stamp
+  uint32_t stamp;
+  uint32_t num_records;
+  OffsetPtr<RecordArray> records;
+};
+
+// an update yet to be compacted into the table;
+// an erased record is kept as a tombstone till then
+struct MemRecord {
+  std::string value;
+  bool erased;
+
+  MemRecord() : erased(true) {}
+  explicit MemRecord(const std::string &v) : value(v), erased(false) {}
+};
+
+typedef std::map<std::string, MemRecord> Memtable;
+
+}  // namespace sorted
+
+// records sorted by key in a memory mapped file, written as a whole
+class SortedTable : public MappedFile {
+ public:
+  explicit SortedTable(const std::string &file_name)
+      : MappedFile(file_name), metadata_(NULL), records_(NULL) {}
+
+  // tells a sorted table from files of other formats
+  static bool IsSortedTable(const std::string &file_name);
+
+  bool Load();
+  bool Save();
+  // writes the records from the cursor, which are visited twice
+  bool Build(DbCursor *source, uint32_t stamp);
+
+  // index of the first record whose key is not less than the given one
+  size_t LowerBound(const std::string &key) const;
+  bool Get(const std::string &key, std::string *value) const;
+  const std::string key(size_t index) const;
+  const std::string value(size_t index) const;
+  size_t size() const { return records_ ? records_->size : 0; }
+  uint32_t stamp() const { return metadata_ ? metadata_->stamp : 0; }
+
+ private:
+  sorted::Metadata *metadata_;
+  sorted::RecordArray *records_;
+};
+
+// a storage engine made of a read-only sorted table, a memtable of recent
+// updates and an append log of them. once the memtable has grown large,
+// it is merged with the table into a new one in a background thread.
+class SortedStore : public DbStore {
+ public:
+  SortedStore();
+  virtual ~SortedStore();
+
+  virtual bool Open(const std::string &file_name, bool read_only);
+  virtual bool Close();
+  virtual bool Get(const std::string &key, std::string *value);
+  virtual bool Set(const std::string &key, const std::string &value);
+  virtual bool Remove(const std::string &key);
+  virtual bool Synchronize();
+  virtual bool DumpSnapshot(const std::string &snapshot_file);
+  virtual bool LoadSnapshot(const std::string &snapshot_file);
+  virtual DbCursor* NewCursor();
+  virtual DbCursor* NewSnapshotCursor();
+
+  const std::string& file_name() const { return file_name_; }
+  const std::string log_file_name() const { return file_name_ + ".log"; }
+  // where a new table is written before it replaces the current one
+  const std::string temp_file_name() const { return file_name_ + ".tmp"; }
+
+ protected:
+  bool Update(const std::string &key, const sorted::MemRecord &record);
+  bool ReplayLog();
+  bool AppendToLog(const std::string &key, const sorted::MemRecord &record);
+  // leaves in the log only the updates in the memtable
+  bool RewriteLog();
+  bool InstallTable();
+  void StartCompaction();
+  void Compact();
+  bool FinishCompaction(bool wait);
+
+  std::string file_name_;
+  bool loaded_;
+  bool read_only_;
+  shared_ptr<SortedTable> table_;
+  shared_ptr<sorted::Memtable> memtable_;
+  // updates being merged into the table
+  shared_ptr<sorted::Memtable> frozen_;
+  std::ofstream log_;
+  // guards the members read by background threads
+  boost::mutex mutex_;
+  boost::thread compaction_thread_;
+  bool compacted_;
+  // the memtable is compacted once it holds this many records
+  size_t compaction_threshold_;
+};
+
+}  // namespace rime
+
+#endif  // RIME_SORTED_STORE_H_
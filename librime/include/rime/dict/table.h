@@ -123,6 +123,8 @@ class TableVisitor {
 };
 
 typedef std::map<int, std::vector<TableAccessor> > TableQueryResult;
+// query results indexed by start position
+typedef std::map<int, TableQueryResult> TableQueryLattice;
 
 struct SyllableGraph;
 
@@ -148,6 +150,12 @@ class Table : public MappedFile {
   bool Query(const SyllableGraph &syll_graph,
              size_t start_pos,
              TableQueryResult *result);
+  // queries from every vertex of the syllable graph in one call; each
+  // vertex still has its own search from the root of the index, only the
+  // queue and the result are shared, as searches from different vertices
+  // seldom reach the same node of the index at the same position.
+  bool Query(const SyllableGraph &syll_graph,
+             TableQueryLattice *result);
   uint32_t dict_file_checksum() const;
 
  private:
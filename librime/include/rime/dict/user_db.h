@@ -4,33 +4,66 @@
 // Copyleft 2011 RIME Developers
 // License: GPLv3
 //
-// A simple wrapper for kyotocabinet::TreeDB
+// A simple wrapper for kyotocabinet::TreeDB, or another storage engine
 // 
 // 2011-11-02 GONG Chen <chen.sst@gmail.com>
 //
 #ifndef RIME_USER_DB_H_
 #define RIME_USER_DB_H_
 
-#if defined(_MSC_VER)
-#pragma warning(disable: 4244)
-#pragma warning(disable: 4351)
-#endif
-#include <kchashdb.h>
-#if defined(_MSC_VER)
-#pragma warning(default: 4351)
-#pragma warning(default: 4244)
-#endif
-
+#include <fstream>
+#include <map>
 #include <string>
+#include <boost/thread.hpp>
 #include <rime/common.h>
 
 namespace rime {
 
+// iterates over the records of a DbStore in key order
+class DbCursor {
+ public:
+  virtual ~DbCursor() {}
+
+  // moves to the first record whose key is not less than the given one
+  virtual bool Jump(const std::string &key) = 0;
+  // moves to the last record whose key is not greater than the given one
+  virtual bool JumpBack(const std::string &key) = 0;
+  virtual bool GetKey(std::string *key) = 0;
+  virtual bool Get(std::string *key, std::string *value) = 0;
+  virtual bool Step() = 0;
+};
+
+// the storage engine underneath a TreeDb
+class DbStore {
+ public:
+  virtual ~DbStore() {}
+
+  virtual bool Open(const std::string &file_name, bool read_only) = 0;
+  virtual bool Close() = 0;
+  virtual bool Get(const std::string &key, std::string *value) = 0;
+  virtual bool Set(const std::string &key, const std::string &value) = 0;
+  virtual bool Remove(const std::string &key) = 0;
+  // makes the updates so far durable
+  virtual bool Synchronize() = 0;
+  virtual bool DumpSnapshot(const std::string &snapshot_file) = 0;
+  // merges the records in a snapshot dumped by any engine
+  virtual bool LoadSnapshot(const std::string &snapshot_file) = 0;
+  virtual DbCursor* NewCursor() = 0;  // should be freed by the caller
+  // a cursor over the records as of now, which may be used in another
+  // thread while the store is being updated
+  virtual DbCursor* NewSnapshotCursor() = 0;
+};
+
+// updates yet to be written into the db
+typedef std::map<std::string, std::string> PendingRecords;
+
+// iterates over records in the db merged with pending updates
 class TreeDbAccessor {
  public:
-  TreeDbAccessor() {}
-  explicit TreeDbAccessor(kyotocabinet::DB::Cursor *cursor,
-                          const std::string &prefix);
+  TreeDbAccessor() : pending_(NULL) {}
+  explicit TreeDbAccessor(DbCursor *cursor,
+                          const std::string &prefix,
+                          const PendingRecords *pending = NULL);
   ~TreeDbAccessor();
 
   bool Reset();
@@ -40,13 +73,26 @@ class TreeDbAccessor {
   bool exhausted();
 
  private:
-  scoped_ptr<kyotocabinet::DB::Cursor> cursor_;
+  bool PeekNextKey(std::string *key);
+
+  scoped_ptr<DbCursor> cursor_;
   std::string prefix_;
+  const PendingRecords *pending_;
+  PendingRecords::const_iterator pending_pos_;
 };
 
+// storage engines; kyotocabinet is the default
+extern const char kKyotoCabinetEngine[];
+// records sorted in a memory mapped file, with recent updates in memory
+// and in an append log
+extern const char kSortedEngine[];
+
+class DbFileLock;
+
 class TreeDb {
  public:
-  TreeDb(const std::string &name);
+  TreeDb(const std::string &name,
+         const std::string &engine = kKyotoCabinetEngine);
   virtual ~TreeDb();
 
   bool Exists() const;
@@ -56,25 +102,91 @@ class TreeDb {
   bool Close();
 
   const shared_ptr<TreeDbAccessor> Query(const std::string &key);
+  // iterates over the records stored so far, leaving out pending updates;
+  // unlike Query(), it may be used in another thread while the db is open
+  const shared_ptr<TreeDbAccessor> QueryStored(const std::string &key);
   bool Fetch(const std::string &key, std::string *value);
   bool Update(const std::string &key, const std::string &value);
   bool Erase(const std::string &key);
+  // dumps a full snapshot of the db
   bool Backup();
+  // records changes since the last snapshot in a delta file next to it;
+  // once the delta has grown too large, a full snapshot is dumped in a
+  // background thread.
+  bool UpdateSnapshot();
   bool RecoverFromSnapshot();
+  // rewrites the db file from a dump of its records, without the space
+  // left by erased ones
+  bool Defragment();
+  // loads a snapshot, along with its delta file if any
   bool Restore(const std::string& snapshot_file);
+  // bulk loads a snapshot into a new db file, which then takes the place
+  // of the current one in a single rename; the db should be closed.
+  bool Rebuild(const std::string& snapshot_file);
+
+  // with write-behind enabled, updates are kept in memory and appended to a
+  // journal; they are written into the db by Flush(), which is done on
+  // closing, before a backup, or when too many updates are pending.
+  // a journal left by a crash is replayed when the db is opened.
+  void EnableWriteBehind() { write_behind_ = true; }
+  bool Flush();
 
   const std::string& name() const { return name_; }
   const std::string& file_name() const { return file_name_; }
+  const std::string& engine() const { return engine_; }
+  const std::string journal_file_name() const {
+    return file_name_ + ".journal";
+  }
+  const std::string snapshot_file_name() const {
+    return file_name_ + ".snapshot";
+  }
   bool loaded() const { return loaded_; }
+  // whether the db is open for writing by another, in this process or not
+  bool IsInUse() const;
+  // changes each time the records are modified
+  uint64_t revision() const { return revision_; }
 
  protected:
   virtual bool CreateMetadata();
-  void Initialize();
+  void Initialize(const std::string &engine);
+  bool OpenStore();
+  bool Lock();
+  bool FinishConversion(const std::string &snapshot_file);
+  bool ConvertFromEngine(const std::string &engine,
+                         const std::string &snapshot_file);
+  bool ReplayJournal(bool read_only);
+  bool AppendToJournal(const std::string &key, const std::string &value);
+  bool AppendToSnapshotDelta();
+  bool ApplySnapshotDelta(const std::string &delta_file);
+  void DumpSnapshot();
+  bool FinishSnapshot(bool wait);
+  void UntrackedChange() {
+    snapshot_synced_ = false;
+    ++untracked_changes_;
+  }
   
   std::string name_;
   std::string file_name_;
+  std::string engine_;
   bool loaded_;
-  scoped_ptr<kyotocabinet::TreeDB> db_;
+  uint64_t revision_;
+  bool read_only_;
+  bool write_behind_;
+  scoped_ptr<DbStore> db_;
+  // held while the db is open for writing
+  scoped_ptr<DbFileLock> lock_;
+  PendingRecords pending_;
+  std::ofstream journal_;
+  // whether the snapshot and its delta are up to date with the db,
+  // before the pending updates
+  bool snapshot_synced_;
+  // counts changes not recorded in the delta; a snapshot dumped in the
+  // background is up to date only if there has been none since it began
+  uint64_t untracked_changes_;
+  uint64_t untracked_changes_at_dump_;
+  bool snapshot_dumped_;
+  uintmax_t snapshot_delta_offset_;
+  boost::thread snapshot_thread_;
 };
 
 typedef TreeDbAccessor UserDbAccessor;
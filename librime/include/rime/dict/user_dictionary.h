@@ -7,32 +7,120 @@
 // 2011-10-30 GONG Chen <chen.sst@gmail.com>
 //
 #ifndef RIME_USER_DICTIONARY_H_
-#define RIME_USER_DICTIONRAY_H_
+#define RIME_USER_DICTIONARY_H_
 
 #include <stdint.h>
 #include <map>
 #include <string>
+#include <vector>
+#include <boost/thread.hpp>
 #include <rime/common.h>
 #include <rime/component.h>
+#include <rime/dict/position_map.h>
 #include <rime/dict/vocabulary.h>
 
 namespace rime {
 
 typedef uint64_t TickCount;
   
-struct UserDictEntryCollector : std::map<size_t, DictEntryList> {
+// entries indexed by end position
+struct UserDictEntryCollector : PositionMap<DictEntryList> {
 };
 
+// collected entries indexed by start position
+typedef PositionMap<UserDictEntryCollector> WordGraph;
+
 class Schema;
 class Table;
 class Prism;
 class UserDb;
+class TreeDbAccessor;
+class PrefixFilter;
 struct SyllableGraph;
 struct DfsState;
+struct UserDictCache;
+
+// the code in a user db key is packed as fixed-width syllable ids, which
+// index the syllabary saved in the db metadata.  every byte of a packed id
+// has the high bit set, so that packed keys keep the order of spelled ones
+// ("a b \t..." < "ab \t..."), and sort after metadata and spelled keys.
+class UserDbSyllabary {
+ public:
+  static const size_t kSyllableIdWidth = 2;
+  static const int kMaxSyllableId = (1 << 14) - 1;
+
+  void Assign(const Syllabary &syllabary);
+  bool Load(UserDb *db);
+  bool Save(UserDb *db) const;
+
+  // 'a b \tAB' => packed key
+  bool PackKey(const std::string &spelled_key, std::string *packed_key) const;
+  // packed key => 'a b \tAB'
+  bool SpellKey(const std::string &packed_key, std::string *spelled_key) const;
+  // returns -1 if the syllable is missing
+  int GetSyllableId(const std::string &syllable) const;
+  // packs the keys in the db with this syllabary, which is then saved.
+  // spelled keys are packed, and so are those packed with a syllabary saved
+  // earlier; as it scans the whole db, it is left to the deployment tasks.
+  bool Repack(UserDb *db) const;
+
+  bool empty() const { return syllables_.empty(); }
+  bool operator== (const UserDbSyllabary &other) const {
+    return syllables_ == other.syllables_;
+  }
+  bool operator!= (const UserDbSyllabary &other) const {
+    return !(*this == other);
+  }
+
+  // appends a packed syllable id to the key
+  static bool PackSyllableId(int syllable_id, std::string *key);
+  static bool IsPackedKey(const std::string &key);
+
+ private:
+  std::vector<std::string> syllables_;
+  std::map<std::string, int> syllable_ids_;
+};
+
+// a prefix filter over the codes in a user db, shared by the user dicts on
+// it.  the db is scanned in a background thread, so that starting a session
+// is not held up; until the filter is built, every branch is sought in the db.
+class UserDictFilter {
+ public:
+  explicit UserDictFilter(size_t max_depth);
+  ~UserDictFilter();
+
+  // starts scanning the db, unless it is under way.  the db should stay
+  // open for as long as the filter lives.
+  void Build(UserDb *db);
+  // takes in the result once the scan is done; returns false while it is
+  // still under way
+  bool FinishBuilding(bool wait);
+  // to be called for each new entry, lest it should be filtered out
+  void Add(const std::string &code);
+
+  // NULL until built
+  const PrefixFilter* filter() const { return filter_.get(); }
+  bool ready() const { return filter_.get() != NULL; }
+  // over capacity, it should be rebuilt with room for more
+  bool full() const;
+
+ private:
+  void Scan(shared_ptr<TreeDbAccessor> accessor);
+
+  size_t max_depth_;
+  scoped_ptr<PrefixFilter> filter_;
+  // written by the scan
+  scoped_ptr<PrefixFilter> built_;
+  // codes of entries added while the scan is under way
+  std::vector<std::string> added_codes_;
+  boost::thread thread_;
+};
 
 class UserDictionary : public Class<UserDictionary, Schema*> {
  public:
-  explicit UserDictionary(const shared_ptr<UserDb> &user_db);
+  explicit UserDictionary(const shared_ptr<UserDb> &user_db,
+                          const shared_ptr<UserDictFilter> &prefix_filter =
+                          shared_ptr<UserDictFilter>());
   virtual ~UserDictionary();
 
   void Attach(const shared_ptr<Table> &table, const shared_ptr<Prism> &prism);
@@ -43,19 +131,44 @@ class UserDictionary : public Class<UserDictionary, Schema*> {
                                             size_t start_pos,
                                             size_t depth_limit = 0,
                                             double initial_credibility = 1.0);
+  // collects into the given result, whose storage may be reused
+  bool Lookup(const SyllableGraph &syllable_graph,
+              size_t start_pos,
+              size_t depth_limit,
+              double initial_credibility,
+              UserDictEntryCollector *result);
+  // looks up words starting at every vertex of the syllable graph.
+  // each vertex has a search of its own, which seeks in the db anew;
+  // they share the cursor, the cache and a tick count fetch.
+  // see also Dictionary::Lookup()
+  bool Lookup(const SyllableGraph &syllable_graph,
+              size_t depth_limit,
+              const std::vector<double> &initial_credibility,
+              WordGraph *result);
   bool UpdateEntry(const DictEntry &entry, int commit);
   bool UpdateTickCount(TickCount increment);
 
   const std::string& name() const { return name_; }
   const TickCount tick() const { return tick_; }
 
+  // values of a user dict entry are stored in a packed binary record
+  static const std::string PackValues(int commit_count,
+                                      double dee,
+                                      TickCount tick);
+  // also accepts text records written by earlier versions
   static bool UnpackValues(const std::string &value,
                            int *commit_count, double *dee, TickCount *tick);
 
  protected:
   bool Initialize();
   bool FetchTickCount();
-  bool TranslateCodeToString(const Code &code, std::string *result);
+  bool LoadSyllabary();
+  bool HasSpelledKeys();
+  bool PackSyllableId(int syllable_id, std::string *key) const;
+  void SyncCache();
+  const PrefixFilter* GetPrefixFilter();
+  void DfsLookupKeys(const SyllableGraph &syll_graph, size_t start_pos,
+                     DfsState *state);
   void DfsLookup(const SyllableGraph &syll_graph, size_t current_pos,
                  const std::string &current_prefix,
                  DfsState *state);
@@ -63,9 +176,18 @@ class UserDictionary : public Class<UserDictionary, Schema*> {
  private:
   std::string name_;
   shared_ptr<UserDb> db_;
+  // destroyed before the db, as the scan is stopped
+  shared_ptr<UserDictFilter> prefix_filter_;
   shared_ptr<Table> table_;
   shared_ptr<Prism> prism_;
   TickCount tick_;
+  scoped_ptr<UserDictCache> cache_;
+  // ids of the table's syllables in the syllabary the db is packed with,
+  // or -1 for those missing there; empty once the db has been repacked
+  std::vector<int> syllable_ids_;
+  // false for a db without a syllabary, whose keys are all spelled
+  bool packed_;
+  bool has_spelled_keys_;
 };
 
 class UserDictionaryComponent : public UserDictionary::Component {
@@ -74,8 +196,9 @@ class UserDictionaryComponent : public UserDictionary::Component {
   UserDictionary* Create(Schema *schema);
  private:
   std::map<std::string, weak_ptr<UserDb> > db_pool_;
+  std::map<std::string, weak_ptr<UserDictFilter> > filter_pool_;
 };
 
 }  // namespace rime
 
-#endif  // RIME_USER_DICTIONRAY_H_
+#endif  // RIME_USER_DICTIONARY_H_
@@ -15,12 +15,14 @@
 #include <string>
 #include <vector>
 #include <rime/common.h>
+#include <rime/dict/small_vector.h>
 
 namespace rime {
 
 typedef std::set<std::string> Syllabary;
 
-class Code : public std::vector<int> {
+// syllable ids; nearly all codes fit in the inline storage
+class Code : public SmallVector<int, 8> {
  public:
   static const size_t kIndexCodeMaxLength = 3;
 
@@ -68,6 +68,20 @@ class UserDictUpgration : public DeploymentTask {
   bool Run(Deployer* deployer);
 };
 
+// drops dead entries from user dictionaries and defragments them,
+// once there are enough of them
+class UserDictCompaction : public DeploymentTask {
+ public:
+  bool Run(Deployer* deployer);
+};
+
+// builds the bigram model for sentence making from the essay,
+// optionally mixed with phrases from the user's commit history.
+class BigramModelUpdate : public DeploymentTask {
+ public:
+  bool Run(Deployer* deployer);
+};
+
 }  // namespace rime
 
 #endif  // RIME_DEPLOYMENT_TASKS_H_
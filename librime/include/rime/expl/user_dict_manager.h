@@ -28,10 +28,25 @@ class UserDictManager {
 
   // CAVEAT: the user dict should be closed before the following operations
   bool Backup(const std::string& dict_name);
+  // merges a snapshot into the user dict it was taken from, in one pass
+  // over both; the result is bulk loaded into a new db file replacing it
   bool Restore(const std::string& snapshot_file);
+  // also repacks the keys with syllable ids of the dictionary's table,
+  // as it may have been rebuilt with a different syllabary
   bool UpgradeUserDict(const std::string& dict_name);
+  // the repacking takes a scan of the whole db; it is skipped while the db
+  // is open for writing elsewhere, or if the table is missing
+  bool SyncSyllabary(const std::string& dict_name);
+  // drops deleted entries, and those never committed whose weight has
+  // decayed below min_weight, then defragments the db; nothing is done
+  // unless the dead entries make up at least min_dead_ratio of all, or
+  // while the db is open for writing elsewhere.
+  // returns num of dropped entries, -1 denotes failure
+  int CompactUserDict(const std::string& dict_name, double min_weight,
+                      double min_dead_ratio = 0.0);
   // returns num of exported entires, -1 denotes failure
   int Export(const std::string& dict_name, const std::string& text_file);
+  // merges the entries in one pass as Restore() does.
   // returns num of imported entires, -1 denotes failure
   int Import(const std::string& dict_name, const std::string& text_file);
 
@@ -15,16 +15,39 @@
 #include <rime/translation.h>
 #include <rime/translator.h>
 #include <rime/algo/algebra.h>
+#include <rime/algo/fuzzy.h>
+#include <rime/algo/poet.h>
+#include <rime/algo/syllabifier.h>
+#include <rime/dict/dictionary.h>
+#include <rime/dict/user_dictionary.h>
 #include <rime/impl/translator_commons.h>
 
 namespace rime {
 
 class Code;
-struct DictEntry;
-struct DictEntryCollector;
-class Dictionary;
-class UserDictionary;
-struct SyllableGraph;
+
+// dict entries made of table entries for sentence making, recycled across
+// keystrokes.  an entry is handed out again once no word graph refers to it.
+class DictEntryPool {
+ public:
+  DictEntryPool() : next_(0) {}
+  // starts over from the first entry, for a new word graph
+  void Rewind() { next_ = 0; }
+  shared_ptr<DictEntry> Get();
+
+ private:
+  std::vector<shared_ptr<DictEntry> > pool_;
+  size_t next_;
+};
+
+// storage of lookup results, recycled across keystrokes
+struct R10nLookupPools {
+  PositionMapPool<DictEntryCollector> phrases;
+  PositionMapPool<UserDictEntryCollector> user_phrases;
+  PositionMapPool<DictEntryLattice> lattices;
+  PositionMapPool<WordGraph> word_graphs;
+  DictEntryPool entries;
+};
 
 class R10nTranslator : public Translator {
  public:
@@ -41,6 +64,13 @@ class R10nTranslator : public Translator {
   const std::string& delimiters() const { return delimiters_; }
   bool enable_completion() const { return enable_completion_; }
   int spelling_hints() const { return spelling_hints_; }
+  // lattice operations allowed for making a sentence per keystroke
+  int sentence_work_budget() const { return sentence_work_budget_; }
+  const FuzzyMatcher& fuzzy_matcher() const { return fuzzy_matcher_; }
+  // kept across keystrokes to reuse the analysis of unchanged input
+  Syllabifier& syllabifier() { return syllabifier_; }
+  SentenceMemo& sentence_memo() { return sentence_memo_; }
+  R10nLookupPools& lookup_pools() { return lookup_pools_; }
   
  protected:
   void OnCommit(Context *ctx);
@@ -52,6 +82,11 @@ class R10nTranslator : public Translator {
   std::string delimiters_;
   bool enable_completion_;
   int spelling_hints_;
+  int sentence_work_budget_;
+  FuzzyMatcher fuzzy_matcher_;
+  Syllabifier syllabifier_;
+  SentenceMemo sentence_memo_;
+  R10nLookupPools lookup_pools_;
   
   Projection preedit_formatter_;
   Projection comment_formatter_;
@@ -35,22 +35,36 @@ class ZhCandidate : public Candidate {
  public:
   ZhCandidate(size_t start, size_t end,
               const shared_ptr<DictEntry> &entry)
-      : Candidate("zh", start, end),
-        entry_(entry) {
+      : Candidate("zh", start, end), entry_(entry), has_comment_(false) {
   }
-  const std::string& text() const { return entry_->text; }
-  const std::string comment() const { return entry_->comment; }
-  const std::string preedit() const { return entry_->preedit; }
-  void set_comment(const std::string &comment) {
-    entry_->comment = comment;
+  // keeps the view of a table entry looked at in place; its text is read
+  // from the table when asked for, and the dict entry is not made until
+  // then, as on commit.
+  ZhCandidate(size_t start, size_t end, const DictEntryView &view);
+  const std::string& text() const;
+  const std::string comment() const;
+  const std::string preedit() const {
+    return entry_ ? entry_->preedit : preedit_;
   }
+  void set_comment(const std::string &comment);
   void set_preedit(const std::string &preedit) {
-    entry_->preedit = preedit;
+    (entry_ ? entry_->preedit : preedit_) = preedit;
   }
-  const Code& code() const { return entry_->code; }
-  const DictEntry& entry() const { return *entry_; }
+  const Code& code() const { return entry_ ? entry_->code : code_; }
+  const DictEntry& entry() const;
  protected:
-  const shared_ptr<DictEntry> entry_;
+  mutable shared_ptr<DictEntry> entry_;
+  // the table entry, till the dict entry is made.  its text stays in the
+  // mapped table; the code and the remaining code are kept here, for the
+  // iterator's chunk holding them is gone once it moves on.  a code of up
+  // to 8 syllables is stored in place.
+  DictEntryView view_;
+  Code code_;
+  std::string remaining_code_;
+  mutable std::string text_;  // read from the table on first use
+  std::string comment_;
+  bool has_comment_;
+  std::string preedit_;
 };
 
 //
@@ -62,6 +76,8 @@ class Sentence : public Candidate {
   }
   void Extend(const DictEntry& entry, size_t end_pos);
   void Offset(size_t offset);
+  // weight of a sentence after being extended with the entry
+  static double ExtendWeight(double weight, const DictEntry& entry);
 
   const std::string& text() const { return entry_.text; }
   const std::string comment() const { return entry_.comment; }
@@ -115,6 +131,7 @@ class CharsetFilter : public Translation {
   virtual shared_ptr<Candidate> Peek();
 
   static bool Passed(const std::string& text);
+  static bool Passed(const char* text);
   
  protected:
   bool LocateNextCandidate();
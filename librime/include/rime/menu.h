@@ -39,13 +39,22 @@ class Menu {
   size_t Prepare(size_t candidate_count);
   Page* CreatePage(size_t page_size, size_t page_no);
   shared_ptr<Candidate> GetCandidateAt(size_t index);
+  // refines candidates of the translations, including those exhausted;
+  // see Translation::Refine()
+  bool Refine();
 
   // CAVEAT: returns the number of candidates currently obtained,
   // rather than the total number of available candidates.
   size_t candidate_count() const { return candidates_.size(); }
 
  private:
+  void Refilter();
+
   std::vector<shared_ptr<Translation> > translations_;
+  // kept for refinement
+  std::vector<shared_ptr<Translation> > exhausted_translations_;
+  // as offered by the translations, before filtering
+  CandidateList recruits_;
   CandidateList candidates_;
   CandidateFilter filter_;
 };
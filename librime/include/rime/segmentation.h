@@ -18,6 +18,7 @@ namespace rime {
 
 class Candidate;
 class Menu;
+class SyllableGraphCache;
 
 struct Segment {
   enum Status {
@@ -33,6 +34,8 @@ struct Segment {
   shared_ptr<Menu> menu;
   size_t selected_index;
   std::string prompt;
+  // syllable graphs shared by translators of the segment
+  shared_ptr<SyllableGraphCache> syllable_graphs;
 
   Segment()
   : status(kVoid), start(0), end(0),
@@ -46,6 +49,7 @@ struct Segment {
     status = kVoid;
     tags.clear();
     menu.reset();
+    syllable_graphs.reset();
     selected_index = 0;
   }
 
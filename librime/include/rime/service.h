@@ -37,6 +37,7 @@ class Session {
   void ResetCommitText();
   bool CommitComposition();
   void ClearComposition();
+  bool RefineComposition();
 
   Context* context() const;
   Schema* schema() const;
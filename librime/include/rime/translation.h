@@ -32,6 +32,13 @@ class Translation {
   virtual int Compare(shared_ptr<Translation> other,
                       const CandidateList &candidates);
 
+  // finishes work left undone for lack of time, such as candidates made
+  // under a work budget, a step at a time. returns false once there is
+  // nothing left to refine; otherwise the refined candidate is to take the
+  // place of the draft, wherever it has been recruited.
+  virtual bool Refine(shared_ptr<Candidate> *draft,
+                      shared_ptr<Candidate> *refined) { return false; }
+
   bool exhausted() const { return exhausted_; }
 
  protected:
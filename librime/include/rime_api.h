@@ -142,6 +142,10 @@ RIME_API Bool RimeProcessKey(RimeSessionId session_id, int keycode, int mask);
 // return True if there is unread commit text
 RIME_API Bool RimeCommitComposition(RimeSessionId session_id);
 RIME_API void RimeClearComposition(RimeSessionId session_id);
+// to be called when idle, again and again while it returns True;
+// finishes candidates made in a hurry, a step at a time.
+// return True if the context may have changed and should be read again
+RIME_API Bool RimeRefineComposition(RimeSessionId session_id);
 
 // output
   
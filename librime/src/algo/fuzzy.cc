@@ -0,0 +1,181 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+#include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
+#include <rime/algo/fuzzy.h>
+
+namespace rime {
+
+struct FuzzyMatcher::SearchState {
+  Prism *prism;
+  const std::string *key;
+  // visited with and without a rule applied
+  std::set<std::pair<Prism::NodePos, size_t> > visited[2];
+  // (length, spelling id) -> whether matched only by applying rules
+  std::map<std::pair<size_t, int>, bool> matches;
+  size_t reach;  // see Prism::CommonPrefixSearch()
+
+  void AddMatch(size_t length, int value, bool fuzzy) {
+    std::pair<std::map<std::pair<size_t, int>, bool>::iterator, bool> r =
+        matches.insert(std::make_pair(std::make_pair(length, value), fuzzy));
+    if (!r.second && !fuzzy)
+      r.first->second = false;
+  }
+};
+
+FuzzyMatcher::FuzzyMatcher() {
+  Clear();
+}
+
+void FuzzyMatcher::Clear() {
+  rules_.clear();
+  nodes_.clear();
+  nodes_.push_back(Node());  // root
+}
+
+bool FuzzyMatcher::Load(ConfigListPtr settings) {
+  if (!settings) return false;
+  Clear();
+  for (size_t i = 0; i < settings->size(); ++i) {
+    ConfigValuePtr v(settings->GetValueAt(i));
+    if (!v || !AddRule(v->str())) {
+      EZLOGGERPRINT("Error loading fuzzy rule #%d.", i + 1);
+      Clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FuzzyMatcher::AddRule(const std::string &formula) {
+  size_t sep = formula.find_first_not_of("zyxwvutsrqponmlkjihgfedcba");
+  if (sep == std::string::npos)
+    return false;
+  std::vector<std::string> args;
+  boost::split(args, formula, boost::is_from_range(formula[sep], formula[sep]));
+  if (args.size() < 3 || args[0] != "fuzz")
+    return false;
+  FuzzyRule rule;
+  rule.key = args[1];
+  rule.typed = args[2];
+  if (!rule.key.empty() && rule.key[0] == '^') {
+    rule.at_start = true;
+    rule.key.erase(0, 1);
+  }
+  if (!rule.key.empty() && rule.key[rule.key.length() - 1] == '$') {
+    rule.at_end = true;
+    rule.key.erase(rule.key.length() - 1);
+  }
+  if ((rule.key.empty() && rule.typed.empty()) || rule.key == rule.typed) {
+    EZLOGGERPRINT("Invalid fuzzy rule: '%s'.", formula.c_str());
+    return false;
+  }
+  // insert the typed fragment into the trie
+  size_t t = 0;
+  BOOST_FOREACH(char c, rule.typed) {
+    std::map<char, size_t>::const_iterator it = nodes_[t].next.find(c);
+    if (it != nodes_[t].next.end()) {
+      t = it->second;
+    }
+    else {
+      size_t n = nodes_.size();
+      nodes_.push_back(Node());
+      nodes_[t].next[c] = n;
+      t = n;
+    }
+  }
+  nodes_[t].rules.push_back(rules_.size());
+  rules_.push_back(rule);
+  return true;
+}
+
+size_t FuzzyMatcher::CommonPrefixSearch(Prism &prism, const std::string &key,
+                                        std::vector<Prism::Match> *result,
+                                        std::vector<bool> *fuzzy) const {
+  if (!result)
+    return 0;
+  result->clear();
+  if (fuzzy)
+    fuzzy->clear();
+  if (key.empty())
+    return 1;
+  SearchState state;
+  state.prism = &prism;
+  state.key = &key;
+  state.reach = 0;
+  Search(&state, 0, 0, false);
+  // ordered by length, as returned by the double array
+  typedef std::pair<std::pair<size_t, int>, bool> Item;
+  BOOST_FOREACH(const Item &x, state.matches) {
+    Prism::Match m;
+    m.length = x.first.first;
+    m.value = x.first.second;
+    result->push_back(m);
+    if (fuzzy)
+      fuzzy->push_back(x.second);
+  }
+  return state.reach;
+}
+
+void FuzzyMatcher::Search(SearchState *state, Prism::NodePos node_pos,
+                          size_t key_pos, bool fuzzy) const {
+  if (!state->visited[fuzzy].insert(std::make_pair(node_pos, key_pos)).second)
+    return;
+  const std::string &key(*state->key);
+  int value = -1;
+  // advance by a typed character
+  state->reach = (std::max)(state->reach, key_pos + 1);
+  if (key_pos < key.length()) {
+    Prism::NodePos n = node_pos;
+    if (Step(state, std::string(1, key[key_pos]), &n, &value)) {
+      if (value >= 0)
+        state->AddMatch(key_pos + 1, value, fuzzy);
+      Search(state, n, key_pos + 1, fuzzy);
+    }
+  }
+  // try fuzzy rules whose typed fragment matches the input at key_pos
+  size_t t = 0;
+  size_t end_pos = key_pos;
+  while (true) {
+    BOOST_FOREACH(size_t i, nodes_[t].rules) {
+      const FuzzyRule &rule(rules_[i]);
+      if (rule.at_start && node_pos != 0)  // not at the trie root
+        continue;
+      Prism::NodePos n = node_pos;
+      if (!Step(state, rule.key, &n, &value))
+        continue;
+      if (value >= 0 && end_pos > 0)
+        state->AddMatch(end_pos, value, true);
+      // a syllable-final fragment ends the spelling here
+      if (!rule.at_end)
+        Search(state, n, end_pos, true);
+    }
+    state->reach = (std::max)(state->reach, end_pos + 1);
+    if (end_pos >= key.length())
+      break;
+    std::map<char, size_t>::const_iterator it =
+        nodes_[t].next.find(key[end_pos]);
+    if (it == nodes_[t].next.end())
+      break;
+    t = it->second;
+    ++end_pos;
+  }
+}
+
+bool FuzzyMatcher::Step(SearchState *state, const std::string &key,
+                        Prism::NodePos *node_pos, int *value) const {
+  *value = state->prism->Traverse(key, node_pos);
+  return *value != -2;
+}
+
+}  // namespace rime
@@ -7,12 +7,14 @@
 // 2011-07-12 Zou Xu <zouivex@gmail.com>
 // 2012-02-11 GONG Chen <chen.sst@gmail.com>
 //
+#include <algorithm>
 #include <functional>
 #include <queue>
 #include <utility>
 #include <vector>
 #include <boost/foreach.hpp>
 #include <rime/dict/prism.h>
+#include <rime/algo/fuzzy.h>
 #include <rime/algo/syllabifier.h>
 
 namespace rime {
@@ -20,11 +22,157 @@ namespace rime {
 typedef std::pair<size_t, SpellingType> Vertex;
 typedef std::priority_queue<Vertex, std::vector<Vertex>, std::greater<Vertex> > VertexQueue;
 
-int Syllabifier::BuildSyllableGraph(const std::string &input, Prism &prism, SyllableGraph *graph) {
-  if (input.empty())
+namespace {
+
+// normal spellings first, then longer ones
+struct CompareRankedSpellings {
+  bool operator() (const SyllableSpelling &a, const SyllableSpelling &b) const {
+    if (a.properties.type != b.properties.type)
+      return a.properties.type < b.properties.type;
+    if (a.properties.end_pos != b.properties.end_pos)
+      return a.properties.end_pos > b.properties.end_pos;
+    return a.syllable_id < b.syllable_id;
+  }
+};
+
+// by end position, then by syllable id, more favored spelling types first
+struct CompareSpellingsOnEdges {
+  bool operator() (const SyllableSpelling &a, const SyllableSpelling &b) const {
+    if (a.properties.end_pos != b.properties.end_pos)
+      return a.properties.end_pos < b.properties.end_pos;
+    if (a.syllable_id != b.syllable_id)
+      return a.syllable_id < b.syllable_id;
+    return a.properties.type < b.properties.type;
+  }
+};
+
+struct SameSyllableOnEdge {
+  bool operator() (const SyllableSpelling &a, const SyllableSpelling &b) const {
+    return a.properties.end_pos == b.properties.end_pos &&
+        a.syllable_id == b.syllable_id;
+  }
+};
+
+// orders spellings by edge, keeping the first of the most favored type
+// where a syllable is spelled more than once on an edge
+void UniqueSpellings(std::vector<SyllableSpelling> *spellings, size_t begin) {
+  std::stable_sort(spellings->begin() + begin, spellings->end(),
+                   CompareSpellingsOnEdges());
+  spellings->erase(std::unique(spellings->begin() + begin, spellings->end(),
+                               SameSyllableOnEdge()),
+                   spellings->end());
+}
+
+// keeps the most favored spellings of a vertex
+void TrimSpellings(std::vector<SyllableSpelling> *spellings, size_t limit) {
+  if (spellings->size() <= limit)
+    return;
+  std::sort(spellings->begin(), spellings->end(), CompareRankedSpellings());
+  spellings->erase(spellings->begin() + limit, spellings->end());
+  std::sort(spellings->begin(), spellings->end(), CompareSpellingsOnEdges());
+}
+
+// spellings dropped from the graph are marked kInvalidSpelling
+bool HasValidSpellings(const SyllableGraph &graph, size_t edge) {
+  for (size_t k = graph.spellings_begin(edge); k < graph.spellings_end(edge); ++k) {
+    if (graph.spellings[k].properties.type != kInvalidSpelling)
+      return true;
+  }
+  return false;
+}
+
+void InvalidateSpellings(SyllableGraph *graph, size_t pos) {
+  for (size_t k = graph->spellings_begin(graph->edges_begin(pos));
+       k < graph->spellings_begin(graph->edges_end(pos)); ++k) {
+    graph->spellings[k].properties.type = kInvalidSpelling;
+  }
+}
+
+// moves valid spellings on edges from vertex pos on, read from
+// edges[edge_begin, ...) and spellings[spelling_begin, ...), to follow
+// what is laid out before pos; edges left without spellings are dropped
+void RemoveInvalidSpellings(SyllableGraph *graph, size_t pos,
+                            size_t edge_begin, size_t spelling_begin) {
+  size_t num_edges = graph->edge_offsets[pos];
+  size_t num_spellings = graph->spelling_offsets[num_edges];
+  for (size_t i = pos; i + 1 < graph->edge_offsets.size(); ++i) {
+    size_t edge_end = graph->edge_offsets[i + 1];
+    graph->edge_offsets[i] = num_edges;
+    for (size_t e = edge_begin; e < edge_end; ++e) {
+      size_t spelling_end = graph->spelling_offsets[e + 1];
+      size_t first = num_spellings;
+      for (size_t k = spelling_begin; k < spelling_end; ++k) {
+        if (graph->spellings[k].properties.type != kInvalidSpelling)
+          graph->spellings[num_spellings++] = graph->spellings[k];
+      }
+      spelling_begin = spelling_end;
+      if (num_spellings == first)
+        continue;
+      graph->edges[num_edges++] = graph->edges[e];
+      graph->spelling_offsets[num_edges] = num_spellings;
+    }
+    edge_begin = edge_end;
+  }
+  graph->edge_offsets.back() = num_edges;
+  graph->edges.erase(graph->edges.begin() + num_edges, graph->edges.end());
+  graph->spellings.erase(graph->spellings.begin() + num_spellings,
+                         graph->spellings.end());
+  graph->spelling_offsets.resize(num_edges + 1);
+}
+
+// takes what is laid out before vertex pos from a graph pruned the same way,
+// in place of the unpruned edges, which take up no less room
+void CopyPrunedPrefix(const SyllableGraph &pruned, size_t pos,
+                      SyllableGraph *graph) {
+  size_t num_edges = pruned.edge_offsets[pos];
+  size_t num_spellings = pruned.spelling_offsets[num_edges];
+  std::copy(pruned.vertices.begin(), pruned.vertices.begin() + pos,
+            graph->vertices.begin());
+  std::copy(pruned.edge_offsets.begin(), pruned.edge_offsets.begin() + pos + 1,
+            graph->edge_offsets.begin());
+  std::copy(pruned.edges.begin(), pruned.edges.begin() + num_edges,
+            graph->edges.begin());
+  std::copy(pruned.spelling_offsets.begin(),
+            pruned.spelling_offsets.begin() + num_edges + 1,
+            graph->spelling_offsets.begin());
+  std::copy(pruned.spellings.begin(), pruned.spellings.begin() + num_spellings,
+            graph->spellings.begin());
+  graph->index_offsets.assign(pruned.index_offsets.begin(),
+                              pruned.index_offsets.begin() + pos + 1);
+  graph->index.assign(pruned.index.begin(),
+                      pruned.index.begin() + pruned.index_offsets[pos]);
+}
+
+}  // namespace
+
+int Syllabifier::BuildSyllableGraph(const std::string &full_input, Prism &prism, SyllableGraph *graph) {
+  if (full_input.empty())
     return 0;
 
+  // analyze only the beginning of an overlong input
+  bool overlong = max_input_length_ && full_input.length() > max_input_length_;
+  const std::string input(overlong ? full_input.substr(0, max_input_length_) :
+                          full_input);
+  if (overlong)
+    EZLOGGERPRINT("Warning: input is too long to analyze, %d > %d.",
+                  full_input.length(), max_input_length_);
+
+  size_t stable = DiscardStaleVertices(input, prism);
+
+  // the graph is laid out in place as vertices are visited in order
+  graph->Clear();
+  graph->input_length = full_input.length();
+  graph->vertices.resize(graph->input_length + 1, kInvalidSpelling);
+  graph->edge_offsets.resize(graph->input_length + 2, 0);
+  graph->spelling_offsets.push_back(0);
+  std::vector<SpellingType> &vertices(graph->vertices);
+  std::vector<SyllableSpelling> trimmed;
+  // no edge goes past a cut vertex; every path passes through it
+  std::vector<bool> cuts(input.length() + 1, false);
+  size_t laid_out = 0;  // edge offsets are set for vertices before it
   size_t farthest = 0;
+  size_t total_edges = 0;
+  bool exhausted = false;
   VertexQueue queue;
   queue.push(Vertex(0, kNormalSpelling));  // start
 
@@ -34,101 +182,113 @@ int Syllabifier::BuildSyllableGraph(const std::string &input, Prism &prism, Syll
     size_t current_pos = vertex.first;
 
     // record a visit to the vertex
-    VertexMap::iterator it = graph->vertices.find(current_pos);
-    if (it == graph->vertices.end())
-      graph->vertices.insert(vertex);  // preferred spelling type comes first
+    if (vertices[current_pos] == kInvalidSpelling)
+      vertices[current_pos] = vertex.second;  // preferred spelling type comes first
     else
       continue;  // discard worse spelling types
+    // vertices are visited in order, after all edges ending at them
+    if (farthest == current_pos)
+      cuts[current_pos] = true;
+
+    // out of budget, remaining vertices are only recorded
+    if (exhausted)
+      continue;
 
     // see where we can go by advancing a syllable
-    std::vector<Prism::Match> matches;
-    prism.CommonPrefixSearch(input.substr(current_pos), &matches);
-    if (!matches.empty()) {
-      EndVertexMap &end_vertices(graph->edges[current_pos]);
-      BOOST_FOREACH(const Prism::Match &m, matches) {
-        if (m.length == 0) continue;
-        size_t end_pos = current_pos + m.length;
-        // consume trailing delimiters
-        while (end_pos < input.length() &&
-               delimiters_.find(input[end_pos]) != std::string::npos)
-          ++end_pos;
-        if (end_pos > farthest)
-          farthest = end_pos;
-        SpellingMap &spellings(end_vertices[end_pos]);
-        SpellingType end_vertex_type = kInvalidSpelling;
-        // when spelling algebra is enabled, a spelling evaluates to a set of syllables;
-        // otherwise, it resembles exactly the syllable itself.
-        SpellingAccessor accessor(prism.QuerySpelling(m.value));
-        while (!accessor.exhausted()) {
-          SyllableId syllable_id(accessor.syllable_id());
-          SpellingProperties props(accessor.properties());
-          props.end_pos = end_pos;
-          // add a syllable with properties to the edge's spelling-to-syllable map
-          spellings.insert(SpellingMap::value_type(syllable_id, props));
-          if (props.type < end_vertex_type) {
-            end_vertex_type = props.type;
-          }
-          accessor.Next();
-        }
-        // update the vertex type
-        if (end_vertex_type < vertex.second) {
-          end_vertex_type = vertex.second;
-        }
-        queue.push(Vertex(end_pos, end_vertex_type));
-        EZDBGONLYLOGGERPRINT("added to syllable graph, edge: [%d, %d)", current_pos, end_pos);
+    const std::vector<SyllableSpelling> *spellings =
+        &Explore(input, prism, current_pos);
+    if (max_total_edges_ &&
+        total_edges + spellings->size() > max_total_edges_) {
+      EZLOGGERPRINT("Warning: too many edges in syllable graph, "
+                    "stopped at position %d.", current_pos);
+      trimmed = *spellings;
+      TrimSpellings(&trimmed, max_total_edges_ - total_edges);
+      spellings = &trimmed;
+      exhausted = true;
+    }
+    if (spellings->empty())
+      continue;
+    total_edges += spellings->size();
+    while (laid_out <= current_pos)
+      graph->edge_offsets[laid_out++] = graph->edges.size();
+    for (size_t k = 0; k < spellings->size(); ) {
+      size_t end_pos = (*spellings)[k].properties.end_pos;
+      if (end_pos > farthest)
+        farthest = end_pos;
+      SpellingType end_vertex_type = kInvalidSpelling;
+      for (; k < spellings->size() &&
+               (*spellings)[k].properties.end_pos == end_pos; ++k) {
+        graph->spellings.push_back((*spellings)[k]);
+        if ((*spellings)[k].properties.type < end_vertex_type)
+          end_vertex_type = (*spellings)[k].properties.type;
+      }
+      graph->edges.push_back(SyllableEdge(current_pos, end_pos));
+      graph->spelling_offsets.push_back(graph->spellings.size());
+      // update the vertex type
+      if (end_vertex_type < vertex.second) {
+        end_vertex_type = vertex.second;
       }
+      queue.push(Vertex(end_pos, end_vertex_type));
+      EZDBGONLYLOGGERPRINT("added to syllable graph, edge: [%d, %d)", current_pos, end_pos);
     }
   }
+  while (laid_out < graph->edge_offsets.size())
+    graph->edge_offsets[laid_out++] = graph->edges.size();
 
   // remove stale vertices and edges
-  std::set<int> good;
-  good.insert(farthest);
-  SpellingType last_type = graph->vertices[farthest];
-  for (int i = farthest - 1; i >= 0; --i) {
-    if (graph->vertices.find(i) == graph->vertices.end())
-      continue;
-    // remove stale edges
-    for (EndVertexMap::iterator j = graph->edges[i].begin();
-         j != graph->edges[i].end(); ) {
-      if (good.find(j->first) == good.end()) {
-        // not connected
-        graph->edges[i].erase(j++);
+  std::vector<bool> good(farthest + 1, false);
+  good[farthest] = true;
+  SpellingType last_type = vertices[farthest];
+  size_t reused = 0;
+  for (int i = farthest; i >= 0; --i) {
+    if (i < static_cast<int>(farthest)) {
+      if (vertices[i] == kInvalidSpelling)
         continue;
-      }
-      // remove disqualified syllables (eg. matching abbreviated spellings)
-      // when there is a path of more favored type (eg. normal spellings only)
-      SpellingType edge_type = kInvalidSpelling;
-      for (SpellingMap::iterator k = j->second.begin();
-           k != j->second.end(); ) {
-        if (k->second.type > last_type) {
-          j->second.erase(k++);
-        }
-        else {
-          if (k->second.type < edge_type)
-            edge_type = k->second.type;
-          ++k;
+      bool connected = false;
+      for (size_t e = graph->edges_begin(i); e < graph->edges_end(i); ++e) {
+        size_t end_pos = graph->edges[e].end;
+        SpellingType edge_type = kInvalidSpelling;
+        for (size_t k = graph->spellings_begin(e); k < graph->spellings_end(e); ++k) {
+          SpellingProperties &props(graph->spellings[k].properties);
+          // remove stale edges, and disqualified syllables (eg. matching
+          // abbreviated spellings) when there is a path of more favored type
+          // (eg. normal spellings only)
+          if (!good[end_pos] || props.type > last_type)
+            props.type = kInvalidSpelling;
+          else if (props.type < edge_type)
+            edge_type = props.type;
         }
+        if (edge_type == kInvalidSpelling)
+          continue;
+        connected = true;
+        if (edge_type == kNormalSpelling)
+          CheckOverlappedSpellings(graph, i, end_pos);
       }
-      if (j->second.empty()) {
-        graph->edges[i].erase(j++);
+      if (vertices[i] > last_type || !connected) {
+        // remove stale vertex
+        vertices[i] = kInvalidSpelling;
+        InvalidateSpellings(graph, i);
       }
       else {
-        if (edge_type == kNormalSpelling)
-          CheckOverlappedSpellings(graph, i, j->first);
-        ++j;
+        // keep the valid vetex
+        good[i] = true;
       }
     }
-    if (graph->vertices[i] > last_type || graph->edges[i].empty()) {
-      // remove stale vertex
-      graph->vertices.erase(i);
-      graph->edges.erase(i);
-      continue;
+    // before an unchanged cut vertex, the graph is pruned as it was
+    // for the last input
+    if (i > 0 && static_cast<size_t>(i) < stable && cuts[i] &&
+        last_type == last_type_ && good[i] == last_graph_.HasVertex(i)) {
+      reused = i;
+      break;
     }
-    // keep the valid vetex
-    good.insert(i);
   }
+  size_t edge_begin = graph->edge_offsets[reused];
+  size_t spelling_begin = graph->spelling_offsets[edge_begin];
+  if (reused)
+    CopyPrunedPrefix(last_graph_, reused, graph);
+  RemoveInvalidSpellings(graph, reused, edge_begin, spelling_begin);
 
-  if (enable_completion_ && farthest < input.length()) {
+  if (enable_completion_ && !overlong && farthest < input.length()) {
     const size_t kExpandSearchLimit = 512;
     std::vector<Prism::Match> keys;
     prism.ExpandSearch(input.substr(farthest), &keys, kExpandSearchLimit);
@@ -136,59 +296,152 @@ int Syllabifier::BuildSyllableGraph(const std::string &input, Prism &prism, Syll
       size_t current_pos = farthest;
       size_t end_pos = current_pos;
       size_t code_length = input.length() - farthest;
-      EndVertexMap &end_vertices(graph->edges[current_pos]);
+      size_t first_spelling = graph->spellings.size();
       BOOST_FOREACH(const Prism::Match &m, keys) {
         if (m.length < code_length) continue;
         end_pos = input.length();
-        SpellingMap &spellings(end_vertices[end_pos]);
         // when spelling algebra is enabled, a spelling evaluates to a set of syllables;
         // otherwise, it resembles exactly the syllable itself.
         SpellingAccessor accessor(prism.QuerySpelling(m.value));
         while (!accessor.exhausted()) {
           SyllableId syllable_id(accessor.syllable_id());
           SpellingProperties props(accessor.properties());
-          if (props.type > kNormalSpelling) continue;
+          if (props.type > kNormalSpelling) {
+            accessor.Next();
+            continue;
+          }
           props.type = kCompletion;
           props.credibility *= 0.5;
           props.end_pos = end_pos;
-          // add a syllable with properties to the edge's spelling-to-syllable map
-          spellings.insert(SpellingMap::value_type(syllable_id, props));
+          // add a syllable with properties to the completion edge
+          graph->spellings.push_back(SyllableSpelling(syllable_id, props));
           accessor.Next();
         }
-        queue.push(Vertex(end_pos, kCompletion));
+        vertices[end_pos] = kCompletion;
         EZDBGONLYLOGGERPRINT("added to syllable graph, compl. edge: [%d, %d)", current_pos, end_pos);
       }
+      if (graph->spellings.size() > first_spelling) {
+        UniqueSpellings(&graph->spellings, first_spelling);
+        graph->edges.push_back(SyllableEdge(current_pos, end_pos));
+        graph->spelling_offsets.push_back(graph->spellings.size());
+        // no other edges start at or after the farthest vertex
+        for (size_t i = current_pos + 1; i < graph->edge_offsets.size(); ++i)
+          graph->edge_offsets[i] = graph->edges.size();
+      }
       farthest = end_pos;
     }
   }
 
-  graph->input_length = input.length();
   graph->interpreted_length = farthest;
+  graph->Transpose(reused);
+  last_graph_ = *graph;
+  last_type_ = last_type;
   EZDBGONLYLOGGERVAR(graph->input_length);
   EZDBGONLYLOGGERVAR(graph->interpreted_length);
 
-  Transpose(graph);
-
   return farthest;
 }
 
-void Syllabifier::CheckOverlappedSpellings(SyllableGraph *graph, size_t start, size_t end) {
+void Syllabifier::Reset() {
+  explored_.clear();
+  last_input_.clear();
+  last_graph_.Clear();
+}
+
+size_t Syllabifier::DiscardStaleVertices(const std::string &input, Prism &prism) {
+  // the prism may have been loaded again in place
+  if (&prism != last_prism_ || prism.revision() != last_prism_revision_) {
+    Reset();
+    last_prism_ = &prism;
+    last_prism_revision_ = prism.revision();
+  }
+  size_t common = 0;
+  while (common < input.length() && common < last_input_.length() &&
+         input[common] == last_input_[common])
+    ++common;
+  if (common == input.length() && common == last_input_.length())
+    ++common;  // where the input ends is also unchanged
+  size_t stable = common;
+  explored_.resize(input.length() + 1);
+  for (size_t i = 0; i < explored_.size(); ++i) {
+    ExploredVertex &vertex(explored_[i]);
+    if (vertex.explored && vertex.reach > common) {
+      vertex.explored = false;
+      vertex.spellings.clear();
+      if (i < stable)
+        stable = i;
+    }
+  }
+  last_input_ = input;
+  return stable;
+}
+
+const std::vector<SyllableSpelling>& Syllabifier::Explore(
+    const std::string &input, Prism &prism, size_t pos) {
+  ExploredVertex &vertex(explored_[pos]);
+  if (vertex.explored)
+    return vertex.spellings;
+  vertex.explored = true;
+  std::vector<Prism::Match> matches;
+  std::vector<bool> fuzzy;
+  size_t examined = 0;
+  if (fuzzy_matcher_ && !fuzzy_matcher_->empty())
+    examined = fuzzy_matcher_->CommonPrefixSearch(prism, input.substr(pos),
+                                                  &matches, &fuzzy);
+  else
+    examined = prism.CommonPrefixSearch(input.substr(pos), &matches);
+  vertex.reach = pos + examined;
+  for (size_t k = 0; k < matches.size(); ++k) {
+    const Prism::Match &m(matches[k]);
+    if (m.length == 0) continue;
+    size_t end_pos = pos + m.length;
+    // consume trailing delimiters
+    while (end_pos < input.length() &&
+           delimiters_.find(input[end_pos]) != std::string::npos)
+      ++end_pos;
+    // the character at end_pos, or the end of input, has been looked at
+    if (end_pos + 1 > vertex.reach)
+      vertex.reach = end_pos + 1;
+    // when spelling algebra is enabled, a spelling evaluates to a set of syllables;
+    // otherwise, it resembles exactly the syllable itself.
+    SpellingAccessor accessor(prism.QuerySpelling(m.value));
+    while (!accessor.exhausted()) {
+      SyllableId syllable_id(accessor.syllable_id());
+      SpellingProperties props(accessor.properties());
+      props.end_pos = end_pos;
+      if (k < fuzzy.size() && fuzzy[k]) {
+        if (props.type < kFuzzySpelling)
+          props.type = kFuzzySpelling;
+        props.credibility *= 0.5;
+      }
+      vertex.spellings.push_back(SyllableSpelling(syllable_id, props));
+      accessor.Next();
+    }
+  }
+  // the syllable may be matched exactly as well as by fuzzy rules
+  UniqueSpellings(&vertex.spellings, 0);
+  if (max_edges_per_vertex_)
+    TrimSpellings(&vertex.spellings, max_edges_per_vertex_);
+  return vertex.spellings;
+}
+
+void Syllabifier::CheckOverlappedSpellings(SyllableGraph *graph,
+                                           size_t start, size_t end) {
   // TODO: more cases to handle...
-  if (!graph || graph->edges.find(start) == graph->edges.end())
+  if (!graph)
     return;
   // if "Z" = "YX", mark the vertex between Y and X an ambiguous syllable joint
-  EndVertexMap& y_end_vertices(graph->edges[start]);
   // enumerate Ys
-  BOOST_FOREACH(const EndVertexMap::value_type& y, y_end_vertices) {
-    size_t joint = y.first;
+  for (size_t y = graph->edges_begin(start); y < graph->edges_end(start); ++y) {
+    size_t joint = graph->edges[y].end;
     if (joint >= end) break;
-    // test X
-    if (graph->edges.find(joint) == graph->edges.end())
+    if (!HasValidSpellings(*graph, y))
       continue;
-    EndVertexMap& x_end_vertices(graph->edges[joint]);
-    BOOST_FOREACH(const EndVertexMap::value_type& x, x_end_vertices) {
-      if (x.first < end) continue;
-      if (x.first == end) {
+    // test X
+    for (size_t x = graph->edges_begin(joint); x < graph->edges_end(joint); ++x) {
+      if (!HasValidSpellings(*graph, x) || graph->edges[x].end < end)
+        continue;
+      if (graph->edges[x].end == end) {
         graph->vertices[joint] = kAmbiguousSpelling;
         EZDBGONLYLOGGERPRINT("ambiguous syllable joint at position %d.", joint);
       }
@@ -197,16 +450,96 @@ void Syllabifier::CheckOverlappedSpellings(SyllableGraph *graph, size_t start, s
   }
 }
 
-void Syllabifier::Transpose(SyllableGraph* graph) {
-  BOOST_FOREACH(const EdgeMap::value_type& start, graph->edges) {
-    SpellingIndex& index(graph->indices[start.first]);
-    BOOST_REVERSE_FOREACH(const EndVertexMap::value_type& end, start.second) {
-      BOOST_FOREACH(const SpellingMap::value_type& spelling, end.second) {
-        SyllableId syll_id = spelling.first;
-        index[syll_id].push_back(&spelling.second);
-      }
+// SyllableGraph members
+
+namespace {
+
+struct CompareIndexedSpellings {
+  const std::vector<SyllableSpelling> *spellings;
+  explicit CompareIndexedSpellings(const std::vector<SyllableSpelling> *s)
+      : spellings(s) {}
+  // by syllable id, then longer spellings first
+  bool operator() (size_t a, size_t b) const {
+    const SyllableSpelling &x((*spellings)[a]);
+    const SyllableSpelling &y((*spellings)[b]);
+    if (x.syllable_id != y.syllable_id)
+      return x.syllable_id < y.syllable_id;
+    return x.properties.end_pos > y.properties.end_pos;
+  }
+};
+
+}  // namespace
+
+void SyllableGraph::Transpose(size_t pos) {
+  index_offsets.resize(edge_offsets.size());
+  index.resize(pos ? index_offsets[pos] : 0);
+  if (edge_offsets.empty())
+    return;
+  for (size_t i = pos; i + 1 < edge_offsets.size(); ++i) {
+    index_offsets[i] = index.size();
+    for (size_t k = spelling_offsets[edge_offsets[i]];
+         k < spelling_offsets[edge_offsets[i + 1]]; ++k) {
+      index.push_back(k);
     }
+    std::sort(index.begin() + index_offsets[i], index.end(),
+              CompareIndexedSpellings(&spellings));
   }
+  index_offsets.back() = index.size();
+}
+
+void SyllableGraph::Clear() {
+  input_length = 0;
+  interpreted_length = 0;
+  vertices.clear();
+  edge_offsets.clear();
+  edges.clear();
+  spelling_offsets.clear();
+  spellings.clear();
+  index_offsets.clear();
+  index.clear();
+}
+
+size_t SyllableGraph::num_vertices() const {
+  return vertices.size() -
+      std::count(vertices.begin(), vertices.end(), kInvalidSpelling);
+}
+
+const SyllableEdge* SyllableGraph::FindEdge(size_t start, size_t end) const {
+  for (size_t e = edges_begin(start); e < edges_end(start); ++e) {
+    if (edges[e].end == end)
+      return &edges[e];
+  }
+  return NULL;
+}
+
+const SpellingProperties* SyllableGraph::FindSpelling(
+    size_t start, size_t end, SyllableId syllable_id) const {
+  for (size_t e = edges_begin(start); e < edges_end(start); ++e) {
+    if (edges[e].end != end)
+      continue;
+    for (size_t k = spellings_begin(e); k < spellings_end(e); ++k) {
+      if (spellings[k].syllable_id == syllable_id)
+        return &spellings[k].properties;
+    }
+  }
+  return NULL;
+}
+
+// SyllableGraphCache members
+
+shared_ptr<SyllableGraph> SyllableGraphCache::Find(const Prism *prism,
+                                                   size_t start,
+                                                   size_t end) const {
+  std::map<Key, shared_ptr<SyllableGraph> >::const_iterator it =
+      graphs_.find(std::make_pair(prism, std::make_pair(start, end)));
+  if (it == graphs_.end())
+    return shared_ptr<SyllableGraph>();
+  return it->second;
+}
+
+void SyllableGraphCache::Add(const Prism *prism, size_t start, size_t end,
+                             const shared_ptr<SyllableGraph> &graph) {
+  graphs_[std::make_pair(prism, std::make_pair(start, end))] = graph;
 }
 
 }  // namespace rime
@@ -240,6 +240,19 @@ bool Context::RefreshNonConfirmedComposition() {
   return false;
 }
 
+bool Context::RefineComposition() {
+  bool refined = false;
+  for (size_t i = 0; i < composition_->size(); ++i) {
+    Segment &seg((*composition_)[i]);
+    // what has been selected stays as it is
+    if (seg.status >= Segment::kSelected)
+      continue;
+    if (seg.menu && seg.menu->Refine())
+      refined = true;
+  }
+  return refined;
+}
+
 void Context::set_caret_pos(size_t caret_pos) {
   if (caret_pos > input_.length())
     caret_pos_ = input_.length();
@@ -0,0 +1,299 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <boost/foreach.hpp>
+#include <utf8.h>
+#include <rime/dict/bigram_model.h>
+
+namespace {
+
+const char kBigramFormat[] = "Rime::Bigram/1.0";
+
+// a factor is stored as log2(factor) in steps of 1/8, up to 2^31.875
+const double kQuantizationStep = 0.125;
+const int kMaxLevel = 255;
+const uint64_t kLevelMask = 0xff;
+
+inline uint64_t fnv1a(uint64_t h, const char *p, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<unsigned char>(p[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+inline uint64_t fingerprint(const std::string &left, const std::string &right) {
+  uint64_t h = 14695981039346656037ULL;
+  h = fnv1a(h, left.c_str(), left.length());
+  h = fnv1a(h, "\t", 1);
+  h = fnv1a(h, right.c_str(), right.length());
+  h &= ~kLevelMask;
+  return h ? h : (kLevelMask + 1);
+}
+
+inline int quantize(double factor) {
+  double level = std::floor(std::log(factor) / std::log(2.0) /
+                            kQuantizationStep + 0.5);
+  return static_cast<int>((std::min)(level, double(kMaxLevel)));
+}
+
+struct PairCount {
+  const std::string *key;
+  double count;
+  double factor;
+  bool operator< (const PairCount &other) const {
+    return count > other.count;  // by count desc
+  }
+};
+
+}  // namespace
+
+namespace rime {
+
+// BigramCollector members
+
+void BigramCollector::AddWord(const std::string &word, double weight) {
+  if (word.empty() || weight <= 0.0)
+    return;
+  vocabulary_[word] += weight;
+  total_weight_ += weight;
+}
+
+void BigramCollector::AddPhrase(const std::string &phrase, double weight) {
+  if (phrase.empty() || weight <= 0.0)
+    return;
+  phrases_.push_back(std::make_pair(phrase, weight));
+}
+
+double BigramCollector::average_weight() const {
+  return vocabulary_.empty() ? 0.0 : total_weight_ / vocabulary_.size();
+}
+
+// finds the most probable way to split the phrase into shorter words
+bool BigramCollector::Segment(const std::string &phrase,
+                              std::vector<std::string> *words) {
+  std::vector<size_t> boundaries;
+  const char *p = phrase.c_str();
+  const char *end = p + phrase.length();
+  while (p < end) {
+    boundaries.push_back(p - phrase.c_str());
+    utf8::unchecked::next(p);
+  }
+  boundaries.push_back(phrase.length());
+  size_t n = boundaries.size() - 1;
+  if (n < 2)
+    return false;
+  const double kUnreached = -1e300;
+  std::vector<double> score(n + 1, kUnreached);
+  std::vector<size_t> back(n + 1, 0);
+  score[0] = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    if (score[i] == kUnreached)
+      continue;
+    for (size_t j = i + 1; j <= n; ++j) {
+      if (i == 0 && j == n)
+        break;  // the phrase itself
+      std::string w(phrase.substr(boundaries[i], boundaries[j] - boundaries[i]));
+      WeightMap::const_iterator it = vocabulary_.find(w);
+      if (it == vocabulary_.end())
+        continue;
+      double s = score[i] + std::log(it->second / total_weight_);
+      if (s > score[j]) {
+        score[j] = s;
+        back[j] = i;
+      }
+    }
+  }
+  if (score[n] == kUnreached)
+    return false;
+  words->clear();
+  for (size_t j = n; j > 0; j = back[j]) {
+    words->push_back(phrase.substr(boundaries[back[j]],
+                                   boundaries[j] - boundaries[back[j]]));
+  }
+  std::reverse(words->begin(), words->end());
+  return true;
+}
+
+void BigramCollector::Count(const std::string &phrase, double weight) {
+  std::vector<std::string> words;
+  if (!Segment(phrase, &words))
+    return;
+  for (size_t i = 0; i < words.size(); ++i) {
+    unigram_counts_[words[i]] += weight;
+    if (i > 0)
+      bigram_counts_[words[i - 1] + '\t' + words[i]] += weight;
+  }
+}
+
+void BigramCollector::Collect(size_t max_pairs, bigram::Records *result) {
+  if (!result)
+    return;
+  result->clear();
+  unigram_counts_ = vocabulary_;
+  bigram_counts_.clear();
+  BOOST_FOREACH(const WeightMap::value_type &v, vocabulary_) {
+    Count(v.first, v.second);
+  }
+  typedef std::pair<std::string, double> Phrase;
+  BOOST_FOREACH(const Phrase &x, phrases_) {
+    Count(x.first, x.second);
+  }
+  double total_count = 0.0;
+  BOOST_FOREACH(const WeightMap::value_type &v, unigram_counts_) {
+    total_count += v.second;
+  }
+  // pointwise mutual information of adjacent words
+  std::vector<PairCount> pairs;
+  BOOST_FOREACH(const WeightMap::value_type &v, bigram_counts_) {
+    size_t sep = v.first.find('\t');
+    double left_count = unigram_counts_[v.first.substr(0, sep)];
+    double right_count = unigram_counts_[v.first.substr(sep + 1)];
+    PairCount x;
+    x.key = &v.first;
+    x.count = v.second;
+    x.factor = v.second * total_count / (left_count * right_count);
+    if (quantize(x.factor) > 0)
+      pairs.push_back(x);
+  }
+  std::sort(pairs.begin(), pairs.end());
+  if (pairs.size() > max_pairs)
+    pairs.resize(max_pairs);
+  BOOST_FOREACH(const PairCount &x, pairs) {
+    size_t sep = x.key->find('\t');
+    bigram::Record r;
+    r.left = x.key->substr(0, sep);
+    r.right = x.key->substr(sep + 1);
+    r.factor = x.factor;
+    result->push_back(r);
+  }
+  EZLOGGERPRINT("collected %d word pairs out of %d.",
+                result->size(), bigram_counts_.size());
+}
+
+// BigramModel members
+
+bool BigramModel::Load() {
+  EZLOGGERPRINT("Load file: %s", file_name().c_str());
+
+  if (IsOpen())
+    Close();
+  slots_ = NULL;
+
+  if (!OpenReadOnly()) {
+    EZLOGGERPRINT("Error opening bigram model file '%s'.", file_name().c_str());
+    return false;
+  }
+
+  metadata_ = Find<bigram::Metadata>(0);
+  if (!metadata_) {
+    EZLOGGERPRINT("Metadata not found.");
+    return false;
+  }
+  if (strncmp(metadata_->format, kBigramFormat, sizeof(kBigramFormat) - 1)) {
+    EZLOGGERPRINT("Invalid metadata.");
+    return false;
+  }
+  uint32_t num_slots = metadata_->num_slots;
+  if (!metadata_->slots || !num_slots || (num_slots & (num_slots - 1))) {
+    EZLOGGERPRINT("Hash table not found.");
+    return false;
+  }
+  slots_ = metadata_->slots.get();
+  mask_ = num_slots - 1;
+  return true;
+}
+
+bool BigramModel::Save() {
+  EZLOGGERPRINT("Save file: %s", file_name().c_str());
+  if (!slots_) {
+    EZLOGGERPRINT("Error: the bigram model has not been constructed!");
+    return false;
+  }
+  // the file is closed after being resized; to be loaded again for use
+  metadata_ = NULL;
+  slots_ = NULL;
+  return ShrinkToFit();
+}
+
+bool BigramModel::Build(const bigram::Records &records,
+                        uint32_t source_checksum) {
+  // keep the load factor under 1/2
+  size_t num_slots = 1;
+  while (num_slots < records.size() * 2)
+    num_slots <<= 1;
+  const size_t kReservedSize = 1024;
+  if (!Create(sizeof(bigram::Metadata) + num_slots * sizeof(bigram::Slot) +
+              kReservedSize)) {
+    EZLOGGERPRINT("Error creating bigram model file '%s'.",
+                  file_name().c_str());
+    return false;
+  }
+  bigram::Metadata *metadata = Allocate<bigram::Metadata>();
+  if (!metadata) {
+    EZLOGGERPRINT("Error creating metadata in file '%s'.", file_name().c_str());
+    return false;
+  }
+  std::strncpy(metadata->format, kBigramFormat,
+               bigram::Metadata::kFormatMaxLength);
+  metadata->source_checksum = source_checksum;
+  bigram::Slot *slots = Allocate<bigram::Slot>(num_slots);
+  if (!slots) {
+    EZLOGGERPRINT("Error creating hash table.");
+    return false;
+  }
+  metadata->slots = slots;
+  metadata->num_slots = num_slots;
+  uint64_t mask = num_slots - 1;
+  size_t num_pairs = 0;
+  BOOST_FOREACH(const bigram::Record &r, records) {
+    int level = quantize(r.factor);
+    if (level <= 0)
+      continue;
+    uint64_t h = fingerprint(r.left, r.right);
+    uint64_t i = (h >> 8) & mask;
+    while (slots[i] && (slots[i] & ~kLevelMask) != h)
+      i = (i + 1) & mask;
+    if (!slots[i])
+      ++num_pairs;
+    slots[i] = h | static_cast<uint64_t>(level);
+  }
+  metadata->num_pairs = num_pairs;
+  metadata_ = metadata;
+  slots_ = slots;
+  mask_ = mask;
+  return true;
+}
+
+double BigramModel::Query(const std::string &left,
+                          const std::string &right) const {
+  if (!slots_ || left.empty() || right.empty())
+    return 1.0;
+  uint64_t h = fingerprint(left, right);
+  uint64_t i = (h >> 8) & mask_;
+  for (uint64_t k = 0; k <= mask_ && slots_[i]; ++k, i = (i + 1) & mask_) {
+    if ((slots_[i] & ~kLevelMask) == h) {
+      int level = static_cast<int>(slots_[i] & kLevelMask);
+      return std::pow(2.0, level * kQuantizationStep);
+    }
+  }
+  return 1.0;
+}
+
+size_t BigramModel::num_pairs() const {
+  return metadata_ ? metadata_->num_pairs : 0;
+}
+
+uint32_t BigramModel::source_checksum() const {
+  return metadata_ ? metadata_->source_checksum : 0;
+}
+
+}  // namespace rime
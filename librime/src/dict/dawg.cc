@@ -0,0 +1,208 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <map>
+#include <queue>
+#include <string>
+#include <utility>
+#include <rime/common.h>
+#include <rime/dict/dawg.h>
+
+namespace {
+
+const uint32_t kLabelMask = 0xff;
+const uint32_t kFinalFlag = 1 << 8;
+const uint32_t kLastFlag = 1 << 9;
+const int kTargetShift = 10;
+const size_t kMaxTarget = (1 << 22) - 1;
+const uint32_t kNoChildren = 0x7fffffff;
+
+typedef std::vector<std::pair<unsigned char, size_t> > Children;
+
+struct TrieNode {
+  Children children;
+  bool final;
+  TrieNode() : final(false) {}
+};
+
+struct GraphNode {
+  Children children;
+  bool final;
+  uint32_t num_keys;
+  GraphNode() : final(false), num_keys(0) {}
+};
+
+class DawgBuilder {
+ public:
+  DawgBuilder() : trie_(1) {}
+  bool Insert(const char *key);
+  bool Build(std::vector<rime::dawg::Transition> *result);
+
+ private:
+  size_t Minimize(size_t trie_node);
+
+  std::vector<TrieNode> trie_;
+  std::vector<GraphNode> graph_;
+  std::map<std::string, size_t> registry_;
+};
+
+bool DawgBuilder::Insert(const char *key) {
+  size_t node = 0;
+  for (const char *p = key; *p; ++p) {
+    unsigned char label = static_cast<unsigned char>(*p);
+    Children &children(trie_[node].children);
+    if (!children.empty() && children.back().first == label) {
+      node = children.back().second;
+      continue;
+    }
+    if (!children.empty() && children.back().first > label)
+      return false;  // keys are not sorted
+    size_t child = trie_.size();
+    children.push_back(std::make_pair(label, child));
+    trie_.push_back(TrieNode());
+    node = child;
+  }
+  if (node == 0 || trie_[node].final || !trie_[node].children.empty())
+    return false;  // empty, duplicate or unsorted key
+  trie_[node].final = true;
+  return true;
+}
+
+// merges equivalent sub-graphs bottom-up
+size_t DawgBuilder::Minimize(size_t trie_node) {
+  GraphNode g;
+  g.final = trie_[trie_node].final;
+  g.num_keys = g.final ? 1 : 0;
+  std::string signature(1, g.final ? '$' : '.');
+  for (size_t i = 0; i < trie_[trie_node].children.size(); ++i) {
+    std::pair<unsigned char, size_t> c(trie_[trie_node].children[i]);
+    size_t child = Minimize(c.second);
+    g.children.push_back(std::make_pair(c.first, child));
+    g.num_keys += graph_[child].num_keys;
+    signature += static_cast<char>(c.first);
+    signature.append(reinterpret_cast<const char*>(&child), sizeof(child));
+  }
+  std::map<std::string, size_t>::const_iterator it = registry_.find(signature);
+  if (it != registry_.end())
+    return it->second;
+  size_t id = graph_.size();
+  graph_.push_back(g);
+  registry_[signature] = id;
+  return id;
+}
+
+bool DawgBuilder::Build(std::vector<rime::dawg::Transition> *result) {
+  size_t root = Minimize(0);
+  trie_.clear();
+  // place transitions of each node in a contiguous block, root first
+  std::vector<size_t> start(graph_.size(), 0);
+  std::vector<size_t> placed;
+  size_t next = graph_[root].children.size();
+  std::queue<size_t> q;
+  q.push(root);
+  while (!q.empty()) {
+    size_t g = q.front();
+    q.pop();
+    placed.push_back(g);
+    for (size_t i = 0; i < graph_[g].children.size(); ++i) {
+      size_t child = graph_[g].children[i].second;
+      if (start[child] || graph_[child].children.empty())
+        continue;
+      start[child] = next;
+      next += graph_[child].children.size();
+      q.push(child);
+    }
+  }
+  if (next > kMaxTarget) {
+    EZLOGGERPRINT("Error: too many transitions in dawg: %d.", next);
+    return false;
+  }
+  result->resize(next);
+  for (size_t k = 0; k < placed.size(); ++k) {
+    const GraphNode &node(graph_[placed[k]]);
+    uint32_t rank = 0;
+    for (size_t i = 0; i < node.children.size(); ++i) {
+      const GraphNode &child(graph_[node.children[i].second]);
+      rime::dawg::Transition &t((*result)[start[placed[k]] + i]);
+      t.base = node.children[i].first |
+          (child.final ? kFinalFlag : 0) |
+          (i + 1 == node.children.size() ? kLastFlag : 0) |
+          (start[node.children[i].second] << kTargetShift);
+      t.rank = rank;
+      rank += child.num_keys;
+    }
+  }
+  return true;
+}
+
+inline rime::Dawg::State MakeState(uint32_t node, bool final, uint32_t rank) {
+  return (static_cast<rime::Dawg::State>(node) << 33) |
+      (static_cast<rime::Dawg::State>(final ? 1 : 0) << 32) | rank;
+}
+
+}  // namespace
+
+namespace rime {
+
+bool Dawg::Build(size_t num_keys, const char * const *keys) {
+  clear();
+  DawgBuilder builder;
+  for (size_t i = 0; i < num_keys; ++i) {
+    if (!builder.Insert(keys[i])) {
+      EZLOGGERPRINT("Error inserting key #%d into dawg.", i);
+      return false;
+    }
+  }
+  if (!builder.Build(&buffer_))
+    return false;
+  set_array(buffer_.empty() ? NULL : &buffer_[0], buffer_.size());
+  return true;
+}
+
+void Dawg::set_array(const dawg::Transition *array, size_t size) {
+  array_ = array;
+  size_ = size;
+}
+
+void Dawg::clear() {
+  buffer_.clear();
+  array_ = NULL;
+  size_ = 0;
+}
+
+int Dawg::Traverse(const char *key, size_t length, State *state) const {
+  uint32_t node = static_cast<uint32_t>(*state >> 33);
+  bool final = ((*state >> 32) & 1) != 0;
+  uint32_t rank = static_cast<uint32_t>(*state);
+  for (size_t i = 0; i < length; ++i) {
+    if (node >= size_)
+      return -2;
+    uint32_t label = static_cast<unsigned char>(key[i]);
+    const dawg::Transition *t = array_ + node;
+    // transitions are ordered by label
+    while ((t->base & kLabelMask) != label) {
+      if ((t->base & kLabelMask) > label || (t->base & kLastFlag))
+        return -2;
+      ++t;
+    }
+    rank += (final ? 1 : 0) + t->rank;
+    final = (t->base & kFinalFlag) != 0;
+    uint32_t target = t->base >> kTargetShift;
+    node = target ? target : kNoChildren;
+    *state = MakeState(node, final, rank);
+  }
+  return final ? static_cast<int>(rank) : -1;
+}
+
+int Dawg::ExactMatchSearch(const char *key, size_t length) const {
+  State state = 0;
+  int value = Traverse(key, length, &state);
+  return value >= 0 ? value : -1;
+}
+
+}  // namespace rime
@@ -6,6 +6,7 @@
 //
 // 2011-07-05 GONG Chen <chen.sst@gmail.com>
 //
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
@@ -39,58 +40,159 @@ bool compare_chunk_by_head_element(const Chunk &a, const Chunk &b) {
          b.credibility * b.entries[b.cursor].weight;  // by weight desc
 }
 
+// among chunks of equal head elements, the chunk advanced most recently
+// goes first, then the others in the order they were added
+bool chunk_precedes(const Chunk &a, const Chunk &b) {
+  if (compare_chunk_by_head_element(a, b)) return true;
+  if (compare_chunk_by_head_element(b, a)) return false;
+  return a.rank < b.rank;
+}
+
+void Chunk::swap(Chunk &other) {
+  code.swap(other.code);
+  std::swap(entries, other.entries);
+  std::swap(size, other.size);
+  std::swap(cursor, other.cursor);
+  remaining_code.swap(other.remaining_code);
+  std::swap(credibility, other.credibility);
+  std::swap(rank, other.rank);
+}
+
 size_t match_extra_code(const table::Code *extra_code, size_t depth,
                         const SyllableGraph &syll_graph, size_t current_pos) {
   if (!extra_code || depth >= extra_code->size)
     return current_pos;  // success
   if (current_pos >= syll_graph.interpreted_length)
     return 0;  // failure (possibly success for completion in the future)
-  SpellingIndices::const_iterator index = syll_graph.indices.find(current_pos);
-  if (index == syll_graph.indices.end())
-    return 0;
   table::SyllableId current_syll_id = extra_code->at[depth];
-  SpellingIndex::const_iterator spellings = index->second.find(current_syll_id);
-  if (spellings == index->second.end())
-    return 0;
+  size_t k = syll_graph.index_begin(current_pos);
+  size_t index_end = syll_graph.index_end(current_pos);
+  while (k < index_end &&
+         syll_graph.indexed_spelling(k).syllable_id < current_syll_id)
+    ++k;
   size_t best_match = 0;
-  BOOST_FOREACH(const SpellingProperties* props, spellings->second) {
+  for (; k < index_end &&
+           syll_graph.indexed_spelling(k).syllable_id == current_syll_id; ++k) {
+    const SpellingProperties &props(syll_graph.indexed_spelling(k).properties);
     size_t match_end_pos = match_extra_code(extra_code, depth + 1,
-                                            syll_graph, props->end_pos);
+                                            syll_graph, props.end_pos);
     if (!match_end_pos) continue;
     if (match_end_pos > best_match) best_match = match_end_pos;
   }
   return best_match;
 }
 
+void collect_entries(TableQueryResult *result,
+                     const SyllableGraph &syllable_graph,
+                     double initial_credibility,
+                     DictEntryCollector *collector) {
+  collector->reserve(syllable_graph.input_length + 1);
+  BOOST_FOREACH(TableQueryResult::value_type &v, *result) {
+    size_t end_pos = v.first;
+    BOOST_FOREACH(TableAccessor &a, v.second) {
+      double cr = initial_credibility * a.credibility();
+      if (a.extra_code()) {
+        do {
+          size_t actual_end_pos = match_extra_code(
+              a.extra_code(), 0, syllable_graph, end_pos);
+          if (actual_end_pos == 0) continue;
+          (*collector)[actual_end_pos].AddChunk(
+              Chunk(a.code(), a.entry(), cr));
+        }
+        while (a.Next());
+      }
+      else {
+        (*collector)[end_pos].AddChunk(Chunk(a, cr));
+      }
+    }
+  }
+  // sort each group of equal code length
+  BOOST_FOREACH(DictEntryCollector::value_type &v, *collector) {
+    v.second.Sort();
+  }
+}
+
 }  // namespace dictionary
 
+// DictEntryView members
+
+const std::string DictEntryView::comment() const {
+  if (!remaining_code || remaining_code->empty())
+    return std::string();
+  return "~" + *remaining_code;
+}
+
+void DictEntryView::CopyTo(DictEntry *entry) const {
+  entry->code.assign(code, code + code_length);
+  entry->text.assign(text, text_length);
+  if (remaining_code && !remaining_code->empty())
+    entry->comment = comment();
+  else
+    entry->comment.clear();
+  entry->preedit.clear();
+  entry->weight = weight;
+  entry->commit_count = 0;
+  entry->remaining_code_length =
+      remaining_code ? static_cast<int>(remaining_code->length()) : 0;
+}
+
+// DictEntryIterator members
+
 DictEntryIterator::DictEntryIterator()
-    : Base(), entry_(), entry_count_(0) {
+    : Base(), entry_(), entry_count_(0),
+      sorted_(false), heap_size_(0), head_rank_(0), tail_rank_(0) {
 }
 
 DictEntryIterator::DictEntryIterator(const DictEntryIterator &other)
-    : Base(other), entry_(other.entry_), entry_count_(other.entry_count_) {
+    : Base(other), entry_(other.entry_), entry_count_(other.entry_count_),
+      sorted_(other.sorted_), heap_size_(other.heap_size_),
+      head_rank_(other.head_rank_), tail_rank_(other.tail_rank_) {
 }
 
-DictEntryIterator& DictEntryIterator::operator= (DictEntryIterator &other) {
-  EZDBGONLYLOGGERPRINT("swapping iterator contents.");
-  swap(other);
+DictEntryIterator& DictEntryIterator::operator= (
+    const DictEntryIterator &other) {
+  Base::operator= (other);
   entry_ = other.entry_;
   entry_count_ = other.entry_count_;
+  sorted_ = other.sorted_;
+  heap_size_ = other.heap_size_;
+  head_rank_ = other.head_rank_;
+  tail_rank_ = other.tail_rank_;
   return *this;
 }
 
+void DictEntryIterator::clear() {
+  Base::clear();
+  entry_.reset();
+  entry_count_ = 0;
+  sorted_ = false;
+  heap_size_ = 0;
+  head_rank_ = 0;
+  tail_rank_ = 0;
+}
+
 bool DictEntryIterator::exhausted() const {
   return empty();
 }
 
 void DictEntryIterator::AddChunk(const dictionary::Chunk &chunk) {
+  if (!chunk.entries || chunk.cursor >= chunk.size)
+    return;
   push_back(chunk);
+  back().rank = tail_rank_++;
   entry_count_ += chunk.size;
 }
 
 void DictEntryIterator::Sort() {
-  sort(dictionary::compare_chunk_by_head_element);
+  if (!sorted_) {
+    sorted_ = true;
+    heap_size_ = 0;
+  }
+  else if (heap_size_ > 0) {
+    // front() might have been skipped to a new head element
+    SiftDown(0);
+  }
+  MergePending();
 }
 
 shared_ptr<DictEntry> DictEntryIterator::Peek() {
@@ -99,31 +201,40 @@ shared_ptr<DictEntry> DictEntryIterator::Peek() {
     return shared_ptr<DictEntry>();
   }
   if (!entry_) {
-    const dictionary::Chunk &chunk(front());
+    DictEntryView view;
+    Peek(&view);
+    EZDBGONLYLOGGERPRINT("Creating temporary dict entry '%s'.", view.text);
     entry_ = make_shared<DictEntry>();
-    const table::Entry &e(chunk.entries[chunk.cursor]);
-    EZDBGONLYLOGGERPRINT("Creating temporary dict entry '%s'.", e.text.c_str());
-    entry_->code = chunk.code;
-    entry_->text = e.text.c_str();
-    const double kS = 100000.0;
-    entry_->weight = (e.weight + 1) / kS * chunk.credibility;
-    if (!chunk.remaining_code.empty()) {
-      entry_->comment = "~" + chunk.remaining_code;
-      entry_->remaining_code_length = chunk.remaining_code.length();
-    }
+    view.CopyTo(entry_.get());
   }
   return entry_;
 }
 
+bool DictEntryIterator::Peek(DictEntryView *view) const {
+  if (empty() || !view)
+    return false;
+  const dictionary::Chunk &chunk(front());
+  const table::Entry &e(chunk.entries[chunk.cursor]);
+  view->text = e.text.c_str();
+  view->text_length = e.text.length();
+  const double kS = 100000.0;
+  view->weight = (e.weight + 1) / kS * chunk.credibility;
+  view->code = chunk.code.empty() ? NULL : &chunk.code[0];
+  view->code_length = chunk.code.size();
+  view->remaining_code = &chunk.remaining_code;
+  return true;
+}
+
 bool DictEntryIterator::Next() {
   if (empty()) {
     return false;
   }
   dictionary::Chunk &chunk(front());
   if (++chunk.cursor >= chunk.size) {
-    pop_front();
+    PopFront();
   }
   else {
+    chunk.rank = --head_rank_;
     // reorder chunks since front() has got a new head element
     Sort();
   }
@@ -133,25 +244,78 @@ bool DictEntryIterator::Next() {
 }
 
 bool DictEntryIterator::Skip(size_t num_entries) {
+  entry_.reset();
   while (num_entries > 0) {
     if (empty()) return false;
     dictionary::Chunk &chunk(front());
     if (chunk.cursor + num_entries < chunk.size) {
       chunk.cursor += num_entries;
+      chunk.rank = --head_rank_;
       return true;
     }
     num_entries -= (chunk.size - chunk.cursor);
-    pop_front();
+    PopFront();
   }
   return true;
 }
 
+void DictEntryIterator::PopFront() {
+  if (!sorted_) {
+    erase(begin());
+    return;
+  }
+  front().swap((*this)[--heap_size_]);
+  erase(begin() + heap_size_);
+  if (heap_size_ > 0) {
+    SiftDown(0);
+  }
+  else {
+    // left with chunks added since sorted
+    sorted_ = false;
+  }
+}
+
+void DictEntryIterator::MergePending() {
+  while (heap_size_ < size()) {
+    SiftUp(heap_size_++);
+  }
+}
+
+void DictEntryIterator::SiftUp(size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!dictionary::chunk_precedes((*this)[i], (*this)[parent]))
+      break;
+    (*this)[i].swap((*this)[parent]);
+    i = parent;
+  }
+}
+
+void DictEntryIterator::SiftDown(size_t i) {
+  while (true) {
+    size_t first = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < heap_size_ &&
+        dictionary::chunk_precedes((*this)[left], (*this)[first]))
+      first = left;
+    if (right < heap_size_ &&
+        dictionary::chunk_precedes((*this)[right], (*this)[first]))
+      first = right;
+    if (first == i)
+      break;
+    (*this)[i].swap((*this)[first]);
+    i = first;
+  }
+}
+
 // Dictionary members
 
 Dictionary::Dictionary(const std::string &name,
                        const shared_ptr<Table> &table,
-                       const shared_ptr<Prism> &prism)
-    : name_(name), table_(table), prism_(prism) {
+                       const shared_ptr<Prism> &prism,
+                       const shared_ptr<BigramModel> &bigram_model)
+    : name_(name), table_(table), prism_(prism), bigram_model_(bigram_model) {
 }
 
 Dictionary::~Dictionary() {
@@ -161,38 +325,46 @@ Dictionary::~Dictionary() {
 shared_ptr<DictEntryCollector> Dictionary::Lookup(const SyllableGraph &syllable_graph,
                                                   size_t start_pos,
                                                   double initial_credibility) {
-  if (!loaded())
-    return shared_ptr<DictEntryCollector>();
-  TableQueryResult result;
-  if (!table_->Query(syllable_graph, start_pos, &result)) {
-    return shared_ptr<DictEntryCollector>();
-  }
   shared_ptr<DictEntryCollector> collector = make_shared<DictEntryCollector>();
-  // copy result
-  BOOST_FOREACH(TableQueryResult::value_type &v, result) {
-    size_t end_pos = v.first;
-    BOOST_FOREACH(TableAccessor &a, v.second) {
-      double cr = initial_credibility * a.credibility();
-      if (a.extra_code()) {
-        do {
-          size_t actual_end_pos = dictionary::match_extra_code(
-              a.extra_code(), 0, syllable_graph, end_pos);
-          if (actual_end_pos == 0) continue;
-          (*collector)[actual_end_pos].AddChunk(
-              dictionary::Chunk(a.code(), a.entry(), cr));
-        }
-        while (a.Next());
-      }
-      else {
-        (*collector)[end_pos].AddChunk(dictionary::Chunk(a, cr));
-      }
-    }
+  if (!Lookup(syllable_graph, start_pos, initial_credibility, collector.get()))
+    return shared_ptr<DictEntryCollector>();
+  return collector;
+}
+
+bool Dictionary::Lookup(const SyllableGraph &syllable_graph,
+                        size_t start_pos,
+                        double initial_credibility,
+                        DictEntryCollector *result) {
+  if (!result || !loaded())
+    return false;
+  result->clear();
+  TableQueryResult query_result;
+  if (!table_->Query(syllable_graph, start_pos, &query_result)) {
+    return false;
   }
-  // sort each group of equal code length
-  BOOST_FOREACH(DictEntryCollector::value_type &v, *collector) {
-    v.second.Sort();
+  dictionary::collect_entries(&query_result, syllable_graph,
+                              initial_credibility, result);
+  return true;
+}
+
+bool Dictionary::Lookup(const SyllableGraph &syllable_graph,
+                        const std::vector<double> &initial_credibility,
+                        DictEntryLattice *result) {
+  if (!result || !loaded())
+    return false;
+  result->clear();
+  result->reserve(syllable_graph.input_length + 1);
+  TableQueryLattice lattice;
+  if (!table_->Query(syllable_graph, &lattice))
+    return false;
+  BOOST_FOREACH(TableQueryLattice::value_type &v, lattice) {
+    size_t start_pos = v.first;
+    double credibility = start_pos < initial_credibility.size() ?
+        initial_credibility[start_pos] : 1.0;
+    dictionary::collect_entries(&v.second, syllable_graph, credibility,
+                                &(*result)[start_pos]);
   }
-  return collector;
+  return !result->empty();
 }
 
 size_t Dictionary::LookupWords(DictEntryIterator *result,
@@ -273,6 +445,12 @@ bool Dictionary::Load() {
     EZLOGGERPRINT("Error loading prism for dictionary '%s'.", name_.c_str());
     return false;
   }
+  if (bigram_model_ && !bigram_model_->IsOpen() &&
+      boost::filesystem::exists(bigram_model_->file_name()) &&
+      !bigram_model_->Load()) {
+    EZLOGGERPRINT("Warning: error loading bigram model; not in use.");
+    bigram_model_->Close();
+  }
   return true;
 }
 
@@ -319,7 +497,14 @@ Dictionary* DictionaryComponent::CreateDictionaryWithName(
     prism = boost::make_shared<Prism>((path / prism_name).string() + ".prism.bin");
     prism_map_[prism_name] = prism;
   }
-  return new Dictionary(dict_name, table, prism);
+  // the bigram model is built from the essay, shared by all dictionaries
+  shared_ptr<BigramModel> bigram_model(bigram_model_.lock());
+  if (!bigram_model) {
+    bigram_model = boost::make_shared<BigramModel>(
+        (path / "essay.bigram.bin").string());
+    bigram_model_ = bigram_model;
+  }
+  return new Dictionary(dict_name, table, prism, bigram_model);
 }
 
 }  // namespace rime
@@ -0,0 +1,96 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <algorithm>
+#include <rime/dict/prefix_filter.h>
+
+namespace {
+
+// 10 bits per prefix with 4 probes make for a false positive rate of 1.2%
+const size_t kBitsPerPrefix = 10;
+const int kNumProbes = 4;
+const size_t kMinCapacity = 1024;
+
+inline uint64_t fnv1a(const char *p, size_t n) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<unsigned char>(p[i]);
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+}  // namespace
+
+namespace rime {
+
+PrefixFilter::PrefixFilter(size_t unit_width, size_t max_depth)
+    : unit_width_(unit_width), max_depth_(max_depth),
+      capacity_(0), num_prefixes_(0), mask_(0) {
+}
+
+void PrefixFilter::Reset(size_t num_codes) {
+  // leave room for twice as many prefixes as there are now
+  capacity_ = (std::max)(num_codes * max_depth_ * 2, kMinCapacity);
+  size_t num_bits = 64;
+  while (num_bits < capacity_ * kBitsPerPrefix)
+    num_bits <<= 1;
+  bits_.assign(num_bits / 64, 0);
+  mask_ = num_bits - 1;
+  num_prefixes_ = 0;
+}
+
+void PrefixFilter::Clear() {
+  bits_.clear();
+  capacity_ = 0;
+  num_prefixes_ = 0;
+}
+
+void PrefixFilter::Add(const std::string &code) {
+  if (!ready())
+    return;
+  size_t depth = (std::min)(code.length() / unit_width_, max_depth_);
+  for (size_t d = 1; d <= depth; ++d) {
+    size_t n = d * unit_width_;
+    if (!Test(code.data(), n)) {
+      Set(code.data(), n);
+      ++num_prefixes_;
+    }
+  }
+}
+
+bool PrefixFilter::MayContain(const std::string &prefix) const {
+  if (!ready() || prefix.length() > max_depth_ * unit_width_)
+    return true;
+  return Test(prefix.data(), prefix.length());
+}
+
+// probes at h1 + i * h2, from two halves of the hash value
+bool PrefixFilter::Test(const char *p, size_t n) const {
+  uint64_t h = fnv1a(p, n);
+  uint64_t h1 = h & 0xffffffff;
+  uint64_t h2 = (h >> 32) | 1;
+  for (int i = 0; i < kNumProbes; ++i) {
+    uint64_t k = (h1 + i * h2) & mask_;
+    if (!(bits_[k >> 6] & (1ULL << (k & 63))))
+      return false;
+  }
+  return true;
+}
+
+void PrefixFilter::Set(const char *p, size_t n) {
+  uint64_t h = fnv1a(p, n);
+  uint64_t h1 = h & 0xffffffff;
+  uint64_t h2 = (h >> 32) | 1;
+  for (int i = 0; i < kNumProbes; ++i) {
+    uint64_t k = (h1 + i * h2) & mask_;
+    bits_[k >> 6] |= (1ULL << (k & 63));
+  }
+}
+
+}  // namespace rime
@@ -17,22 +17,35 @@ namespace {
 
 struct node_t {
   std::string key;
-  size_t node_pos;
-  node_t(const std::string& k, size_t pos) : key(k), node_pos(pos) {
+  rime::Prism::NodePos node_pos;
+  node_t(const std::string& k, rime::Prism::NodePos pos)
+      : key(k), node_pos(pos) {
   }
 };
 
 const char kPrismFormatPrefix[] = "Rime::Prism/";
 const size_t kPrismFormatPrefixLen = sizeof(kPrismFormatPrefix) - 1;
 
-const char kPrismFormat[] = "Rime::Prism/1.0";
+const char kPrismFormat[] = "Rime::Prism/1.1";
+const char kPrismFormatDawg[] = "Rime::Prism/1.1-dawg";
+const char kDawgSuffix[] = "-dawg";
 
 const char kDefaultAlphabet[] = "abcdefghijklmnopqrstuvwxyz";
 
+uint32_t last_revision = 0;
+
 }  // namespace
 
 namespace rime {
 
+#ifdef RIME_DAWG_PRISM
+const Prism::Backend Prism::kDefaultBackend = Prism::kDawg;
+#else
+const Prism::Backend Prism::kDefaultBackend = Prism::kDoubleArray;
+#endif
+
+const double Prism::kFormat = 1.1;
+
 SpellingAccessor::SpellingAccessor(prism::SpellingMap* spelling_map, int spelling_id)
     : spelling_id_(spelling_id), iter_(NULL), end_(NULL) {
   if (spelling_map && spelling_id < static_cast<int>(spelling_map->size)) {
@@ -76,6 +89,7 @@ bool Prism::Load() {
 
   if (IsOpen())
     Close();
+  revision_ = ++last_revision;
 
   if (!OpenReadOnly()) {
     EZLOGGERPRINT("Error opening prism file '%s'.", file_name().c_str());
@@ -93,14 +107,28 @@ bool Prism::Load() {
   }
   format_ = atof(&metadata_->format[kPrismFormatPrefixLen]);
   
-  char *array = metadata_->double_array.get();
-  if (!array) {
-    EZLOGGERPRINT("Double array image not found.");
-    return false;
+  if (strstr(metadata_->format, kDawgSuffix)) {
+    backend_ = kDawg;
+    dawg::Transition *array = metadata_->dawg.get();
+    if (!array) {
+      EZLOGGERPRINT("Dawg image not found.");
+      return false;
+    }
+    size_t array_size = metadata_->dawg_size;
+    EZLOGGERPRINT("Found dawg image of size %u.", array_size);
+    dawg_->set_array(array, array_size);
+  }
+  else {
+    backend_ = kDoubleArray;
+    char *array = metadata_->double_array.get();
+    if (!array) {
+      EZLOGGERPRINT("Double array image not found.");
+      return false;
+    }
+    size_t array_size = metadata_->double_array_size;
+    EZLOGGERPRINT("Found double array image of size %u.", array_size);
+    trie_->set_array(array, array_size);
   }
-  size_t array_size = metadata_->double_array_size;
-  EZLOGGERPRINT("Found double array image of size %u.", array_size);
-  trie_->set_array(array, array_size);
 
   spelling_map_ = NULL;
   if (format_ >= 0.99) {
@@ -111,7 +139,7 @@ bool Prism::Load() {
 
 bool Prism::Save() {
   EZLOGGERPRINT("Save file: %s", file_name().c_str());
-  if (!trie_->total_size()) {
+  if (!image_size()) {
     EZLOGGERPRINT("Error: the trie has not been constructed!");
     return false;
   }
@@ -122,6 +150,7 @@ bool Prism::Build(const Syllabary &syllabary,
                   const Script *script,
                   uint32_t dict_file_checksum,
                   uint32_t schema_file_checksum) {
+  revision_ = ++last_revision;
   // building double-array trie
   size_t num_syllables = syllabary.size();
   size_t num_spellings = script ? script->size() : syllabary.size();
@@ -141,13 +170,19 @@ bool Prism::Build(const Syllabary &syllabary,
       keys[key_id] = it->c_str();
     }
   }
-  if (0 != trie_->build(num_spellings, &keys[0])) {
+  if (backend_ == kDawg) {
+    if (!dawg_->Build(num_spellings, &keys[0])) {
+      EZLOGGERPRINT("Error building dawg.");
+      return false;
+    }
+  }
+  else if (0 != trie_->build(num_spellings, &keys[0])) {
     EZLOGGERPRINT("Error building double-array trie.");
     return false;
   }
   // creating prism file
-  size_t array_size = trie_->size();
-  size_t image_size = trie_->total_size();
+  size_t array_size = this->array_size();
+  size_t image_size = this->image_size();
   const size_t kDescriptorExtraSize = 12;
   size_t estimated_map_size = num_spellings * 12 +
       map_size * (4 + sizeof(prism::SpellingDescriptor) + kDescriptorExtraSize);
@@ -162,7 +197,9 @@ bool Prism::Build(const Syllabary &syllabary,
     EZLOGGERPRINT("Error creating metadata in file '%s'.", file_name().c_str());
     return false;
   }
-  std::strncpy(metadata->format, kPrismFormat, prism::Metadata::kFormatMaxLength);
+  std::strncpy(metadata->format,
+               backend_ == kDawg ? kPrismFormatDawg : kPrismFormat,
+               prism::Metadata::kFormatMaxLength);
   metadata->dict_file_checksum = dict_file_checksum;
   metadata->schema_file_checksum = schema_file_checksum;
   metadata->num_syllables = num_syllables;
@@ -180,15 +217,28 @@ bool Prism::Build(const Syllabary &syllabary,
       *p = *c;
     *p = '\0';
   }
-  // saving double-array image
-  char *array = Allocate<char>(image_size);
-  if (!array) {
-    EZLOGGERPRINT("Error creating double-array image.");
-    return false;
+  if (backend_ == kDawg) {
+    // saving dawg image
+    dawg::Transition *array = Allocate<dawg::Transition>(array_size);
+    if (!array) {
+      EZLOGGERPRINT("Error creating dawg image.");
+      return false;
+    }
+    std::memcpy(array, dawg_->array(), image_size);
+    metadata->dawg = array;
+    metadata->dawg_size = array_size;
+  }
+  else {
+    // saving double-array image
+    char *array = Allocate<char>(image_size);
+    if (!array) {
+      EZLOGGERPRINT("Error creating double-array image.");
+      return false;
+    }
+    std::memcpy(array, trie_->array(), image_size);
+    metadata->double_array = array;
+    metadata->double_array_size = array_size;
   }
-  std::memcpy(array, trie_->array(), image_size);
-  metadata->double_array = array;
-  metadata->double_array_size = array_size;
   // building spelling map
   if (script) {
     std::map<std::string, prism::SyllableId> syllable_to_id;
@@ -234,13 +284,19 @@ bool Prism::Build(const Syllabary &syllabary,
 
 bool Prism::HasKey(const std::string &key) {
   Darts::DoubleArray::value_type value;
-  trie_->exactMatchSearch(key.c_str(), value);
+  if (backend_ == kDawg)
+    value = dawg_->ExactMatchSearch(key.c_str(), key.length());
+  else
+    trie_->exactMatchSearch(key.c_str(), value);
   return value != -1;
 }
 
 bool Prism::GetValue(const std::string &key, int *value) {
   Darts::DoubleArray::result_pair_type result;
-  trie_->exactMatchSearch(key.c_str(), result);
+  if (backend_ == kDawg)
+    result.value = dawg_->ExactMatchSearch(key.c_str(), key.length());
+  else
+    trie_->exactMatchSearch(key.c_str(), result);
 
   if (result.value == -1)
     return false;
@@ -250,13 +306,40 @@ bool Prism::GetValue(const std::string &key, int *value) {
 }
 
 // Given a key, search all the keys in the tree which share a common prefix with that key.
-void Prism::CommonPrefixSearch(const std::string &key, std::vector<Match> *result) {
-  if (!result || key.empty())
-    return;
+// Returns the number of leading characters of the key which have been examined,
+// or key.length() + 1 if the result also depends on where the key ends.
+size_t Prism::CommonPrefixSearch(const std::string &key, std::vector<Match> *result) {
+  if (!result)
+    return 0;
   size_t len = key.length();
+  if (key.empty()) {
+    result->clear();
+    return len + 1;
+  }
+  if (backend_ == kDawg) {
+    result->clear();
+    Dawg::State state = 0;
+    for (size_t i = 0; i < len; ++i) {
+      int value = dawg_->Traverse(&key[i], 1, &state);
+      if (value == -2)
+        return i + 1;
+      if (value >= 0) {
+        Match match;
+        match.value = value;
+        match.length = i + 1;
+        result->push_back(match);
+      }
+    }
+    return len + 1;
+  }
   result->resize(len);
   size_t num_results = trie_->commonPrefixSearch(key.c_str(), &result->front(), len, len);
   result->resize(num_results);
+  size_t node_pos = 0;
+  size_t key_pos = 0;
+  if (trie_->traverse(key.c_str(), node_pos, key_pos, len) == -2)
+    return key_pos + 1;
+  return len + 1;
 }
 
 void Prism::ExpandSearch(const std::string &key, std::vector<Match> *result, size_t limit) {
@@ -264,9 +347,8 @@ void Prism::ExpandSearch(const std::string &key, std::vector<Match> *result, siz
     return;
   result->clear();
   size_t count = 0;
-  size_t node_pos = 0;
-  size_t key_pos = 0;
-  int ret = trie_->traverse(key.c_str(), node_pos, key_pos);
+  NodePos node_pos = 0;
+  int ret = Traverse(key, &node_pos);
   //key is not a valid path
   if (ret == -2)
     return;
@@ -274,7 +356,7 @@ void Prism::ExpandSearch(const std::string &key, std::vector<Match> *result, siz
     {
       Match match;
       match.value = ret;
-      match.length = key_pos;
+      match.length = key.length();
       result->push_back(match);
     }
     if (limit && ++count >= limit)
@@ -288,9 +370,8 @@ void Prism::ExpandSearch(const std::string &key, std::vector<Match> *result, siz
     const char *c = (format_ > 0.99) ? metadata_->alphabet : kDefaultAlphabet;
     for (; *c; ++c) {
       std::string k = node.key + *c;
-      size_t k_pos = node.key.length();
-      size_t n_pos = node.node_pos;
-      ret = trie_->traverse(k.c_str(), n_pos, k_pos);
+      NodePos n_pos = node.node_pos;
+      ret = Traverse(std::string(1, *c), &n_pos);
       if (ret <= -2) {
         //ignore
       }
@@ -302,7 +383,7 @@ void Prism::ExpandSearch(const std::string &key, std::vector<Match> *result, siz
         {
           Match match;
           match.value = ret;
-          match.length = k_pos;
+          match.length = k.length();
           result->push_back(match);
         }
         if (limit && ++count >= limit)
@@ -312,12 +393,28 @@ void Prism::ExpandSearch(const std::string &key, std::vector<Match> *result, siz
   }
 }
 
+int Prism::Traverse(const std::string &key, NodePos *node_pos) {
+  if (!node_pos)
+    return -2;
+  if (backend_ == kDawg)
+    return dawg_->Traverse(key.c_str(), key.length(), node_pos);
+  size_t n_pos = static_cast<size_t>(*node_pos);
+  size_t key_pos = 0;
+  int ret = trie_->traverse(key.c_str(), n_pos, key_pos, key.length());
+  *node_pos = n_pos;
+  return ret;
+}
+
 const SpellingAccessor Prism::QuerySpelling(int spelling_id) {
   return SpellingAccessor(spelling_map_, spelling_id);
 }
 
 size_t Prism::array_size() const {
-  return trie_->size();
+  return backend_ == kDawg ? dawg_->size() : trie_->size();
+}
+
+size_t Prism::image_size() const {
+  return backend_ == kDawg ? dawg_->total_size() : trie_->total_size();
 }
 
 uint32_t Prism::dict_file_checksum() const {
@@ -0,0 +1,769 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/uuid.hpp>
+#if defined(_MSC_VER)
+#pragma warning(disable: 4244)
+#pragma warning(disable: 4351)
+#endif
+#include <kchashdb.h>
+#if defined(_MSC_VER)
+#pragma warning(default: 4351)
+#pragma warning(default: 4244)
+#endif
+#include <rime/dict/sorted_store.h>
+
+namespace {
+
+const char kSortedTableFormat[] = "Rime::SortedTable/1.0";
+const char kSortedTableFormatPrefix[] = "Rime::SortedTable/";
+
+// the memtable is merged into the table once it holds this many records
+const size_t kMaxMemtableRecords = 2000;
+
+// the log begins with the stamp of its table; a log record is an
+// operation, '+' for update or '-' for erasure, followed by the key and,
+// for an update, the value; strings are preceded by their lengths
+inline void write_uint32(std::ostream &out, uint32_t n) {
+  char bytes[4];
+  for (int i = 0; i < 4; ++i, n >>= 8)
+    bytes[i] = static_cast<char>(n & 0xff);
+  out.write(bytes, 4);
+}
+
+inline bool read_uint32(std::istream &in, uint32_t *n) {
+  char bytes[4];
+  if (!in.read(bytes, 4))
+    return false;
+  *n = 0;
+  for (int i = 3; i >= 0; --i)
+    *n = (*n << 8) | static_cast<unsigned char>(bytes[i]);
+  return true;
+}
+
+inline void write_string(std::ostream &out, const std::string &s) {
+  write_uint32(out, static_cast<uint32_t>(s.length()));
+  out.write(s.data(), s.length());
+}
+
+inline bool read_string(std::istream &in, std::string *s) {
+  uint32_t n = 0;
+  if (!read_uint32(in, &n))
+    return false;
+  s->resize(n);
+  return n == 0 || in.read(&(*s)[0], n);
+}
+
+inline void write_record(std::ostream &out, const std::string &key,
+                         const rime::sorted::MemRecord &record) {
+  out.put(record.erased ? '-' : '+');
+  write_string(out, key);
+  if (!record.erased)
+    write_string(out, record.value);
+}
+
+// a compacted table keeps the stamp of the one it replaces, as the updates
+// in the log are still to be applied on it; any other table is given a new
+// stamp, so that the log left by a table it has replaced is never replayed.
+uint32_t new_stamp() {
+  boost::uuids::random_generator generate;
+  boost::uuids::uuid id(generate());
+  uint32_t stamp = 0;
+  std::memcpy(&stamp, id.data, sizeof(stamp));
+  return stamp;
+}
+
+inline int compare(const rime::sorted::Record &record,
+                   const std::string &key) {
+  size_t n = (std::min)(static_cast<size_t>(record.key_length),
+                        key.length());
+  int result = n ? std::memcmp(record.key.get(), key.data(), n) : 0;
+  if (result)
+    return result;
+  if (record.key_length == key.length())
+    return 0;
+  return record.key_length < key.length() ? -1 : 1;
+}
+
+}  // namespace
+
+namespace rime {
+
+// merges records from layers of tables and memtables;
+// a record in a later layer hides those of the same key in earlier ones
+class SortedCursor : public DbCursor {
+ public:
+  void AddLayer(const shared_ptr<SortedTable> &table);
+  void AddLayer(const shared_ptr<sorted::Memtable> &memtable);
+
+  virtual bool Jump(const std::string &key);
+  virtual bool JumpBack(const std::string &key);
+  virtual bool GetKey(std::string *key);
+  virtual bool Get(std::string *key, std::string *value);
+  virtual bool Step();
+
+ private:
+  struct Layer {
+    shared_ptr<SortedTable> table;
+    shared_ptr<sorted::Memtable> memtable;
+    size_t index;
+    sorted::Memtable::const_iterator pos;
+    bool exhausted;
+    std::string key;
+
+    Layer() : index(0), exhausted(true) {}
+    // positions the layer at the first record not less than the key
+    void Seek(const std::string &k);
+    // finds the last key before the bound, or not greater than it
+    bool FindLast(const std::string &bound, bool inclusive,
+                  std::string *last) const;
+    void Step();
+    void Update();
+  };
+
+  // the layer holding the current record, or -1 past the end
+  int Top() const;
+  bool IsErased(int layer) const;
+  void Seek(const std::string &key);
+  void StepOver(const std::string &key);
+  void SkipErased();
+
+  std::vector<Layer> layers_;
+};
+
+void SortedCursor::Layer::Seek(const std::string &k) {
+  if (table)
+    index = table->LowerBound(k);
+  else
+    pos = memtable->lower_bound(k);
+  Update();
+}
+
+bool SortedCursor::Layer::FindLast(const std::string &bound, bool inclusive,
+                                   std::string *last) const {
+  if (table) {
+    size_t i = table->LowerBound(bound);
+    if (inclusive && i < table->size() && table->key(i) == bound)
+      ++i;
+    if (i == 0)
+      return false;
+    *last = table->key(i - 1);
+    return true;
+  }
+  sorted::Memtable::const_iterator it = inclusive ?
+      memtable->upper_bound(bound) : memtable->lower_bound(bound);
+  if (it == memtable->begin())
+    return false;
+  *last = (--it)->first;
+  return true;
+}
+
+void SortedCursor::Layer::Step() {
+  if (exhausted)
+    return;
+  if (table)
+    ++index;
+  else
+    ++pos;
+  Update();
+}
+
+void SortedCursor::Layer::Update() {
+  exhausted = table ? index >= table->size() : pos == memtable->end();
+  if (!exhausted)
+    key = table ? table->key(index) : pos->first;
+}
+
+void SortedCursor::AddLayer(const shared_ptr<SortedTable> &table) {
+  if (!table)
+    return;
+  layers_.push_back(Layer());
+  layers_.back().table = table;
+}
+
+void SortedCursor::AddLayer(const shared_ptr<sorted::Memtable> &memtable) {
+  if (!memtable)
+    return;
+  layers_.push_back(Layer());
+  layers_.back().memtable = memtable;
+}
+
+int SortedCursor::Top() const {
+  int top = -1;
+  for (int i = 0; i < static_cast<int>(layers_.size()); ++i) {
+    if (layers_[i].exhausted)
+      continue;
+    if (top < 0 || layers_[i].key <= layers_[top].key)
+      top = i;
+  }
+  return top;
+}
+
+bool SortedCursor::IsErased(int layer) const {
+  return layers_[layer].memtable && layers_[layer].pos->second.erased;
+}
+
+void SortedCursor::Seek(const std::string &key) {
+  for (size_t i = 0; i < layers_.size(); ++i)
+    layers_[i].Seek(key);
+}
+
+void SortedCursor::StepOver(const std::string &key) {
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    if (!layers_[i].exhausted && layers_[i].key == key)
+      layers_[i].Step();
+  }
+}
+
+void SortedCursor::SkipErased() {
+  int top;
+  while ((top = Top()) >= 0 && IsErased(top)) {
+    std::string key(layers_[top].key);
+    StepOver(key);
+  }
+}
+
+bool SortedCursor::Jump(const std::string &key) {
+  Seek(key);
+  SkipErased();
+  return Top() >= 0;
+}
+
+bool SortedCursor::JumpBack(const std::string &key) {
+  std::string bound(key);
+  bool inclusive = true;
+  while (true) {
+    bool found = false;
+    std::string last;
+    for (size_t i = 0; i < layers_.size(); ++i) {
+      std::string k;
+      if (layers_[i].FindLast(bound, inclusive, &k) && (!found || k > last)) {
+        last = k;
+        found = true;
+      }
+    }
+    if (!found) {
+      for (size_t i = 0; i < layers_.size(); ++i) {
+        layers_[i].exhausted = true;
+      }
+      return false;
+    }
+    Seek(last);
+    if (!IsErased(Top()))
+      return true;
+    // the record has been erased; look before it
+    bound = last;
+    inclusive = false;
+  }
+}
+
+bool SortedCursor::GetKey(std::string *key) {
+  int top = Top();
+  if (top < 0 || !key)
+    return false;
+  *key = layers_[top].key;
+  return true;
+}
+
+bool SortedCursor::Get(std::string *key, std::string *value) {
+  int top = Top();
+  if (top < 0 || !key || !value)
+    return false;
+  const Layer &layer(layers_[top]);
+  *key = layer.key;
+  if (layer.table)
+    *value = layer.table->value(layer.index);
+  else
+    *value = layer.pos->second.value;
+  return true;
+}
+
+bool SortedCursor::Step() {
+  int top = Top();
+  if (top < 0)
+    return false;
+  std::string key(layers_[top].key);
+  StepOver(key);
+  SkipErased();
+  return true;
+}
+
+// an error mapping the file is thrown, and should not escape the thread
+// of a compaction
+static bool WriteTable(DbCursor *source, const std::string &file_name,
+                       uint32_t stamp) {
+  SortedTable table(file_name);
+  try {
+    return table.Build(source, stamp) && table.Save();
+  }
+  catch (const std::exception &ex) {
+    EZLOGGERPRINT("Error writing sorted table '%s': %s",
+                  file_name.c_str(), ex.what());
+    return false;
+  }
+}
+
+// snapshots dumped by kyotocabinet are loaded through a temporary db
+static bool ImportKyotoSnapshot(const std::string &snapshot_file,
+                                const std::string &temp_file,
+                                sorted::Memtable *records) {
+  boost::system::error_code ec;
+  boost::filesystem::remove(temp_file, ec);
+  kyotocabinet::TreeDB db;
+  if (!db.open(temp_file))
+    return false;
+  bool success = db.load_snapshot(snapshot_file);
+  if (success) {
+    scoped_ptr<kyotocabinet::DB::Cursor> cursor(db.cursor());
+    std::string key, value;
+    cursor->jump();
+    while (cursor->get(&key, &value, true)) {
+      (*records)[key] = sorted::MemRecord(value);
+    }
+  }
+  db.close();
+  boost::filesystem::remove(temp_file, ec);
+  return success;
+}
+
+// SortedTable members
+
+bool SortedTable::IsSortedTable(const std::string &file_name) {
+  std::ifstream fin(file_name.c_str(), std::ios::binary);
+  char format[sorted::Metadata::kFormatMaxLength] = { 0 };
+  return fin.read(format, sizeof(format)) &&
+      !std::strncmp(format, kSortedTableFormatPrefix,
+                    std::strlen(kSortedTableFormatPrefix));
+}
+
+bool SortedTable::Load() {
+  if (IsOpen())
+    Close();
+  if (!OpenReadOnly()) {
+    EZLOGGERPRINT("Error opening sorted table '%s'.", file_name().c_str());
+    return false;
+  }
+  if (file_size() >= sizeof(sorted::Metadata))
+    metadata_ = Find<sorted::Metadata>(0);
+  if (!metadata_ ||
+      std::strncmp(metadata_->format, kSortedTableFormatPrefix,
+                   std::strlen(kSortedTableFormatPrefix))) {
+    EZLOGGERPRINT("Error: '%s' is not a sorted table.", file_name().c_str());
+    metadata_ = NULL;
+    return false;
+  }
+  records_ = metadata_->records.get();
+  if (!records_) {
+    EZLOGGERPRINT("Records not found in '%s'.", file_name().c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SortedTable::Save() {
+  if (!records_) {
+    EZLOGGERPRINT("Error: the sorted table has not been constructed!");
+    return false;
+  }
+  return ShrinkToFit();
+}
+
+bool SortedTable::Build(DbCursor *source, uint32_t stamp) {
+  // the first pass measures the space needed
+  size_t num_records = 0;
+  size_t num_bytes = 0;
+  std::string key, value;
+  for (source->Jump(""); source->Get(&key, &value); source->Step()) {
+    ++num_records;
+    num_bytes += key.length() + value.length();
+  }
+  size_t capacity = sizeof(sorted::Metadata) + sizeof(sorted::RecordArray) +
+      sizeof(sorted::Record) * num_records + num_bytes;
+  if (!Create(capacity)) {
+    EZLOGGERPRINT("Error creating sorted table '%s'.", file_name().c_str());
+    return false;
+  }
+  metadata_ = Allocate<sorted::Metadata>();
+  records_ = CreateArray<sorted::Record>(num_records);
+  if (!metadata_ || !records_) {
+    EZLOGGERPRINT("Error creating metadata in file '%s'.",
+                  file_name().c_str());
+    return false;
+  }
+  std::strncpy(metadata_->format, kSortedTableFormat,
+               sorted::Metadata::kFormatMaxLength);
+  metadata_->stamp = stamp;
+  metadata_->num_records = num_records;
+  metadata_->records = records_;
+  size_t i = 0;
+  for (source->Jump(""); i < num_records && source->Get(&key, &value);
+       source->Step(), ++i) {
+    sorted::Record &record(records_->at[i]);
+    char *k = Allocate<char>(key.length());
+    char *v = Allocate<char>(value.length());
+    if (!k || !v)
+      return false;
+    std::memcpy(k, key.data(), key.length());
+    std::memcpy(v, value.data(), value.length());
+    record.key = k;
+    record.key_length = key.length();
+    record.value = v;
+    record.value_length = value.length();
+  }
+  return i == num_records;
+}
+
+size_t SortedTable::LowerBound(const std::string &key) const {
+  size_t first = 0;
+  size_t count = size();
+  while (count > 0) {
+    size_t half = count / 2;
+    if (compare(records_->at[first + half], key) < 0) {
+      first += half + 1;
+      count -= half + 1;
+    }
+    else {
+      count = half;
+    }
+  }
+  return first;
+}
+
+bool SortedTable::Get(const std::string &key, std::string *value) const {
+  size_t i = LowerBound(key);
+  if (i >= size() || compare(records_->at[i], key) != 0)
+    return false;
+  *value = this->value(i);
+  return true;
+}
+
+const std::string SortedTable::key(size_t index) const {
+  const sorted::Record &record(records_->at[index]);
+  if (!record.key_length)
+    return std::string();
+  return std::string(record.key.get(), record.key_length);
+}
+
+const std::string SortedTable::value(size_t index) const {
+  const sorted::Record &record(records_->at[index]);
+  if (!record.value_length)
+    return std::string();
+  return std::string(record.value.get(), record.value_length);
+}
+
+// SortedStore members
+
+SortedStore::SortedStore()
+    : loaded_(false), read_only_(false), compacted_(false),
+      compaction_threshold_(kMaxMemtableRecords) {
+}
+
+SortedStore::~SortedStore() {
+  if (loaded_)
+    Close();
+}
+
+bool SortedStore::Open(const std::string &file_name, bool read_only) {
+  if (loaded_) return false;
+  file_name_ = file_name;
+  read_only_ = read_only;
+  memtable_ = make_shared<sorted::Memtable>();
+  frozen_.reset();
+  if (!boost::filesystem::exists(file_name_)) {
+    if (read_only_)
+      return false;
+    // a log without its table is stale
+    boost::system::error_code ec;
+    boost::filesystem::remove(log_file_name(), ec);
+    SortedCursor empty;
+    if (!WriteTable(&empty, temp_file_name(), new_stamp()))
+      return false;
+    boost::filesystem::rename(temp_file_name(), file_name_, ec);
+    if (ec)
+      return false;
+  }
+  table_ = make_shared<SortedTable>(file_name_);
+  if (!table_->Load() || !ReplayLog()) {
+    table_.reset();
+    return false;
+  }
+  loaded_ = true;
+  // also drops a record truncated by a crash from the log
+  if (!read_only_ && !RewriteLog()) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool SortedStore::Close() {
+  if (!loaded_) return false;
+  FinishCompaction(true);
+  if (log_.is_open())
+    log_.close();
+  table_.reset();
+  memtable_.reset();
+  frozen_.reset();
+  loaded_ = false;
+  return true;
+}
+
+bool SortedStore::Get(const std::string &key, std::string *value) {
+  if (!loaded_ || !value) return false;
+  const sorted::Memtable *memtables[] = { memtable_.get(), frozen_.get() };
+  for (int i = 0; i < 2; ++i) {
+    if (!memtables[i])
+      continue;
+    sorted::Memtable::const_iterator it = memtables[i]->find(key);
+    if (it != memtables[i]->end()) {
+      if (it->second.erased)
+        return false;
+      *value = it->second.value;
+      return true;
+    }
+  }
+  return table_->Get(key, value);
+}
+
+bool SortedStore::Set(const std::string &key, const std::string &value) {
+  return Update(key, sorted::MemRecord(value));
+}
+
+bool SortedStore::Remove(const std::string &key) {
+  std::string value;
+  return Get(key, &value) && Update(key, sorted::MemRecord());
+}
+
+bool SortedStore::Update(const std::string &key,
+                         const sorted::MemRecord &record) {
+  if (!loaded_ || read_only_) return false;
+  FinishCompaction(false);
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    (*memtable_)[key] = record;
+  }
+  if (!AppendToLog(key, record))
+    return false;
+  if (!frozen_ && memtable_->size() >= compaction_threshold_)
+    StartCompaction();
+  return true;
+}
+
+bool SortedStore::Synchronize() {
+  if (!loaded_) return false;
+  if (read_only_ || !log_.is_open()) return true;
+  log_.flush();
+  return log_.good();
+}
+
+DbCursor* SortedStore::NewCursor() {
+  if (!loaded_) return NULL;
+  SortedCursor *cursor = new SortedCursor;
+  cursor->AddLayer(table_);
+  cursor->AddLayer(frozen_);
+  cursor->AddLayer(memtable_);
+  return cursor;
+}
+
+// the memtable is copied, for it changes as the store is updated
+DbCursor* SortedStore::NewSnapshotCursor() {
+  if (!loaded_) return NULL;
+  SortedCursor *cursor = new SortedCursor;
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  cursor->AddLayer(table_);
+  cursor->AddLayer(frozen_);
+  cursor->AddLayer(make_shared<sorted::Memtable>(*memtable_));
+  return cursor;
+}
+
+// may be called in a background thread
+bool SortedStore::DumpSnapshot(const std::string &snapshot_file) {
+  scoped_ptr<DbCursor> source(NewSnapshotCursor());
+  return source && WriteTable(source.get(), snapshot_file, new_stamp());
+}
+
+bool SortedStore::LoadSnapshot(const std::string &snapshot_file) {
+  if (!loaded_ || read_only_) return false;
+  FinishCompaction(true);
+  bool written = false;
+  {
+    // the cursor lets go of the current table before it is replaced
+    SortedCursor source;
+    source.AddLayer(table_);
+    source.AddLayer(memtable_);
+    if (SortedTable::IsSortedTable(snapshot_file)) {
+      shared_ptr<SortedTable> snapshot(
+          make_shared<SortedTable>(snapshot_file));
+      if (!snapshot->Load())
+        return false;
+      source.AddLayer(snapshot);
+    }
+    else {
+      shared_ptr<sorted::Memtable> records(make_shared<sorted::Memtable>());
+      if (!ImportKyotoSnapshot(snapshot_file, file_name_ + ".import",
+                               records.get()))
+        return false;
+      source.AddLayer(records);
+    }
+    // the snapshot is merged with everything in the store into a new table
+    written = WriteTable(&source, temp_file_name(), new_stamp());
+  }
+  if (!written || !InstallTable()) {
+    EZLOGGERPRINT("Error: failed to load snapshot into '%s'.",
+                  file_name_.c_str());
+    return false;
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    memtable_ = make_shared<sorted::Memtable>();
+  }
+  return RewriteLog();
+}
+
+bool SortedStore::ReplayLog() {
+  std::ifstream fin(log_file_name().c_str(), std::ios::binary);
+  uint32_t stamp = 0;
+  if (!fin || !read_uint32(fin, &stamp))
+    return true;
+  if (stamp != table_->stamp()) {
+    EZLOGGERPRINT("Warning: ignoring the stale log of '%s'.",
+                  file_name_.c_str());
+    return true;
+  }
+  char op;
+  std::string key, value;
+  // stops at a record truncated by a crash
+  while (fin.get(op) && read_string(fin, &key) &&
+         (op == '-' || read_string(fin, &value))) {
+    (*memtable_)[key] = (op == '-') ? sorted::MemRecord() :
+                                      sorted::MemRecord(value);
+  }
+  return true;
+}
+
+bool SortedStore::AppendToLog(const std::string &key,
+                              const sorted::MemRecord &record) {
+  if (!log_.is_open()) {
+    log_.clear();
+    log_.open(log_file_name().c_str(), std::ios::binary | std::ios::trunc);
+    write_uint32(log_, table_->stamp());
+  }
+  write_record(log_, key, record);
+  return log_.good();
+}
+
+bool SortedStore::RewriteLog() {
+  if (log_.is_open())
+    log_.close();
+  boost::system::error_code ec;
+  if (memtable_->empty()) {
+    // a new log is started by the next update
+    boost::filesystem::remove(log_file_name(), ec);
+    return true;
+  }
+  std::string temp_log(log_file_name() + ".tmp");
+  std::ofstream fout(temp_log.c_str(), std::ios::binary | std::ios::trunc);
+  write_uint32(fout, table_->stamp());
+  BOOST_FOREACH(const sorted::Memtable::value_type &r, *memtable_) {
+    write_record(fout, r.first, r.second);
+  }
+  fout.close();
+  if (!fout)
+    return false;
+  boost::filesystem::rename(temp_log, log_file_name(), ec);
+  if (ec)
+    return false;
+  log_.clear();
+  log_.open(log_file_name().c_str(), std::ios::binary | std::ios::app);
+  return log_.good();
+}
+
+// a file mapped into memory cannot be replaced on Windows, so the store
+// lets go of the current table first; a cursor still holding it keeps the
+// file in place, and the table is then opened again as it is.
+bool SortedStore::InstallTable() {
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  table_.reset();
+  boost::system::error_code ec;
+  boost::filesystem::rename(temp_file_name(), file_name_, ec);
+  bool replaced = !ec;
+  if (!replaced) {
+    EZLOGGERPRINT("Error: failed to replace '%s'.", file_name_.c_str());
+    boost::filesystem::remove(temp_file_name(), ec);
+  }
+  shared_ptr<SortedTable> table(make_shared<SortedTable>(file_name_));
+  if (!table->Load()) {
+    EZLOGGERPRINT("Error: lost the table of '%s'.", file_name_.c_str());
+    loaded_ = false;
+    return false;
+  }
+  table_ = table;
+  return replaced;
+}
+
+void SortedStore::StartCompaction() {
+  EZLOGGERPRINT("compacting db '%s' in the background.", file_name_.c_str());
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    frozen_ = memtable_;
+    memtable_ = make_shared<sorted::Memtable>();
+  }
+  compacted_ = false;
+  boost::thread t(boost::bind(&SortedStore::Compact, this));
+  compaction_thread_.swap(t);
+}
+
+// the table is held no longer than the compaction, so that it can be
+// replaced once the thread has finished
+void SortedStore::Compact() {
+  SortedCursor source;
+  uint32_t stamp = 0;
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    source.AddLayer(table_);
+    source.AddLayer(frozen_);
+    stamp = table_->stamp();
+  }
+  compacted_ = WriteTable(&source, temp_file_name(), stamp);
+}
+
+// returns false if the compaction is still going on
+bool SortedStore::FinishCompaction(bool wait) {
+  if (!compaction_thread_.joinable())
+    return true;
+  if (wait)
+    compaction_thread_.join();
+  else if (!compaction_thread_.timed_join(boost::posix_time::milliseconds(0)))
+    return false;
+  if (!compacted_ || !InstallTable()) {
+    EZLOGGERPRINT("Error: failed to compact db '%s'.", file_name_.c_str());
+    // the frozen updates stay, behind the newer ones
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    memtable_->insert(frozen_->begin(), frozen_->end());
+    frozen_.reset();
+    // not to rewrite the whole table again with every update that follows
+    compaction_threshold_ = memtable_->size() + kMaxMemtableRecords;
+    return true;
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    frozen_.reset();
+  }
+  compaction_threshold_ = kMaxMemtableRecords;
+  RewriteLog();
+  return true;
+}
+
+}  // namespace rime
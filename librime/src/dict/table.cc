@@ -438,46 +438,89 @@ const TableAccessor Table::QueryPhrases(const Code &code) {
   return visitor.Access(-1);
 }
 
-bool Table::Query(const SyllableGraph &syll_graph, size_t start_pos,
-                  TableQueryResult *result) {
-  if (!result ||
-      !index_ ||
-      start_pos >= syll_graph.interpreted_length)
-    return false;
-  result->clear();
-  std::queue<std::pair<size_t, TableVisitor> > q;
-  q.push(std::make_pair(start_pos, TableVisitor(index_)));
-  while (!q.empty()) {
-    int current_pos = q.front().first;
-    TableVisitor visitor = q.front().second;
-    q.pop();
-    SpellingIndices::const_iterator index = syll_graph.indices.find(current_pos);
-    if (index == syll_graph.indices.end()) {
+namespace {
+
+struct QueryState {
+  size_t start_pos;
+  size_t current_pos;
+  TableVisitor visitor;
+  QueryState(size_t start, size_t current, const TableVisitor &v)
+      : start_pos(start), current_pos(current), visitor(v) {}
+};
+
+// breadth-first search from the queued vertices
+void QueryLattice(const SyllableGraph &syll_graph,
+                  std::queue<QueryState> *q,
+                  TableQueryLattice *result) {
+  while (!q->empty()) {
+    size_t start_pos = q->front().start_pos;
+    int current_pos = q->front().current_pos;
+    TableVisitor visitor = q->front().visitor;
+    q->pop();
+    size_t k = syll_graph.index_begin(current_pos);
+    size_t index_end = syll_graph.index_end(current_pos);
+    if (k == index_end) {
       continue;
     }
     if (visitor.level() == Code::kIndexCodeMaxLength) {
       TableAccessor accessor(visitor.Access(-1));
       if (!accessor.exhausted()) {
-        (*result)[current_pos].push_back(accessor);
+        (*result)[start_pos][current_pos].push_back(accessor);
       }
       continue;
     }
-    BOOST_FOREACH(const SpellingIndex::value_type& spellings, index->second) {
-      SyllableId syll_id = spellings.first;
+    while (k < index_end) {
+      SyllableId syll_id = syll_graph.indexed_spelling(k).syllable_id;
       TableAccessor accessor(visitor.Access(syll_id));
-      BOOST_FOREACH(const SpellingProperties* props, spellings.second) {
-        size_t end_pos = props->end_pos;
+      for (; k < index_end &&
+               syll_graph.indexed_spelling(k).syllable_id == syll_id; ++k) {
+        const SpellingProperties &props(syll_graph.indexed_spelling(k).properties);
+        size_t end_pos = props.end_pos;
         if (!accessor.exhausted()) {
-          (*result)[end_pos].push_back(accessor);
+          (*result)[start_pos][end_pos].push_back(accessor);
         }
         if (end_pos < syll_graph.interpreted_length &&
-          visitor.Walk(syll_id, props->credibility)) {
-          q.push(std::make_pair(end_pos, visitor));
+          visitor.Walk(syll_id, props.credibility)) {
+          q->push(QueryState(start_pos, end_pos, visitor));
           visitor.Backdate();
         }
       }
     }
   }
+}
+
+}  // namespace
+
+bool Table::Query(const SyllableGraph &syll_graph, size_t start_pos,
+                  TableQueryResult *result) {
+  if (!result ||
+      !index_ ||
+      start_pos >= syll_graph.interpreted_length)
+    return false;
+  result->clear();
+  std::queue<QueryState> q;
+  q.push(QueryState(start_pos, start_pos, TableVisitor(index_)));
+  TableQueryLattice lattice;
+  QueryLattice(syll_graph, &q, &lattice);
+  if (lattice.empty())
+    return false;
+  result->swap(lattice.begin()->second);
+  return !result->empty();
+}
+
+bool Table::Query(const SyllableGraph &syll_graph,
+                  TableQueryLattice *result) {
+  if (!result || !index_)
+    return false;
+  result->clear();
+  // one search per start vertex, run from the same queue
+  std::queue<QueryState> q;
+  for (size_t start_pos = 0; start_pos < syll_graph.interpreted_length;
+       ++start_pos) {
+    if (syll_graph.num_edges(start_pos))
+      q.push(QueryState(start_pos, start_pos, TableVisitor(index_)));
+  }
+  QueryLattice(syll_graph, &q, result);
   return !result->empty();
 }
 
@@ -6,24 +6,217 @@
 //
 // 2011-11-02 GONG Chen <chen.sst@gmail.com>
 //
+#include <iterator>
+#include <set>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#if defined(_MSC_VER)
+#pragma warning(disable: 4244)
+#pragma warning(disable: 4351)
+#endif
+#include <kchashdb.h>
+#if defined(_MSC_VER)
+#pragma warning(default: 4351)
+#pragma warning(default: 4244)
+#endif
 #include <rime_version.h>
 #include <rime/common.h>
 #include <rime/schema.h>
 #include <rime/service.h>
+#include <rime/dict/sorted_store.h>
 #include <rime/dict/user_db.h>
 #include <rime/algo/syllabifier.h>
 
+namespace {
+
+const size_t kMaxPendingRecords = 200;
+// a record rewritten on every commit, such as the tick, keeps the number
+// of pending records low while the journal grows
+const std::streamoff kMaxJournalSize = 64 * 1024;
+
+// a full snapshot is dumped once the delta outgrows a quarter of it
+const uintmax_t kMinSnapshotDeltaSize = 64 * 1024;
+const uintmax_t kSnapshotToDeltaRatio = 4;
+
+inline uintmax_t file_size(const std::string &file_name) {
+  boost::system::error_code ec;
+  uintmax_t size = boost::filesystem::file_size(file_name, ec);
+  return ec ? 0 : size;
+}
+
+// a journal record is a key and a value, each preceded by its length
+inline void write_string(std::ostream &out, const std::string &s) {
+  uint32_t n = static_cast<uint32_t>(s.length());
+  char length[4];
+  for (int i = 0; i < 4; ++i, n >>= 8)
+    length[i] = static_cast<char>(n & 0xff);
+  out.write(length, 4);
+  out.write(s.data(), s.length());
+}
+
+inline bool read_string(std::istream &in, std::string *s) {
+  char length[4];
+  if (!in.read(length, 4))
+    return false;
+  uint32_t n = 0;
+  for (int i = 3; i >= 0; --i)
+    n = (n << 8) | static_cast<unsigned char>(length[i]);
+  s->resize(n);
+  return n == 0 || in.read(&(*s)[0], n);
+}
+
+}  // namespace
+
 namespace rime {
 
+const char kKyotoCabinetEngine[] = "kyotocabinet";
+const char kSortedEngine[] = "sorted";
+
+class KyotoCursor : public DbCursor {
+ public:
+  explicit KyotoCursor(kyotocabinet::DB::Cursor *cursor) : cursor_(cursor) {}
+
+  virtual bool Jump(const std::string &key) { return cursor_->jump(key); }
+  virtual bool JumpBack(const std::string &key) {
+    return cursor_->jump_back(key);
+  }
+  virtual bool GetKey(std::string *key) { return cursor_->get_key(key); }
+  virtual bool Get(std::string *key, std::string *value) {
+    return cursor_->get(key, value);
+  }
+  virtual bool Step() { return cursor_->step(); }
+
+ private:
+  scoped_ptr<kyotocabinet::DB::Cursor> cursor_;
+};
+
+class KyotoStore : public DbStore {
+ public:
+  KyotoStore() {
+    db_.tune_options(kyotocabinet::TreeDB::TLINEAR |
+                     kyotocabinet::TreeDB::TCOMPRESS);
+    db_.tune_buckets(10LL * 1000);
+    db_.tune_defrag(8);
+    db_.tune_page(32768);
+  }
+
+  virtual bool Open(const std::string &file_name, bool read_only) {
+    if (read_only)
+      return db_.open(file_name, kyotocabinet::TreeDB::OREADER);
+    return db_.open(file_name);
+  }
+  virtual bool Close() { return db_.close(); }
+  virtual bool Get(const std::string &key, std::string *value) {
+    return db_.get(key, value);
+  }
+  virtual bool Set(const std::string &key, const std::string &value) {
+    return db_.set(key, value);
+  }
+  virtual bool Remove(const std::string &key) { return db_.remove(key); }
+  virtual bool Synchronize() { return db_.synchronize(); }
+  virtual bool DumpSnapshot(const std::string &snapshot_file) {
+    return db_.dump_snapshot(snapshot_file);
+  }
+  virtual bool LoadSnapshot(const std::string &snapshot_file);
+  virtual DbCursor* NewCursor() { return new KyotoCursor(db_.cursor()); }
+  // cursors of kyotocabinet are thread-safe
+  virtual DbCursor* NewSnapshotCursor() { return NewCursor(); }
+
+ private:
+  kyotocabinet::TreeDB db_;
+};
+
+bool KyotoStore::LoadSnapshot(const std::string &snapshot_file) {
+  if (!SortedTable::IsSortedTable(snapshot_file))
+    return db_.load_snapshot(snapshot_file);
+  // dumped by the sorted engine
+  SortedTable snapshot(snapshot_file);
+  if (!snapshot.Load())
+    return false;
+  for (size_t i = 0; i < snapshot.size(); ++i) {
+    if (!db_.set(snapshot.key(i), snapshot.value(i)))
+      return false;
+  }
+  return true;
+}
+
+static DbStore* CreateStore(const std::string &engine) {
+  if (engine == kSortedEngine)
+    return new SortedStore;
+  if (engine != kKyotoCabinetEngine) {
+    EZLOGGERPRINT("Warning: unknown db engine '%s'; using %s.",
+                  engine.c_str(), kKyotoCabinetEngine);
+  }
+  return new KyotoStore;
+}
+
+static const std::string DetectEngine(const std::string &file_name) {
+  return SortedTable::IsSortedTable(file_name) ? kSortedEngine :
+                                                 kKyotoCabinetEngine;
+}
+
+// a lock file next to a db, held by one process at a time
+class DbFileLock {
+ public:
+  explicit DbFileLock(const std::string &db_file);
+  ~DbFileLock();
+  bool locked() const { return locked_; }
+
+ private:
+  std::string file_name_;
+  scoped_ptr<boost::interprocess::file_lock> lock_;
+  bool locked_;
+};
+
+// DbFileLock members
+
+// file locks are held by processes; within one, a lock file is only
+// opened once, as closing it again would release the lock
+static std::set<std::string> locked_files;
+static boost::mutex locked_files_mutex;
+
+DbFileLock::DbFileLock(const std::string &db_file)
+    : file_name_(db_file + ".lock"), locked_(false) {
+  {
+    boost::lock_guard<boost::mutex> lock(locked_files_mutex);
+    if (!locked_files.insert(file_name_).second)
+      return;
+  }
+  try {
+    std::ofstream touch(file_name_.c_str(), std::ios::app);
+    touch.close();
+    lock_.reset(new boost::interprocess::file_lock(file_name_.c_str()));
+    locked_ = lock_->try_lock();
+  }
+  catch (const boost::interprocess::interprocess_exception &ex) {
+    EZLOGGERPRINT("Error locking '%s': %s", file_name_.c_str(), ex.what());
+  }
+  if (!locked_) {
+    lock_.reset();
+    boost::lock_guard<boost::mutex> lock(locked_files_mutex);
+    locked_files.erase(file_name_);
+  }
+}
+
+DbFileLock::~DbFileLock() {
+  if (!locked_)
+    return;
+  lock_->unlock();
+  lock_.reset();
+  boost::lock_guard<boost::mutex> lock(locked_files_mutex);
+  locked_files.erase(file_name_);
+}
+
 // TreeDbAccessor memebers
 
-TreeDbAccessor::TreeDbAccessor(kyotocabinet::DB::Cursor *cursor,
-                               const std::string &prefix)
-    : cursor_(cursor), prefix_(prefix) {
+TreeDbAccessor::TreeDbAccessor(DbCursor *cursor,
+                               const std::string &prefix,
+                               const PendingRecords *pending)
+    : cursor_(cursor), prefix_(prefix), pending_(pending) {
   Reset();
   if (!prefix.empty())
     Forward(prefix);
@@ -34,41 +227,92 @@ TreeDbAccessor::~TreeDbAccessor() {
 }
 
 bool TreeDbAccessor::Reset() {
-  return cursor_ && cursor_->jump();
+  bool ok = cursor_ && cursor_->Jump("");
+  if (!pending_)
+    return ok;
+  pending_pos_ = pending_->begin();
+  return ok || pending_pos_ != pending_->end();
 }
 
 bool TreeDbAccessor::Forward(const std::string &key) {
-  return cursor_ && cursor_->jump(key);
+  bool ok = cursor_ && cursor_->Jump(key);
+  if (!pending_)
+    return ok;
+  pending_pos_ = pending_->lower_bound(key);
+  return ok || pending_pos_ != pending_->end();
 }
 
 bool TreeDbAccessor::Backward(const std::string &key) {
-  return cursor_ && cursor_->jump_back(key);
+  bool ok = cursor_ && cursor_->JumpBack(key);
+  if (!pending_)
+    return ok;
+  std::string db_key;
+  if (ok && !cursor_->GetKey(&db_key))
+    ok = false;
+  PendingRecords::const_iterator last = pending_->upper_bound(key);
+  if (last != pending_->begin() && (!ok || db_key < (--last)->first)) {
+    // a pending record comes last; the cursor moves to the record after it
+    if (cursor_)
+      cursor_->Jump(last->first);
+    pending_pos_ = last;
+    return true;
+  }
+  pending_pos_ = ok ? pending_->lower_bound(db_key) : pending_->end();
+  return ok;
 }
 
 bool TreeDbAccessor::GetNextRecord(std::string *key, std::string *value) {
   if (!cursor_ || !key || !value)
     return false;
-  return cursor_->get(key, value, true) && boost::starts_with(*key, prefix_);
+  bool in_db = cursor_->Get(key, value);
+  if (!pending_ || pending_pos_ == pending_->end()) {
+    if (!in_db)
+      return false;
+    cursor_->Step();
+    return boost::starts_with(*key, prefix_);
+  }
+  if (!in_db || pending_pos_->first <= *key) {
+    if (in_db && pending_pos_->first == *key)
+      cursor_->Step();  // superseded by the pending update
+    *key = pending_pos_->first;
+    *value = pending_pos_->second;
+    ++pending_pos_;
+  }
+  else {
+    cursor_->Step();
+  }
+  return boost::starts_with(*key, prefix_);
 }
 
 bool TreeDbAccessor::exhausted() {
   std::string key;
-  return !cursor_->get_key(&key, false) || !boost::starts_with(key, prefix_);
+  return !PeekNextKey(&key) || !boost::starts_with(key, prefix_);
+}
+
+bool TreeDbAccessor::PeekNextKey(std::string *key) {
+  bool in_db = cursor_->GetKey(key);
+  if (pending_ && pending_pos_ != pending_->end() &&
+      (!in_db || pending_pos_->first < *key)) {
+    *key = pending_pos_->first;
+    return true;
+  }
+  return in_db;
 }
 
 // TreeDb members
 
-TreeDb::TreeDb(const std::string &name) : name_(name), loaded_(false) {
+TreeDb::TreeDb(const std::string &name, const std::string &engine)
+    : name_(name), engine_(engine), loaded_(false), revision_(0),
+      read_only_(false), write_behind_(false),
+      snapshot_synced_(false), untracked_changes_(0),
+      untracked_changes_at_dump_(0), snapshot_dumped_(false),
+      snapshot_delta_offset_(0) {
   boost::filesystem::path path(Service::instance().deployer().user_data_dir);
   file_name_ = (path / name).string();
 }
 
-void TreeDb::Initialize() {
-  db_.reset(new kyotocabinet::TreeDB);
-  db_->tune_options(kyotocabinet::TreeDB::TLINEAR | kyotocabinet::TreeDB::TCOMPRESS);
-  db_->tune_buckets(10LL * 1000);
-  db_->tune_defrag(8);
-  db_->tune_page(32768);
+void TreeDb::Initialize(const std::string &engine) {
+  db_.reset(CreateStore(engine));
 }
 
 TreeDb::~TreeDb() {
@@ -79,39 +323,237 @@ TreeDb::~TreeDb() {
 const shared_ptr<TreeDbAccessor> TreeDb::Query(const std::string &key) {
   if (!loaded())
     return shared_ptr<TreeDbAccessor>();
-  kyotocabinet::DB::Cursor *cursor = db_->cursor();  // should be freed by us
+  DbCursor *cursor = db_->NewCursor();  // should be freed by us
+  return boost::make_shared<TreeDbAccessor>(cursor, key, &pending_);
+}
+
+const shared_ptr<TreeDbAccessor> TreeDb::QueryStored(const std::string &key) {
+  if (!loaded())
+    return shared_ptr<TreeDbAccessor>();
+  DbCursor *cursor = db_->NewSnapshotCursor();  // should be freed by us
   return boost::make_shared<TreeDbAccessor>(cursor, key);
 }
 
 bool TreeDb::Fetch(const std::string &key, std::string *value) {
   if (!value || !loaded())
     return false;
-  return db_->get(key, value);
+  PendingRecords::const_iterator it = pending_.find(key);
+  if (it != pending_.end()) {
+    *value = it->second;
+    return true;
+  }
+  return db_->Get(key, value);
 }
 
 bool TreeDb::Update(const std::string &key, const std::string &value) {
   if (!loaded()) return false;
   EZDBGONLYLOGGER(key, value);
-  return db_->set(key, value);
+  ++revision_;
+  if (!write_behind_ || read_only_) {
+    UntrackedChange();  // not recorded in the delta
+    return db_->Set(key, value);
+  }
+  pending_[key] = value;
+  if (!AppendToJournal(key, value) ||
+      pending_.size() >= kMaxPendingRecords ||
+      journal_.tellp() >= kMaxJournalSize)
+    return Flush();
+  return true;
 }
 
 bool TreeDb::Erase(const std::string &key) {
   if (!loaded()) return false;
-  return db_->remove(key);
+  ++revision_;
+  // the update in the journal should not outlive the record
+  if (pending_.find(key) != pending_.end() && !Flush())
+    return false;
+  // the delta only records updates; have the next snapshot in full
+  UntrackedChange();
+  return db_->Remove(key);
+}
+
+bool TreeDb::Flush() {
+  if (!loaded()) return false;
+  if (read_only_ || pending_.empty())
+    return true;
+  BOOST_FOREACH(const PendingRecords::value_type &r, pending_) {
+    if (!db_->Set(r.first, r.second)) {
+      EZLOGGERPRINT("Error: failed to flush updates to db '%s'.",
+                    name_.c_str());
+      return false;
+    }
+  }
+  // the journal is dropped only after its updates are stored safely
+  if (!db_->Synchronize())
+    return false;
+  AppendToSnapshotDelta();
+  pending_.clear();
+  if (journal_.is_open())
+    journal_.close();
+  boost::system::error_code ec;
+  boost::filesystem::remove(journal_file_name(), ec);
+  return true;
+}
+
+bool TreeDb::ReplayJournal(bool read_only) {
+  std::ifstream fin(journal_file_name().c_str(), std::ios::binary);
+  if (!fin)
+    return true;
+  EZLOGGERPRINT("replaying journal of db '%s'.", name_.c_str());
+  std::string key, value;
+  int num_records = 0;
+  // stops at a record truncated by a crash
+  while (read_string(fin, &key) && read_string(fin, &value)) {
+    if (read_only)
+      pending_[key] = value;
+    else if (!db_->Set(key, value))
+      return false;
+    ++num_records;
+  }
+  fin.close();
+  EZLOGGERPRINT("%d updates recovered from journal.", num_records);
+  if (read_only)
+    return true;
+  if (!db_->Synchronize())
+    return false;
+  boost::system::error_code ec;
+  boost::filesystem::remove(journal_file_name(), ec);
+  return true;
+}
+
+bool TreeDb::AppendToJournal(const std::string &key,
+                             const std::string &value) {
+  if (!journal_.is_open()) {
+    journal_.clear();
+    journal_.open(journal_file_name().c_str(),
+                  std::ios::binary | std::ios::app);
+  }
+  write_string(journal_, key);
+  write_string(journal_, value);
+  journal_.flush();
+  return journal_.good();
+}
+
+bool TreeDb::AppendToSnapshotDelta() {
+  std::ofstream fout((snapshot_file_name() + ".delta").c_str(),
+                     std::ios::binary | std::ios::app);
+  BOOST_FOREACH(const PendingRecords::value_type &r, pending_) {
+    write_string(fout, r.first);
+    write_string(fout, r.second);
+  }
+  fout.close();
+  if (!fout) {
+    EZLOGGERPRINT("Error: failed to update snapshot delta of db '%s'.",
+                  name_.c_str());
+    UntrackedChange();
+    return false;
+  }
+  return true;
+}
+
+bool TreeDb::ApplySnapshotDelta(const std::string &delta_file) {
+  std::ifstream fin(delta_file.c_str(), std::ios::binary);
+  if (!fin)
+    return true;
+  std::string key, value;
+  while (read_string(fin, &key) && read_string(fin, &value)) {
+    if (!db_->Set(key, value))
+      return false;
+  }
+  return true;
 }
 
 bool TreeDb::Backup() {
   if (!loaded()) return false;
+  FinishSnapshot(true);
+  if (!Flush()) return false;
   EZLOGGERPRINT("backing up db '%s'.", name_.c_str());
-  bool success = db_->dump_snapshot(file_name() + ".snapshot");
+  bool success = db_->DumpSnapshot(snapshot_file_name());
   if (!success) {
     EZLOGGERPRINT("Error: failed to backup db '%s'.", name_.c_str());
+    return false;
   }
-  return success;
+  // everything in the delta has gone into the snapshot
+  boost::system::error_code ec;
+  boost::filesystem::remove(snapshot_file_name() + ".delta", ec);
+  snapshot_synced_ = !read_only_;
+  return true;
+}
+
+bool TreeDb::UpdateSnapshot() {
+  if (!loaded() || read_only_) return false;
+  // changes go into the delta as they are flushed
+  if (!FinishSnapshot(false))
+    return Flush();
+  if (!Flush())
+    return false;
+  uintmax_t delta_size = file_size(snapshot_file_name() + ".delta");
+  uintmax_t snapshot_size = file_size(snapshot_file_name());
+  if (snapshot_synced_ &&
+      (delta_size < kMinSnapshotDeltaSize ||
+       delta_size * kSnapshotToDeltaRatio < snapshot_size))
+    return true;
+  // changes before this point will be in the new snapshot,
+  // while those after it are kept in the delta
+  EZLOGGERPRINT("backing up db '%s' in the background.", name_.c_str());
+  snapshot_delta_offset_ = delta_size;
+  untracked_changes_at_dump_ = untracked_changes_;
+  snapshot_dumped_ = false;
+  boost::thread t(boost::bind(&TreeDb::DumpSnapshot, this));
+  snapshot_thread_.swap(t);
+  return snapshot_thread_.joinable();
+}
+
+void TreeDb::DumpSnapshot() {
+  snapshot_dumped_ = db_->DumpSnapshot(snapshot_file_name() + ".tmp");
+}
+
+// returns false if the snapshot is still being dumped
+bool TreeDb::FinishSnapshot(bool wait) {
+  if (!snapshot_thread_.joinable())
+    return true;
+  if (wait)
+    snapshot_thread_.join();
+  else if (!snapshot_thread_.timed_join(boost::posix_time::milliseconds(0)))
+    return false;
+  if (!snapshot_dumped_) {
+    EZLOGGERPRINT("Error: failed to backup db '%s'.", name_.c_str());
+    return true;
+  }
+  std::string snapshot_file(snapshot_file_name());
+  std::string delta_file(snapshot_file + ".delta");
+  boost::system::error_code ec;
+  boost::filesystem::rename(snapshot_file + ".tmp", snapshot_file, ec);
+  if (ec) {
+    EZLOGGERPRINT("Error: failed to replace snapshot of db '%s'.",
+                  name_.c_str());
+    return true;
+  }
+  // drops the part of the delta that is now in the snapshot;
+  // replaying it again would be harmless should this fail.
+  std::string rest;
+  {
+    std::ifstream fin(delta_file.c_str(), std::ios::binary);
+    if (fin && fin.seekg(snapshot_delta_offset_)) {
+      rest.assign(std::istreambuf_iterator<char>(fin),
+                  std::istreambuf_iterator<char>());
+    }
+  }
+  if (rest.empty()) {
+    boost::filesystem::remove(delta_file, ec);
+  }
+  else {
+    std::ofstream fout(delta_file.c_str(),
+                       std::ios::binary | std::ios::trunc);
+    fout.write(rest.data(), rest.size());
+  }
+  // an erasure, for one, may or may not have made it into the snapshot
+  snapshot_synced_ = (untracked_changes_ == untracked_changes_at_dump_);
+  return true;
 }
 
 bool TreeDb::RecoverFromSnapshot() {
-  std::string snapshot_file(file_name() + ".snapshot");
+  std::string snapshot_file(snapshot_file_name());
   if (!boost::filesystem::exists(snapshot_file))
     return false;
   EZLOGGERPRINT("snapshot file exists, trying to recover db '%s'.", name_.c_str());
@@ -126,12 +568,68 @@ bool TreeDb::RecoverFromSnapshot() {
       return false;
     }
   }
-  return Open() && Restore(snapshot_file);
+  // updates in the journal are newer than the snapshot; they are kept
+  // until it has been restored
+  if (!OpenStore() || !Restore(snapshot_file))
+    return false;
+  ReplayJournal(false);
+  std::string db_name;
+  if (!Fetch("\x01/db_name", &db_name))
+    CreateMetadata();
+  return true;
+}
+
+// the records are dumped into a file of its own, leaving the snapshot
+// as it is; the lock is held till the db is open again.
+bool TreeDb::Defragment() {
+  if (!loaded() || read_only_) return false;
+  FinishSnapshot(true);
+  if (!Flush()) return false;
+  std::string dump_file(file_name() + ".defrag");
+  boost::system::error_code ec;
+  boost::filesystem::remove(dump_file + ".delta", ec);
+  if (!db_->DumpSnapshot(dump_file)) {
+    EZLOGGERPRINT("Error: failed to dump db '%s'.", name_.c_str());
+    return false;
+  }
+  EZLOGGERPRINT("defragmenting db '%s'.", name_.c_str());
+  db_->Close();
+  loaded_ = false;
+  std::string old_file(file_name() + ".old");
+  boost::filesystem::rename(file_name(), old_file, ec);
+  bool success = false;
+  if (!ec) {
+    success = OpenStore() && Restore(dump_file);
+    if (!success) {
+      // the original file is put back
+      if (loaded_) {
+        db_->Close();
+        loaded_ = false;
+      }
+      boost::filesystem::remove(file_name(), ec);
+      boost::filesystem::rename(old_file, file_name(), ec);
+      if (ec) {
+        EZLOGGERPRINT("Error: the original file of db '%s' is kept in '%s'.",
+                      name_.c_str(), old_file.c_str());
+      }
+    }
+  }
+  boost::filesystem::remove(dump_file, ec);
+  if (!success) {
+    EZLOGGERPRINT("Error: failed to defragment db '%s'.", name_.c_str());
+    OpenStore();
+    return false;
+  }
+  boost::filesystem::remove(old_file, ec);
+  return true;
 }
 
 bool TreeDb::Restore(const std::string& snapshot_file) {
   if (!loaded()) return false;
-  bool success = db_->load_snapshot(snapshot_file);
+  ++revision_;
+  UntrackedChange();
+  bool success = db_->LoadSnapshot(snapshot_file) &&
+      ApplySnapshotDelta(snapshot_file + ".delta");
   if (!success) {
     EZLOGGERPRINT("Error: failed to restore db from '%s'.",
                   snapshot_file.c_str());
@@ -139,6 +637,38 @@ bool TreeDb::Restore(const std::string& snapshot_file) {
   return success;
 }
 
+bool TreeDb::Rebuild(const std::string& snapshot_file) {
+  if (loaded()) return false;
+  // not to replace the file under one who has it open
+  DbFileLock lock(file_name());
+  if (!lock.locked()) {
+    EZLOGGERPRINT("Error: db '%s' is in use; not rebuilt.", name_.c_str());
+    return false;
+  }
+  std::string temp_file(file_name() + ".rebuild");
+  boost::system::error_code ec;
+  boost::filesystem::remove(temp_file, ec);
+  bool success = false;
+  {
+    scoped_ptr<DbStore> store(CreateStore(engine_));
+    success = store->Open(temp_file, false) &&
+        store->LoadSnapshot(snapshot_file);
+    store->Close();
+  }
+  if (success)
+    boost::filesystem::rename(temp_file, file_name(), ec);
+  if (!success || ec) {
+    EZLOGGERPRINT("Error: failed to rebuild db '%s' from '%s'.",
+                  name_.c_str(), snapshot_file.c_str());
+    boost::filesystem::remove(temp_file, ec);
+    return false;
+  }
+  // updates left in the journal belong to the replaced file
+  boost::filesystem::remove(journal_file_name(), ec);
+  ++revision_;
+  return true;
+}
+
 bool TreeDb::Exists() const {
   return boost::filesystem::exists(file_name());
 }
@@ -152,10 +682,21 @@ bool TreeDb::Remove() {
 }
 
 bool TreeDb::Open() {
-  if (loaded()) return false;
-  Initialize();
-  loaded_ = db_->open(file_name());
-  if (loaded_) {
+  if (loaded() || !Lock()) return false;
+  std::string conversion_file;
+  if (Exists() && DetectEngine(file_name()) != engine_) {
+    conversion_file = file_name() + ".convert";
+    if (!ConvertFromEngine(DetectEngine(file_name()), conversion_file)) {
+      lock_.reset();
+      return false;
+    }
+  }
+  if (OpenStore()) {
+    if (!conversion_file.empty() && !FinishConversion(conversion_file)) {
+      lock_.reset();
+      return false;
+    }
+    ReplayJournal(false);
     std::string db_name;
     if (!Fetch("\x01/db_name", &db_name))
       CreateMetadata();
@@ -169,19 +710,108 @@ bool TreeDb::Open() {
   return loaded_;
 }
 
+// opens the db file for writing, with the journal left as it is
+bool TreeDb::OpenStore() {
+  if (!Lock())
+    return false;
+  Initialize(engine_);
+  loaded_ = db_->Open(file_name(), false);
+  ++revision_;
+  read_only_ = false;
+  snapshot_synced_ = false;
+  if (!loaded_)
+    lock_.reset();
+  return loaded_;
+}
+
+bool TreeDb::IsInUse() const {
+  if (lock_)
+    return false;
+  DbFileLock lock(file_name());
+  return !lock.locked();
+}
+
+// keeps the db file from being written, or replaced, by others while it
+// is open for writing here
+bool TreeDb::Lock() {
+  if (lock_)
+    return true;
+  lock_.reset(new DbFileLock(file_name()));
+  if (!lock_->locked()) {
+    EZLOGGERPRINT("Error: db '%s' is in use by another process.",
+                  name_.c_str());
+    lock_.reset();
+    return false;
+  }
+  return true;
+}
+
 bool TreeDb::OpenReadOnly() {
   if (loaded()) return false;
-  Initialize();
-  loaded_ = db_->open(file_name(), kyotocabinet::TreeDB::OREADER);
-  if (!loaded_) {
+  // a db made by another engine is read as it is
+  Initialize(Exists() ? DetectEngine(file_name()) : engine_);
+  loaded_ = db_->Open(file_name(), true);
+  ++revision_;
+  read_only_ = true;
+  if (loaded_) {
+    // updates left in the journal are not yet in the db
+    ReplayJournal(true);
+  }
+  else {
     EZLOGGERPRINT("Error opening db '%s' read-only.", name_.c_str());
   }
   return loaded_;
 }
 
+// dumps the records of a db made by another engine, whose file is set aside
+bool TreeDb::ConvertFromEngine(const std::string &engine,
+                               const std::string &snapshot_file) {
+  EZLOGGERPRINT("converting db '%s' from %s to %s.",
+                name_.c_str(), engine.c_str(), engine_.c_str());
+  scoped_ptr<DbStore> store(CreateStore(engine));
+  bool success = store->Open(file_name(), true) &&
+      store->DumpSnapshot(snapshot_file);
+  store->Close();
+  boost::system::error_code ec;
+  if (success)
+    boost::filesystem::rename(file_name(), file_name() + ".old", ec);
+  if (!success || ec) {
+    EZLOGGERPRINT("Error: failed to convert db '%s'.", name_.c_str());
+    return false;
+  }
+  return true;
+}
+
+// loads the records of the db file set aside, which is put back should
+// that fail; the store is closed then.
+bool TreeDb::FinishConversion(const std::string &snapshot_file) {
+  boost::system::error_code ec;
+  if (db_->LoadSnapshot(snapshot_file)) {
+    boost::filesystem::remove(snapshot_file, ec);
+    return true;
+  }
+  EZLOGGERPRINT("Error: failed to convert db '%s'.", name_.c_str());
+  db_->Close();
+  loaded_ = false;
+  boost::filesystem::remove(file_name(), ec);
+  boost::filesystem::rename(file_name() + ".old", file_name(), ec);
+  if (ec) {
+    EZLOGGERPRINT("Error: the original file of db '%s' is kept in '%s'.",
+                  name_.c_str(), (file_name() + ".old").c_str());
+  }
+  boost::filesystem::remove(snapshot_file, ec);
+  return false;
+}
+
 bool TreeDb::Close() {
   if (!loaded()) return false;
-  db_->close();
+  FinishSnapshot(true);
+  Flush();
+  pending_.clear();
+  if (journal_.is_open())
+    journal_.close();
+  db_->Close();
+  lock_.reset();
   EZLOGGERPRINT("closed db '%s'.", name_.c_str());
   loaded_ = false;
   return true;
@@ -191,13 +821,15 @@ bool TreeDb::CreateMetadata() {
   EZLOGGERPRINT("Creating metadata for db '%s'.", name_.c_str());
   std::string rime_version(RIME_VERSION);
   // '\x01' is the meta character
-  return db_->set("\x01/db_name", name_) &&
-         db_->set("\x01/rime_version", rime_version);
+  return db_->Set("\x01/db_name", name_) &&
+         db_->Set("\x01/rime_version", rime_version);
 }
 
 // UserDb members
 
-UserDb::UserDb(const std::string &name) : TreeDb(name + ".userdb.kct") {
+UserDb::UserDb(const std::string &name)
+    : TreeDb(name + ".userdb.kct",
+             Service::instance().deployer().user_db_engine) {
 }
 
 bool UserDb::CreateMetadata() {
@@ -205,8 +837,9 @@ bool UserDb::CreateMetadata() {
   std::string user_id(deployer.user_id);
   // '\x01' is the meta character
   return TreeDb::CreateMetadata() &&
-      db_->set("\x01/db_type", "userdb") &&
-      db_->set("\x01/user_id", user_id);
+      db_->Set("\x01/db_type", "userdb") &&
+      db_->Set("\x01/user_id", user_id) &&
+      db_->Set("\x01/value_format", "packed");
 }
 
 }  // namespace rime
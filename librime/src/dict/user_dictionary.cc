@@ -6,11 +6,12 @@
 //
 // 2011-10-30 GONG Chen <chen.sst@gmail.com>
 //
+#include <cstring>
 #include <map>
 #include <algorithm>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
-#include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/scope_exit.hpp>
 #include <rime/common.h>
@@ -18,19 +19,85 @@
 #include <rime/schema.h>
 #include <rime/algo/dynamics.h>
 #include <rime/algo/syllabifier.h>
+#include <rime/dict/prefix_filter.h>
 #include <rime/dict/table.h>
 #include <rime/dict/user_db.h>
 #include <rime/dict/user_dictionary.h>
 
+namespace {
+
+// a packed record is made of a tag byte, which never starts a text record,
+// followed by int32 commit count, float dee and uint64 tick, little-endian.
+const char kPackedValuesTag = '\0';
+const size_t kPackedValuesLength = 1 + 4 + 4 + 8;
+
+inline void put_bytes(std::string *s, uint64_t x, int n) {
+  for (int i = 0; i < n; ++i, x >>= 8)
+    s->push_back(static_cast<char>(x & 0xff));
+}
+
+inline uint64_t get_bytes(const char *p, int n) {
+  uint64_t x = 0;
+  for (int i = n - 1; i >= 0; --i)
+    x = (x << 8) | static_cast<unsigned char>(p[i]);
+  return x;
+}
+
+}  // namespace
+
 namespace rime {
 
+// a decoded record of the user db
+struct UserDictRecord {
+  std::string text;
+  int commit_count;
+  double dee;
+  TickCount tick;
+};
+
+// records found in the user db for a code
+struct UserDictCacheNode {
+  std::vector<UserDictRecord> records;
+  bool has_longer_codes;
+};
+
+// user db lookups while typing a phrase query the same codes over again;
+// their records are kept here, until changed by UpdateEntry().
+struct UserDictCache {
+  typedef std::map<std::string, UserDictCacheNode> Nodes;
+  Nodes nodes;
+  // the db revision the cache reflects
+  uint64_t db_revision;
+
+  UserDictCache() : db_revision(0) {}
+  // drops cached records under the code, as well as its prefixes
+  void Invalidate(const std::string &code) {
+    if (!UserDbSyllabary::IsPackedKey(code)) {  // 'a b '
+      for (size_t n = code.find(' '); n != std::string::npos;
+           n = code.find(' ', n + 1)) {
+        nodes.erase(code.substr(0, n + 1));
+      }
+      return;
+    }
+    for (size_t n = UserDbSyllabary::kSyllableIdWidth;
+         n <= code.length(); n += UserDbSyllabary::kSyllableIdWidth) {
+      nodes.erase(code.substr(0, n));
+    }
+  }
+};
+
 struct DfsState {
   size_t depth_limit;
   TickCount present_tick;
   Code code;
   std::vector<double> credibility;
-  shared_ptr<UserDictEntryCollector> collector;
-  shared_ptr<UserDbAccessor> accessor;
+  UserDictEntryCollector *collector;
+  UserDictCache *cache;
+  const PrefixFilter *filter;
+  // whether spelled keys are looked up, rather than packed ones
+  bool spelled;
+  UserDb *db;
+  shared_ptr<UserDbAccessor> accessor;  // opened on the first cache miss
   std::string key;
   std::string value;
   
@@ -40,7 +107,11 @@ struct DfsState {
   bool IsPrefixMatch(const std::string &prefix) {
     return boost::starts_with(key, prefix);
   }
-  void SaveEntry(size_t pos);
+  bool IsBeyond(const std::string &prefix) {
+    return key > prefix && !IsPrefixMatch(prefix);
+  }
+  const UserDictCacheNode* ScanNode(const std::string &prefix);
+  void SaveEntry(size_t pos, const UserDictRecord &record);
   bool NextEntry() {
     if (!accessor->GetNextRecord(&key, &value)) {
       key.clear();
@@ -50,7 +121,9 @@ struct DfsState {
     return true;
   }
   bool ForwardScan(const std::string &prefix) {
-    if (!accessor->Forward(prefix)) {
+    if (!accessor)
+      accessor = db->Query("");
+    if (!accessor || !accessor->Forward(prefix)) {
       return false;
     }
     return NextEntry();
@@ -67,20 +140,39 @@ struct DfsState {
   }
 };
 
-void DfsState::SaveEntry(size_t pos) {
-  size_t seperator_pos = key.find('\t');
-  if (seperator_pos == std::string::npos)
-    return;
+// reads records for the code from the db into the cache; returns NULL
+// when the db has no more records from there on.
+const UserDictCacheNode* DfsState::ScanNode(const std::string &prefix) {
+  if (prefix > key) {  // 'a b c |d ' > 'a b c \tabracadabra'
+    EZDBGONLYLOGGERPRINT("forward scanning for '%s'.", prefix.c_str());
+    if (!ForwardScan(prefix))  // reached the end of db
+      return NULL;
+  }
+  UserDictCacheNode &node(cache->nodes[prefix]);
+  node.records.clear();
+  node.has_longer_codes = false;
+  UserDictRecord r;
+  while (IsExactMatch(prefix)) {  // 'b |e ' vs. 'b e \tBe'
+    r.text = key.substr(prefix.length() + 1);
+    r.commit_count = 0;
+    r.dee = 0.0;
+    r.tick = 0;
+    if (UserDictionary::UnpackValues(value, &r.commit_count, &r.dee, &r.tick) &&
+        r.commit_count >= 0)  // or a deleted entry
+      node.records.push_back(r);
+    if (!NextEntry())  // reached the end of db
+      return &node;
+  }
+  node.has_longer_codes = IsPrefixMatch(prefix);  // 'b |e ' vs. 'b e f \tBefore'
+  return &node;
+}
+
+void DfsState::SaveEntry(size_t pos, const UserDictRecord &record) {
   shared_ptr<DictEntry> e = make_shared<DictEntry>();
-  e->text = key.substr(seperator_pos + 1);
-  int commit_count = 0;
-  double dee = 0.0;
-  TickCount last_tick = 0;
-  if (!UserDictionary::UnpackValues(value, &commit_count, &dee, &last_tick))
-    return;
-  if (commit_count < 0)  // deleted entry
-    return;
-  dee = algo::formula_d(0, (double)present_tick, dee, (double)last_tick);
+  e->text = record.text;
+  int commit_count = record.commit_count;
+  double dee = algo::formula_d(0, (double)present_tick,
+                               record.dee, (double)record.tick);
   e->commit_count = commit_count;
   // TODO: argument s not defined...
   e->weight = algo::formula_p(0,
@@ -95,8 +187,10 @@ void DfsState::SaveEntry(size_t pos) {
 
 // UserDictionary members
 
-UserDictionary::UserDictionary(const shared_ptr<UserDb> &user_db)
-    : db_(user_db), tick_(0) {
+UserDictionary::UserDictionary(const shared_ptr<UserDb> &user_db,
+                               const shared_ptr<UserDictFilter> &prefix_filter)
+    : db_(user_db), prefix_filter_(prefix_filter), tick_(0),
+      cache_(new UserDictCache), packed_(false), has_spelled_keys_(false) {
 }
 
 UserDictionary::~UserDictionary() {
@@ -105,6 +199,11 @@ UserDictionary::~UserDictionary() {
 void UserDictionary::Attach(const shared_ptr<Table> &table, const shared_ptr<Prism> &prism) {
   table_ = table;
   prism_ = prism;
+  if (table_ && loaded()) {
+    LoadSyllabary();
+    if (prefix_filter_ && !prefix_filter_->ready())
+      prefix_filter_->Build(db_.get());
+  }
 }
 
 bool UserDictionary::Load() {
@@ -133,80 +232,200 @@ bool UserDictionary::loaded() const {
 void UserDictionary::DfsLookup(const SyllableGraph &syll_graph, size_t current_pos,
                                const std::string &current_prefix,
                                DfsState *state) {
-  SpellingIndices::const_iterator index = syll_graph.indices.find(current_pos);
-  if (index == syll_graph.indices.end()) {
+  size_t index_end = syll_graph.index_end(current_pos);
+  size_t k = syll_graph.index_begin(current_pos);
+  if (k == index_end) {
     return;
   }
   EZDBGONLYLOGGERPRINT("dfs lookup starts from %d.", current_pos);
   std::string prefix;
-  BOOST_FOREACH(const SpellingIndex::value_type& spelling, index->second) {
-    if (spelling.second.empty()) continue;
-    const SpellingProperties* props = spelling.second[0];
+  for (; k < index_end; ++k) {
+    const SyllableSpelling &spelling(syll_graph.indexed_spelling(k));
+    // take the longest one of spellings mapped to the same syllable
+    if (k > syll_graph.index_begin(current_pos) &&
+        syll_graph.indexed_spelling(k - 1).syllable_id == spelling.syllable_id)
+      continue;
+    const SpellingProperties* props = &spelling.properties;
     size_t end_pos = props->end_pos;
-    EZDBGONLYLOGGERPRINT("prefix: '%s', syll_id: %d, edge: [%d, %d) of %d",
-                         current_prefix.c_str(), spelling.first,
-                         current_pos, end_pos, spelling.second.size());
-    state->code.push_back(spelling.first);
+    EZDBGONLYLOGGERPRINT("prefix: '%s', syll_id: %d, edge: [%d, %d)",
+                         current_prefix.c_str(), spelling.syllable_id,
+                         current_pos, end_pos);
+    state->code.push_back(spelling.syllable_id);
     state->credibility.push_back(state->credibility.back() * props->credibility);
     BOOST_SCOPE_EXIT( (&state) ) {
       state->code.pop_back();
       state->credibility.pop_back();
     } BOOST_SCOPE_EXIT_END
-    if (!TranslateCodeToString(state->code, &prefix))
-      continue;
-    if (prefix > state->key) {  // 'a b c |d ' > 'a b c \tabracadabra'
-      EZDBGONLYLOGGERPRINT("forward scanning for '%s'.", prefix.c_str());
-      if (!state->ForwardScan(prefix))  // reached the end of db
-        return;
+    prefix = current_prefix;
+    if (state->spelled) {
+      const char *syllable = table_->GetSyllableById(spelling.syllable_id);
+      if (!syllable)
+        continue;
+      prefix += syllable;
+      prefix += ' ';
     }
-    while (state->IsExactMatch(prefix)) {  // 'b |e ' vs. 'b e \tBe'
-      EZDBGONLYLOGGERPRINT("match found for '%s'.", prefix.c_str());
-      state->SaveEntry(end_pos);
-      if (!state->NextEntry())  // reached the end of db
-        return;
+    else {
+      if (!PackSyllableId(spelling.syllable_id, &prefix))
+        continue;
+      // no need to seek in the db for codes no entry starts with
+      if (state->filter && !state->filter->MayContain(prefix))
+        continue;
+    }
+    const UserDictCacheNode *node = NULL;
+    UserDictCache::Nodes::const_iterator cached =
+        state->cache->nodes.find(prefix);
+    if (cached != state->cache->nodes.end()) {
+      node = &cached->second;
+    }
+    else if (!(node = state->ScanNode(prefix))) {  // reached the end of db
+      return;
+    }
+    BOOST_FOREACH(const UserDictRecord &r, node->records) {
+      EZDBGONLYLOGGERPRINT("match found for '%s'.", r.text.c_str());
+      state->SaveEntry(end_pos, r);
     }
     // the caller can limit the number of syllables to look up
     if ((!state->depth_limit || state->code.size() < state->depth_limit)
-        && state->IsPrefixMatch(prefix)) {  // 'b |e ' vs. 'b e f \tBefore'
+        && node->has_longer_codes) {
       DfsLookup(syll_graph, end_pos, prefix, state);
     }
-    if (!state->IsPrefixMatch(current_prefix))  // 'b |' vs. 'g o \tGo'
+    // the cursor may lag behind, having been spared by the cache
+    if (state->IsBeyond(current_prefix))  // 'b |' vs. 'g o \tGo'
       return;
     // 'b |e ' vs. 'b y \tBy'
   }
 }
 
+// spelled keys, which sort before packed ones, are looked up first; those
+// are found in a db yet to be packed by the deployment task.
+void UserDictionary::DfsLookupKeys(const SyllableGraph &syll_graph,
+                                   size_t start_pos,
+                                   DfsState *state) {
+  std::string prefix;
+  if (has_spelled_keys_) {
+    state->spelled = true;
+    DfsLookup(syll_graph, start_pos, prefix, state);
+  }
+  if (packed_) {
+    state->spelled = false;
+    DfsLookup(syll_graph, start_pos, prefix, state);
+  }
+}
+
 shared_ptr<UserDictEntryCollector> UserDictionary::Lookup(const SyllableGraph &syll_graph,
                                                           size_t start_pos,
                                                           size_t depth_limit,
                                                           double initial_credibility) {
-  if (!table_ || !prism_ || !loaded() ||
-      start_pos >= syll_graph.interpreted_length)
+  shared_ptr<UserDictEntryCollector> collector =
+      make_shared<UserDictEntryCollector>();
+  if (!Lookup(syll_graph, start_pos, depth_limit, initial_credibility,
+              collector.get()))
     return shared_ptr<UserDictEntryCollector>();
+  return collector;
+}
+
+bool UserDictionary::Lookup(const SyllableGraph &syll_graph,
+                            size_t start_pos,
+                            size_t depth_limit,
+                            double initial_credibility,
+                            UserDictEntryCollector *result) {
+  if (!result || !table_ || !prism_ || !loaded() ||
+      start_pos >= syll_graph.interpreted_length)
+    return false;
+  result->clear();
+  result->reserve(syll_graph.input_length + 1);
+  SyncCache();
   DfsState state;
   state.depth_limit = depth_limit;
-  FetchTickCount();
   state.present_tick = tick_ + 1;
   state.credibility.push_back(initial_credibility);
-  state.collector = make_shared<UserDictEntryCollector>();
-  state.accessor = db_->Query("");
-  state.accessor->Forward(" ");  // skip metadata
-  std::string prefix;
-  DfsLookup(syll_graph, start_pos, prefix, &state);
-  if (state.collector->empty())
-    return shared_ptr<UserDictEntryCollector>();
+  state.collector = result;
+  state.cache = cache_.get();
+  state.db = db_.get();
+  state.filter = GetPrefixFilter();
+  DfsLookupKeys(syll_graph, start_pos, &state);
+  if (result->empty())
+    return false;
   // sort each group of homophones by weight
-  BOOST_FOREACH(UserDictEntryCollector::value_type &v, *state.collector) {
+  BOOST_FOREACH(UserDictEntryCollector::value_type &v, *result) {
     v.second.Sort();
   }
-  return state.collector;
+  return true;
+}
+
+bool UserDictionary::Lookup(const SyllableGraph &syll_graph,
+                            size_t depth_limit,
+                            const std::vector<double> &initial_credibility,
+                            WordGraph *result) {
+  if (!result || !table_ || !prism_ || !loaded())
+    return false;
+  result->clear();
+  result->reserve(syll_graph.interpreted_length);
+  SyncCache();
+  DfsState state;
+  state.depth_limit = depth_limit;
+  state.present_tick = tick_ + 1;
+  state.cache = cache_.get();
+  state.db = db_.get();
+  state.filter = GetPrefixFilter();
+  for (size_t start_pos = 0; start_pos < syll_graph.interpreted_length;
+       ++start_pos) {
+    if (!syll_graph.num_edges(start_pos))
+      continue;
+    state.code.clear();
+    state.credibility.assign(1, start_pos < initial_credibility.size() ?
+                             initial_credibility[start_pos] : 1.0);
+    state.collector = &(*result)[start_pos];
+    state.collector->reserve(syll_graph.input_length + 1);
+    // a new search from the vertex; the cursor is positioned past the
+    // words of the last one, so it seeks the first prefix anew
+    state.key.clear();
+    state.value.clear();
+    DfsLookupKeys(syll_graph, start_pos, &state);
+    if (state.collector->empty()) {
+      result->erase(start_pos);
+      continue;
+    }
+    // sort each group of homophones by weight
+    BOOST_FOREACH(UserDictEntryCollector::value_type &v, *state.collector) {
+      v.second.Sort();
+    }
+  }
+  return !result->empty();
 }
 
 bool UserDictionary::UpdateEntry(const DictEntry &entry, int commit) {
-  std::string code_str;
-  if (!TranslateCodeToString(entry.code, &code_str))
+  if (!table_)
     return false;
-  std::string key(code_str + '\t' + entry.text);
+  std::string key;
+  bool packed = true;
+  BOOST_FOREACH(const int &syllable_id, entry.code) {
+    if (!PackSyllableId(syllable_id, &key)) {
+      packed = false;
+      break;
+    }
+  }
+  // a syllable missing from the syllabary the db is packed with is spelled
+  // out, as is every key of a db yet to be packed
+  if (!packed) {
+    key.clear();
+    BOOST_FOREACH(const int &syllable_id, entry.code) {
+      const char *syllable = table_->GetSyllableById(syllable_id);
+      if (!syllable)
+        return false;
+      key += syllable;
+      key += ' ';
+    }
+    has_spelled_keys_ = true;
+  }
+  // changes made elsewhere to the db, if any, are left to SyncCache()
+  bool cache_in_sync = cache_->db_revision == db_->revision();
+  cache_->Invalidate(key);
+  if (packed && prefix_filter_) {
+    prefix_filter_->Add(key);
+  }
+  key += '\t';
+  key += entry.text;
   std::string value;
   int commit_count = 0;
   double dee = 0.0;
@@ -229,15 +448,18 @@ bool UserDictionary::UpdateEntry(const DictEntry &entry, int commit) {
     commit_count = (std::min)(-1, -commit_count);
     dee = algo::formula_d(0.0, (double)tick_, dee, (double)last_tick);
   }
-  value = boost::str(boost::format("c=%1% d=%2% t=%3%") % 
-                     commit_count % dee % tick_);
-  return db_->Update(key, value);
+  bool ok = db_->Update(key, PackValues(commit_count, dee, tick_));
+  if (prefix_filter_ && prefix_filter_->full())
+    prefix_filter_->Build(db_.get());  // with room for more
+  if (cache_in_sync)
+    cache_->db_revision = db_->revision();
+  return ok;
 }
 
 bool UserDictionary::UpdateTickCount(TickCount increment) {
   tick_ += increment;
   if (tick_ % 50 == 0) {  // backup every 50 commits
-    db_->Backup();
+    db_->UpdateSnapshot();
   }
   try {
     return db_->Update("\x01/tick", boost::lexical_cast<std::string>(tick_));
@@ -247,6 +469,28 @@ bool UserDictionary::UpdateTickCount(TickCount increment) {
   }
 }
 
+// the filter is consulted once it has been built
+const PrefixFilter* UserDictionary::GetPrefixFilter() {
+  if (!prefix_filter_)
+    return NULL;
+  prefix_filter_->FinishBuilding(false);
+  return prefix_filter_->filter();
+}
+
+// the cache, as well as the tick count, is refreshed if the db has been
+// changed since, e.g. by another session sharing it
+void UserDictionary::SyncCache() {
+  const size_t kMaxCachedNodes = 10000;
+  if (cache_->db_revision != db_->revision() ||
+      cache_->nodes.size() > kMaxCachedNodes) {
+    cache_->nodes.clear();
+    FetchTickCount();
+    // as some may have been written by another
+    has_spelled_keys_ = HasSpelledKeys();
+    cache_->db_revision = db_->revision();
+  }
+}
+
 bool UserDictionary::Initialize() {
   return db_->Update("\x01/tick", "0");
 }
@@ -267,26 +511,111 @@ bool UserDictionary::FetchTickCount() {
   }
 }
 
-bool UserDictionary::TranslateCodeToString(const Code &code, std::string* result) {
-  if (!table_ || !result) return false;
-  result->clear();
-  BOOST_FOREACH(const int &syllable_id, code) {
-    const char *spelling = table_->GetSyllableById(syllable_id);
-    if (!spelling) {
-      EZLOGGERPRINT("Error translating syllable_id '%d' to string.", syllable_id);
-      result->clear();
-      return false;
+static const std::string MergeValues(const std::string &left,
+                                     const std::string &right) {
+  int c = 0, c0 = 0;
+  double d = 0.0, d0 = 0.0;
+  TickCount t = 0, t0 = 0;
+  UserDictionary::UnpackValues(left, &c, &d, &t);
+  UserDictionary::UnpackValues(right, &c0, &d0, &t0);
+  return UserDictionary::PackValues((std::max)(c, c0),
+                                    (std::max)(d, d0),
+                                    (std::max)(t, t0));
+}
+
+// keys are packed with syllable ids of the attached table.  the ids change
+// when the table is rebuilt with a different syllabary, then the keys are
+// repacked by a deployment task; until then, ids of the table are mapped to
+// those the db is packed with.
+bool UserDictionary::LoadSyllabary() {
+  syllable_ids_.clear();
+  packed_ = false;
+  has_spelled_keys_ = HasSpelledKeys();
+  Syllabary syllabary;
+  if (!table_->GetSyllabary(&syllabary))
+    return false;
+  UserDbSyllabary current;
+  current.Assign(syllabary);
+  UserDbSyllabary saved;
+  if (!saved.Load(db_.get())) {
+    // the keys written by an earlier version are spelled; the db is left
+    // unpacked until the deployment task packs them all
+    if (has_spelled_keys_) {
+      EZLOGGERPRINT("user dict '%s' is yet to be packed.",
+                    db_->name().c_str());
+      return true;
     }
-    *result += spelling;
-    *result += ' ';
+    packed_ = current.Save(db_.get());
+    return packed_;
+  }
+  packed_ = true;
+  if (saved == current)
+    return true;
+  EZLOGGERPRINT("user dict '%s' is yet to be repacked.",
+                db_->name().c_str());
+  syllable_ids_.reserve(syllabary.size());
+  BOOST_FOREACH(const std::string &s, syllabary) {
+    syllable_ids_.push_back(saved.GetSyllableId(s));
   }
   return true;
 }
 
+// whether the db has spelled keys, which are left to be packed
+bool UserDictionary::HasSpelledKeys() {
+  shared_ptr<UserDbAccessor> a = db_->Query("");
+  if (!a || !a->Forward(" "))  // skip metadata
+    return false;
+  std::string key, value;
+  return a->GetNextRecord(&key, &value) &&
+      !UserDbSyllabary::IsPackedKey(key);
+}
+
+// appends a syllable id of the table to the key, as the db is packed
+bool UserDictionary::PackSyllableId(int syllable_id, std::string *key) const {
+  if (!packed_)
+    return false;
+  if (!syllable_ids_.empty()) {
+    if (syllable_id < 0 ||
+        syllable_id >= static_cast<int>(syllable_ids_.size()) ||
+        syllable_ids_[syllable_id] < 0)
+      return false;
+    syllable_id = syllable_ids_[syllable_id];
+  }
+  return UserDbSyllabary::PackSyllableId(syllable_id, key);
+}
+
+const std::string UserDictionary::PackValues(int commit_count,
+                                            double dee,
+                                            TickCount tick) {
+  std::string value;
+  value.reserve(kPackedValuesLength);
+  value.push_back(kPackedValuesTag);
+  put_bytes(&value, static_cast<uint32_t>(commit_count), 4);
+  float d = static_cast<float>(dee);
+  uint32_t d_bits = 0;
+  std::memcpy(&d_bits, &d, sizeof(d_bits));
+  put_bytes(&value, d_bits, 4);
+  put_bytes(&value, tick, 8);
+  return value;
+}
+
 bool UserDictionary::UnpackValues(const std::string &value,
                                   int *commit_count,
                                   double *dee,
                                   TickCount *tick) {
+  if (value.length() == kPackedValuesLength &&
+      value[0] == kPackedValuesTag) {
+    const char *p = value.data() + 1;
+    *commit_count = static_cast<int32_t>(
+        static_cast<uint32_t>(get_bytes(p, 4)));
+    uint32_t d_bits = static_cast<uint32_t>(get_bytes(p + 4, 4));
+    float d = 0.0f;
+    std::memcpy(&d, &d_bits, sizeof(d));
+    *dee = d;
+    *tick = get_bytes(p + 8, 8);
+    return true;
+  }
+  // a text record written by an earlier version: "c=%1% d=%2% t=%3%"
   std::vector<std::string> kv;
   boost::split(kv, value, boost::is_any_of(" "));
   BOOST_FOREACH(const std::string &k_eq_v, kv) {
@@ -314,6 +643,237 @@ bool UserDictionary::UnpackValues(const std::string &value,
   return true;
 }
 
+// UserDbSyllabary members
+
+const size_t UserDbSyllabary::kSyllableIdWidth;
+const int UserDbSyllabary::kMaxSyllableId;
+
+void UserDbSyllabary::Assign(const Syllabary &syllabary) {
+  // a syllable id is its index in alphabetical order
+  syllables_.assign(syllabary.begin(), syllabary.end());
+  syllable_ids_.clear();
+  for (size_t i = 0; i < syllables_.size(); ++i)
+    syllable_ids_[syllables_[i]] = static_cast<int>(i);
+}
+
+bool UserDbSyllabary::Load(UserDb *db) {
+  std::string value;
+  if (!db || !db->Fetch("\x01/syllabary", &value))
+    return false;
+  Syllabary syllabary;
+  std::vector<std::string> syllables;
+  boost::split(syllables, value, boost::is_any_of(" "),
+               boost::token_compress_on);
+  BOOST_FOREACH(const std::string &s, syllables) {
+    if (!s.empty())
+      syllabary.insert(s);
+  }
+  Assign(syllabary);
+  return true;
+}
+
+bool UserDbSyllabary::Save(UserDb *db) const {
+  if (!db)
+    return false;
+  return db->Update("\x01/syllabary", boost::join(syllables_, " "));
+}
+
+bool UserDbSyllabary::PackKey(const std::string &spelled_key,
+                              std::string *packed_key) const {
+  size_t tab_pos = spelled_key.find('\t');
+  if (!packed_key || tab_pos == 0 || tab_pos == std::string::npos)
+    return false;
+  packed_key->clear();
+  const std::string code_str(spelled_key.substr(0, tab_pos));
+  std::vector<std::string> syllables;
+  boost::split(syllables, code_str,
+               boost::is_any_of(" "), boost::token_compress_on);
+  BOOST_FOREACH(const std::string &s, syllables) {
+    if (s.empty())
+      continue;
+    std::map<std::string, int>::const_iterator it = syllable_ids_.find(s);
+    if (it == syllable_ids_.end() || !PackSyllableId(it->second, packed_key))
+      return false;
+  }
+  if (packed_key->empty())
+    return false;
+  packed_key->append(spelled_key, tab_pos, std::string::npos);
+  return true;
+}
+
+bool UserDbSyllabary::SpellKey(const std::string &packed_key,
+                               std::string *spelled_key) const {
+  if (!spelled_key)
+    return false;
+  spelled_key->clear();
+  size_t i = 0;
+  for (; i + kSyllableIdWidth <= packed_key.length() &&
+           packed_key[i] != '\t'; i += kSyllableIdWidth) {
+    unsigned char high = static_cast<unsigned char>(packed_key[i]);
+    unsigned char low = static_cast<unsigned char>(packed_key[i + 1]);
+    if (!(high & 0x80) || !(low & 0x80))
+      return false;
+    size_t syllable_id = ((high & 0x7f) << 7) | (low & 0x7f);
+    if (syllable_id >= syllables_.size())
+      return false;
+    *spelled_key += syllables_[syllable_id];
+    *spelled_key += ' ';
+  }
+  if (i == 0 || i >= packed_key.length() || packed_key[i] != '\t')
+    return false;
+  spelled_key->append(packed_key, i, std::string::npos);
+  return true;
+}
+
+int UserDbSyllabary::GetSyllableId(const std::string &syllable) const {
+  std::map<std::string, int>::const_iterator it = syllable_ids_.find(syllable);
+  return it != syllable_ids_.end() ? it->second : -1;
+}
+
+bool UserDbSyllabary::Repack(UserDb *db) const {
+  if (!db)
+    return false;
+  UserDbSyllabary saved;
+  saved.Load(db);
+  bool repack = !saved.empty() && saved != *this;
+  typedef std::pair<std::string, std::string> Record;
+  std::vector<Record> records;
+  std::vector<std::string> outdated_keys;
+  std::string key, value, spelled_key;
+  shared_ptr<UserDbAccessor> a = db->Query("");
+  if (!a)
+    return false;
+  a->Forward(" ");  // skip metadata
+  while (a->GetNextRecord(&key, &value)) {
+    if (IsPackedKey(key)) {
+      if (!repack)
+        break;
+      if (!saved.SpellKey(key, &spelled_key))
+        continue;
+      outdated_keys.push_back(key);
+      key = spelled_key;
+    }
+    records.push_back(std::make_pair(key, value));
+  }
+  a.reset();
+  // all the keys to be repacked are erased before any is written
+  BOOST_FOREACH(const std::string &k, outdated_keys) {
+    db->Erase(k);
+  }
+  int num_packed = 0;
+  std::string packed_key;
+  BOOST_FOREACH(const Record &r, records) {
+    if (!PackKey(r.first, &packed_key)) {
+      db->Update(r.first, r.second);  // keep it spelled
+      continue;
+    }
+    if (db->Fetch(packed_key, &value))
+      value = MergeValues(value, r.second);
+    else
+      value = r.second;
+    if (db->Update(packed_key, value)) {
+      db->Erase(r.first);
+      ++num_packed;
+    }
+  }
+  if (num_packed > 0) {
+    EZLOGGERPRINT("packed %d keys in user dict '%s'.",
+                  num_packed, db->name().c_str());
+  }
+  return saved == *this || Save(db);
+}
+
+bool UserDbSyllabary::PackSyllableId(int syllable_id, std::string *key) {
+  if (syllable_id < 0 || syllable_id > kMaxSyllableId) {
+    EZLOGGERPRINT("Error packing syllable_id '%d'.", syllable_id);
+    return false;
+  }
+  key->push_back(static_cast<char>(0x80 | (syllable_id >> 7)));
+  key->push_back(static_cast<char>(0x80 | (syllable_id & 0x7f)));
+  return true;
+}
+
+bool UserDbSyllabary::IsPackedKey(const std::string &key) {
+  return !key.empty() && (static_cast<unsigned char>(key[0]) & 0x80);
+}
+
+// UserDictFilter members
+
+UserDictFilter::UserDictFilter(size_t max_depth) : max_depth_(max_depth) {
+}
+
+UserDictFilter::~UserDictFilter() {
+  if (thread_.joinable()) {
+    thread_.interrupt();
+    thread_.join();
+  }
+}
+
+void UserDictFilter::Build(UserDb *db) {
+  if (!db || thread_.joinable())
+    return;
+  // pending updates are left out of the scan, so they are stored first
+  db->Flush();
+  shared_ptr<TreeDbAccessor> accessor = db->QueryStored("");
+  if (!accessor)
+    return;
+  EZLOGGERPRINT("building prefix filter for user dict '%s'.",
+                db->name().c_str());
+  boost::thread t(boost::bind(&UserDictFilter::Scan, this, accessor));
+  thread_.swap(t);
+}
+
+// collects codes of all packed keys in the db, in a background thread
+void UserDictFilter::Scan(shared_ptr<TreeDbAccessor> accessor) {
+  std::vector<std::string> codes;
+  std::string key, value;
+  accessor->Forward("\x80");  // skip metadata and spelled keys
+  while (accessor->GetNextRecord(&key, &value)) {
+    boost::this_thread::interruption_point();
+    size_t tab_pos = key.find('\t');
+    if (tab_pos == std::string::npos)
+      continue;
+    key.resize(tab_pos);
+    if (codes.empty() || codes.back() != key)
+      codes.push_back(key);
+  }
+  built_.reset(new PrefixFilter(UserDbSyllabary::kSyllableIdWidth,
+                                max_depth_));
+  built_->Reset(codes.size());
+  BOOST_FOREACH(const std::string &code, codes) {
+    built_->Add(code);
+  }
+}
+
+bool UserDictFilter::FinishBuilding(bool wait) {
+  if (!thread_.joinable())
+    return true;
+  if (wait)
+    thread_.join();
+  else if (!thread_.timed_join(boost::posix_time::milliseconds(0)))
+    return false;
+  if (built_) {
+    BOOST_FOREACH(const std::string &code, added_codes_) {
+      built_->Add(code);
+    }
+    filter_.swap(built_);
+    built_.reset();
+  }
+  added_codes_.clear();
+  return true;
+}
+
+void UserDictFilter::Add(const std::string &code) {
+  if (filter_)
+    filter_->Add(code);
+  if (thread_.joinable())
+    added_codes_.push_back(code);
+}
+
+bool UserDictFilter::full() const {
+  return filter_ && filter_->full();
+}
+
 // UserDictionaryComponent members
 
 UserDictionaryComponent::UserDictionaryComponent() {
@@ -336,9 +896,21 @@ UserDictionary* UserDictionaryComponent::Create(Schema *schema) {
   shared_ptr<UserDb> db(db_pool_[dict_name].lock());
   if (!db) {
     db = boost::make_shared<UserDb>(dict_name);
+    // commits are written behind, not to stall the typing
+    db->EnableWriteBehind();
     db_pool_[dict_name] = db;
   }
-  return new UserDictionary(db);
+  // shared by user dicts on the same db, so as to see each other's updates
+  shared_ptr<UserDictFilter> prefix_filter(filter_pool_[dict_name].lock());
+  if (!prefix_filter) {
+    int filter_depth = 3;
+    config->GetInt("translator/user_dict_filter_depth", &filter_depth);
+    if (filter_depth > 0) {
+      prefix_filter = boost::make_shared<UserDictFilter>(filter_depth);
+      filter_pool_[dict_name] = prefix_filter;
+    }
+  }
+  return new UserDictionary(db, prefix_filter);
 }
 
 }  // namespace rime
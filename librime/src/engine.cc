@@ -24,6 +24,7 @@
 #include <rime/segmentor.h>
 #include <rime/translation.h>
 #include <rime/translator.h>
+#include <rime/algo/syllabifier.h>
 
 namespace rime {
 
@@ -163,6 +164,7 @@ void ConcreteEngine::TranslateSegments(Composition *comp) {
     const std::string input(comp->input().substr(segment.start, len));
     EZDBGONLYLOGGERPRINT("Translating segment '%s'", input.c_str());
     shared_ptr<Menu> menu = boost::make_shared<Menu>(filter);
+    segment.syllable_graphs = boost::make_shared<SyllableGraphCache>();
     BOOST_FOREACH(shared_ptr<Translator>& translator, translators_) {
       shared_ptr<Translation> translation =
           translator->Query(input, segment, &segment.prompt);
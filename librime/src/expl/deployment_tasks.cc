@@ -8,14 +8,20 @@
 //
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/uuid/random_generator.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <rime_version.h>
 #include <rime/common.h>
 #include <rime/config.h>
+#include <rime/dict/bigram_model.h>
 #include <rime/dict/dictionary.h>
 #include <rime/dict/dict_compiler.h>
+#include <rime/dict/preset_vocabulary.h>
+#include <rime/dict/user_db.h>
+#include <rime/dict/user_dictionary.h>
 #include <rime/expl/customizer.h>
 #include <rime/expl/deployment_tasks.h>
 #include <rime/expl/user_dict_manager.h>
@@ -52,6 +58,9 @@ bool InstallationUpdate::Run(Deployer* deployer) {
     if (config.GetString("rime_version", &last_rime_version)) {
       EZLOGGERPRINT("previous Rime version: %s", last_rime_version.c_str());
     }
+    if (config.GetString("user_db_engine", &deployer->user_db_engine)) {
+      EZLOGGERPRINT("user db engine: %s", deployer->user_db_engine.c_str());
+    }
   }
   if (!installation_id.empty() &&
       last_distro_code_name == deployer->distribution_code_name &&
@@ -104,6 +113,8 @@ bool WorkspaceUpdate::Run(Deployer* deployer) {
     t->Run(deployer);
     t.reset(new SymlinkingPrebuiltDictionaries);
     t->Run(deployer);
+    t.reset(new BigramModelUpdate);
+    t->Run(deployer);
   }
 
   fs::path shared_data_path(deployer->shared_data_dir);
@@ -300,4 +311,121 @@ bool UserDictUpgration::Run(Deployer* deployer) {
   return ok;
 }
 
+bool UserDictCompaction::Run(Deployer* deployer) {
+  // a word never committed falls below this some 2500 commits after
+  // it was last seen in a sentence
+  const double kDefaultMinWeight = 1e-9;
+  // the db is rewritten as a whole, which is only worth it for so many
+  const double kDefaultMinDeadRatio = 0.2;
+  double min_weight = kDefaultMinWeight;
+  double min_dead_ratio = kDefaultMinDeadRatio;
+  {
+    Config config;
+    fs::path user_data_path(deployer->user_data_dir);
+    if (config.LoadFromFile((user_data_path / "default.yaml").string())) {
+      config.GetDouble("user_dict_compaction/min_weight", &min_weight);
+      config.GetDouble("user_dict_compaction/min_dead_ratio",
+                       &min_dead_ratio);
+    }
+  }
+  UserDictManager manager(deployer);
+  UserDictList dicts;
+  manager.GetUserDictList(&dicts);
+  bool ok = true;
+  BOOST_FOREACH(const std::string &dict_name, dicts) {
+    if (manager.CompactUserDict(dict_name, min_weight,
+                                min_dead_ratio) < 0) {
+      EZLOGGERPRINT("Error compacting user dict '%s'.", dict_name.c_str());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool BigramModelUpdate::Run(Deployer* deployer) {
+  const size_t kDefaultMaxPairs = 1 << 17;
+  fs::path essay_path(PresetVocabulary::file_name());
+  fs::path user_data_path(deployer->user_data_dir);
+  fs::path model_path(user_data_path / "essay.bigram.bin");
+  if (!fs::exists(essay_path)) {
+    EZLOGGERPRINT("no essay; skipped building bigram model.");
+    return true;
+  }
+  int max_pairs = kDefaultMaxPairs;
+  bool learn_from_user_history = false;
+  {
+    Config config;
+    if (config.LoadFromFile((user_data_path / "default.yaml").string())) {
+      config.GetInt("bigram_model/max_pairs", &max_pairs);
+      config.GetBool("bigram_model/learn_from_user_history",
+                     &learn_from_user_history);
+    }
+  }
+  // a model mixed with user history is rebuilt on each deployment
+  uint32_t essay_checksum = dictionary::checksum(essay_path.string());
+  uint32_t source_checksum = learn_from_user_history ? 0 : essay_checksum;
+  BigramModel model(model_path.string());
+  if (source_checksum && fs::exists(model_path) && model.Load() &&
+      model.source_checksum() == source_checksum) {
+    return true;
+  }
+  model.Close();
+  scoped_ptr<PresetVocabulary> essay(PresetVocabulary::Create());
+  if (!essay) {
+    EZLOGGERPRINT("Error opening essay '%s'.", essay_path.string().c_str());
+    return false;
+  }
+  EZLOGGERPRINT("building bigram model...");
+  BigramCollector collector;
+  std::string phrase, weight_str;
+  essay->Reset();
+  while (essay->GetNextEntry(&phrase, &weight_str)) {
+    double weight = 0.0;
+    try {
+      weight = boost::lexical_cast<double>(weight_str);
+    }
+    catch (...) {
+      continue;
+    }
+    collector.AddWord(phrase, weight);
+  }
+  if (learn_from_user_history) {
+    // a commit counts as much as an average word of the essay
+    double scale = collector.average_weight();
+    UserDictManager manager(deployer);
+    UserDictList dicts;
+    manager.GetUserDictList(&dicts);
+    BOOST_FOREACH(const std::string &dict_name, dicts) {
+      UserDb db(dict_name);
+      if (!db.OpenReadOnly())
+        continue;
+      std::string key, value;
+      shared_ptr<UserDbAccessor> a = db.Query("");
+      while (a->GetNextRecord(&key, &value)) {
+        if (boost::starts_with(key, "\x01/"))  // skip metadata
+          continue;
+        size_t sep = key.find('\t');
+        if (sep == std::string::npos)
+          continue;
+        int c = 0;
+        double d = 0.0;
+        TickCount t = 0;
+        if (!UserDictionary::UnpackValues(value, &c, &d, &t) || c <= 0)
+          continue;
+        collector.AddPhrase(key.substr(sep + 1), c * scale);
+      }
+      db.Close();
+    }
+  }
+  bigram::Records records;
+  collector.Collect(static_cast<size_t>(max_pairs), &records);
+  model.Remove();
+  if (!model.Build(records, source_checksum) || !model.Save()) {
+    EZLOGGERPRINT("Error building bigram model.");
+    return false;
+  }
+  EZLOGGERPRINT("bigram model is ready.");
+  return true;
+}
+
 }  // namespace rime
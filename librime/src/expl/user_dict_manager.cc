@@ -7,13 +7,16 @@
 // 2012-03-23 GONG Chen <chen.sst@gmail.com>
 //
 #include <fstream>
+#include <map>
 #include <boost/algorithm/string.hpp>
-#include <boost/format.hpp>
+#include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/scope_exit.hpp>
 #include <rime/common.h>
 #include <rime/deployer.h>
 #include <rime/algo/dynamics.h>
+#include <rime/dict/sorted_store.h>
+#include <rime/dict/table.h>
 #include <rime/dict/user_db.h>
 #include <rime/dict/user_dictionary.h>
 #include <rime/expl/user_dict_manager.h>
@@ -42,6 +45,12 @@ static const std::string GetUserId(UserDb& db) {
   return user_id;
 }
 
+static bool HasPackedValues(UserDb& db) {
+  std::string value_format;
+  return db.Fetch("\x01/value_format", &value_format) &&
+      value_format == "packed";
+}
+
 static TickCount GetTickCount(UserDb& db) {
   std::string tick;
   if (db.Fetch("\x01/tick", &tick)) {
@@ -54,6 +63,180 @@ static TickCount GetTickCount(UserDb& db) {
   return 1;
 }
 
+// the records of a user db merged with updates to some of its keys, in a
+// single pass over both in key order. read as a cursor, the merged records
+// are bulk loaded into a new db file in place of the Fetch() and Update()
+// of each key.
+template <class T>
+class UserDbMerge : public DbCursor {
+ public:
+  typedef std::map<std::string, T> Updates;
+
+  UserDbMerge(UserDb *db, const Updates &updates)
+      : db_(db), updates_(updates), in_db_(false), valid_(false) {}
+  virtual ~UserDbMerge() {}
+
+  virtual bool Jump(const std::string &key) {
+    accessor_ = db_->Query("");
+    if (!accessor_)
+      return valid_ = false;
+    if (!key.empty())
+      accessor_->Forward(key);
+    in_db_ = accessor_->GetNextRecord(&db_key_, &db_value_);
+    pos_ = updates_.lower_bound(key);
+    return Settle();
+  }
+  // not needed for bulk loading
+  virtual bool JumpBack(const std::string &key) { return false; }
+  virtual bool GetKey(std::string *key) {
+    if (!valid_ || !key)
+      return false;
+    *key = key_;
+    return true;
+  }
+  virtual bool Get(std::string *key, std::string *value) {
+    if (!valid_ || !key || !value)
+      return false;
+    *key = key_;
+    *value = value_;
+    return true;
+  }
+  virtual bool Step() {
+    if (!valid_)
+      return false;
+    if (in_db_ && db_key_ == key_)
+      in_db_ = accessor_->GetNextRecord(&db_key_, &db_value_);
+    if (pos_ != updates_.end() && pos_->first == key_)
+      ++pos_;
+    return Settle();
+  }
+
+ protected:
+  // combines the value in the db, if any, with an update of the same key
+  virtual const std::string Merge(const std::string *db_value,
+                                  const T &update) = 0;
+
+ private:
+  // takes the lesser key of the two sides
+  bool Settle() {
+    bool has_update = pos_ != updates_.end();
+    if (!in_db_ && !has_update)
+      return valid_ = false;
+    if (has_update && (!in_db_ || pos_->first <= db_key_)) {
+      key_ = pos_->first;
+      bool both = in_db_ && db_key_ == key_;
+      value_ = Merge(both ? &db_value_ : NULL, pos_->second);
+    }
+    else {
+      key_ = db_key_;
+      value_ = db_value_;
+    }
+    return valid_ = true;
+  }
+
+  UserDb *db_;
+  const Updates &updates_;
+  shared_ptr<UserDbAccessor> accessor_;
+  bool in_db_;
+  std::string db_key_;
+  std::string db_value_;
+  typename Updates::const_iterator pos_;
+  bool valid_;
+  std::string key_;
+  std::string value_;
+};
+
+// an entry from a snapshot, its weight decayed to the snapshot's tick
+struct SnapshotEntry {
+  int commits;
+  double dee;
+
+  SnapshotEntry(int c, double d) : commits(c), dee(d) {}
+};
+
+class SnapshotMerge : public UserDbMerge<SnapshotEntry> {
+ public:
+  SnapshotMerge(UserDb *db, const Updates &updates, TickCount tick)
+      : UserDbMerge<SnapshotEntry>(db, updates), tick_(tick) {}
+
+ protected:
+  virtual const std::string Merge(const std::string *db_value,
+                                  const SnapshotEntry &update) {
+    int c = update.commits;
+    double d = update.dee;
+    if (db_value) {
+      int c0 = 0;
+      double d0 = 0.0;
+      TickCount t0 = 0;
+      UserDictionary::UnpackValues(*db_value, &c0, &d0, &t0);
+      if (t0 < tick_)
+        d0 = algo::formula_d(0, (double)tick_, d0, (double)t0);
+      c = (std::max)(c, c0);
+      d = (std::max)(d, d0);
+    }
+    return UserDictionary::PackValues(c, d, tick_);
+  }
+
+ private:
+  TickCount tick_;
+};
+
+// what the lines of an import file do to the commit count of an entry
+struct ImportedEntry {
+  // the count is reset by the last negative one, then raised by others
+  bool deleted;
+  int commits;
+
+  ImportedEntry() : deleted(false), commits(0) {}
+  void Add(int n) {
+    if (n < 0) {
+      deleted = true;
+      commits = n;
+    }
+    else {
+      commits = (std::max)(commits, n);
+    }
+  }
+  int Apply(int c) const {
+    if (deleted)
+      return commits;
+    return commits > 0 ? (std::max)(commits, c) : c;
+  }
+};
+
+class ImportMerge : public UserDbMerge<ImportedEntry> {
+ public:
+  ImportMerge(UserDb *db, const Updates &updates)
+      : UserDbMerge<ImportedEntry>(db, updates) {}
+
+ protected:
+  virtual const std::string Merge(const std::string *db_value,
+                                  const ImportedEntry &update) {
+    int c = 0;
+    double d = 0.0;
+    TickCount t = 0;
+    if (db_value)
+      UserDictionary::UnpackValues(*db_value, &c, &d, &t);
+    return UserDictionary::PackValues(update.Apply(c), d, t);
+  }
+};
+
+// the merged records are written to a sorted table, which is then bulk
+// loaded into a new db file to replace the user db
+static bool RebuildUserDb(UserDb *db, DbCursor *merged) {
+  std::string merged_file(db->file_name() + ".merged");
+  bool success = false;
+  {
+    SortedTable table(merged_file);
+    success = table.Build(merged, 0) && table.Save();
+  }
+  db->Close();
+  success = success && db->Rebuild(merged_file);
+  boost::system::error_code ec;
+  fs::remove(merged_file, ec);
+  return success;
+}
+
 UserDictManager::UserDictManager(Deployer* deployer)
     : deployer_(deployer) {
   if (deployer) {
@@ -121,12 +304,23 @@ bool UserDictManager::Restore(const std::string& snapshot_file) {
   TickCount tick_left = GetTickCount(dest);
   TickCount tick_right = GetTickCount(temp);
   tick_left = (std::max)(tick_left, tick_right);
+  // keys are translated via the string form, as the syllabaries may differ;
+  // the entries are then sorted in the key order of the user dict
+  UserDbSyllabary syllabary_left, syllabary_right;
+  syllabary_left.Load(&dest);
+  syllabary_right.Load(&temp);
+  SnapshotMerge::Updates updates;
   shared_ptr<TreeDbAccessor> a = temp.Query("");
-  std::string key, left, right;
+  std::string key, dest_key, right;
   int num_entries = 0;
   while (a->GetNextRecord(&key, &right)) {
     if (boost::starts_with(key, "\x01/"))  // skip metadata
       continue;
+    if (UserDbSyllabary::IsPackedKey(key)) {
+      if (!syllabary_right.SpellKey(key, &dest_key))
+        continue;
+      key.swap(dest_key);
+    }
     size_t tab_pos = key.find('\t');
     if (tab_pos == 0 || tab_pos == std::string::npos)
       continue;
@@ -139,20 +333,15 @@ bool UserDictManager::Restore(const std::string& snapshot_file) {
     UserDictionary::UnpackValues(right, &c, &d, &t);
     if (t < tick_right)
       d = algo::formula_d(0, (double)tick_right, d, (double)t);
-    if (dest.Fetch(key, &left)) {
-      int c0 = 0;
-      double d0 = 0.0;
-      TickCount t0 = 0;
-      UserDictionary::UnpackValues(left, &c0, &d0, &t0);
-      if (t0 < tick_left)
-        d0 = algo::formula_d(0, (double)tick_left, d0, (double)t0);
-      c = (std::max)(c, c0);
-      d = (std::max)(d, d0);
+    if (!syllabary_left.PackKey(key, &dest_key))
+      dest_key = key;  // to be packed once the user dict is loaded
+    std::pair<SnapshotMerge::Updates::iterator, bool> r =
+        updates.insert(std::make_pair(dest_key, SnapshotEntry(c, d)));
+    if (!r.second) {  // spelled differently in the snapshot
+      r.first->second.commits = (std::max)(r.first->second.commits, c);
+      r.first->second.dee = (std::max)(r.first->second.dee, d);
     }
-    right = boost::str(boost::format("c=%1% d=%2% t=%3%") % 
-                       c % d % tick_left);
-    if (dest.Update(key, right))
-      ++num_entries;
+    ++num_entries;
   }
   if (num_entries > 0) {
     try {
@@ -163,6 +352,9 @@ bool UserDictManager::Restore(const std::string& snapshot_file) {
       EZLOGGERPRINT("Warning: failed to update tick count.");
     }
   }
+  SnapshotMerge merge(&dest, updates, tick_left);
+  if (!updates.empty() && !RebuildUserDb(&dest, &merge))
+    return false;
   EZLOGGERPRINT("total %d entries imported, tick = %d.",
                 num_entries, tick_left);
   return true;
@@ -185,13 +377,20 @@ int UserDictManager::Export(const std::string& dict_name,
        << "# user_id: " << GetUserId(db) << std::endl
        << "# commits: " << GetTickCount(db) << std::endl
        << std::endl;
-  std::string key, value;
+  UserDbSyllabary syllabary;
+  syllabary.Load(&db);
+  std::string key, spelled_key, value;
   std::vector<std::string> row;
   int num_entries = 0;
   shared_ptr<UserDbAccessor> a = db.Query("");
   while (a->GetNextRecord(&key, &value)) {
     if (boost::starts_with(key, "\x01/"))  // skip metadata
       continue;
+    if (UserDbSyllabary::IsPackedKey(key)) {
+      if (!syllabary.SpellKey(key, &spelled_key))
+        continue;
+      key.swap(spelled_key);
+    }
     boost::algorithm::split(row, key,
                             boost::algorithm::is_any_of("\t"));
     if (row.size() != 2 ||
@@ -222,8 +421,11 @@ int UserDictManager::Import(const std::string& dict_name,
   } BOOST_SCOPE_EXIT_END
   if (!IsUserDb(db))
     return -1;
+  UserDbSyllabary syllabary;
+  syllabary.Load(&db);
+  ImportMerge::Updates updates;
   std::ifstream fin(text_file.c_str());
-  std::string line, key, value;
+  std::string line, key, packed_key;
   int num_entries = 0;
   while (getline(fin, line)) {
     // skip empty lines and comments
@@ -246,6 +448,8 @@ int UserDictManager::Import(const std::string& dict_name,
       row[1] = boost::algorithm::join(syllables, " ");
     }
     key = row[1] + " \t" + row[0];
+    if (syllabary.PackKey(key, &packed_key))
+      key.swap(packed_key);
     int commits = 0;
     if (row.size() >= 3 && !row[2].empty()) {
       try {
@@ -254,21 +458,14 @@ int UserDictManager::Import(const std::string& dict_name,
       catch (...) {
       }
     }
-    int c = 0;
-    double d = 0.0;
-    TickCount t = 0;
-    if (db.Fetch(key, &value))
-      UserDictionary::UnpackValues(value, &c, &d, &t);
-    if (commits > 0)
-      c = (std::max)(commits, c);
-    else if (commits < 0)  // mark as deleted
-      c = commits;
-    value = boost::str(boost::format("c=%1% d=%2% t=%3%") %
-                       c % d % t);
-    if (db.Update(key, value))
-      ++num_entries;
+    // a negative count marks the entry as deleted
+    updates[key].Add(commits);
+    ++num_entries;
   }
   fin.close();
+  ImportMerge merge(&db, updates);
+  if (!updates.empty() && !RebuildUserDb(&db, &merge))
+    return -1;
   return num_entries;
 }
 
@@ -280,17 +477,108 @@ bool UserDictManager::UpgradeUserDict(const std::string& dict_name) {
     return false;
   std::string db_creator_version;
   db.Fetch("\x01/rime_version", &db_creator_version);
-  if (CompareVersionString(db_creator_version, "0.9.1") <= 0) {
-    // fix invalid keys created by a buggy version of Import()
+  // fix invalid keys created by a buggy version of Import(),
+  // and convert values stored in text records to the packed form
+  if (CompareVersionString(db_creator_version, "0.9.1") <= 0 ||
+      !HasPackedValues(db)) {
     EZLOGGERPRINT("upgrading user dict '%s'.", dict_name.c_str());
     std::string snapshot_file(db.file_name() + ".snapshot");
-    return db.Backup() &&
-        db.Close() &&
-        db.Remove() &&
-        Restore(snapshot_file);
+    if (!db.Backup() ||
+        !db.Close() ||
+        !db.Remove() ||
+        !Restore(snapshot_file))
+      return false;
   }
-  return true;
+  else {
+    db.Close();
+  }
+  return SyncSyllabary(dict_name);
 }
 
+bool UserDictManager::SyncSyllabary(const std::string& dict_name) {
+  fs::path table_file(path_ / (dict_name + ".table.bin"));
+  if (!fs::exists(table_file))
+    return true;
+  Table table(table_file.string());
+  Syllabary syllabary;
+  if (!table.Load() || !table.GetSyllabary(&syllabary))
+    return false;
+  UserDb db(dict_name);
+  if (db.IsInUse()) {
+    EZLOGGERPRINT("user dict '%s' is in use; not repacked.",
+                  dict_name.c_str());
+    return true;
+  }
+  if (!db.Open())
+    return false;
+  BOOST_SCOPE_EXIT( (&db) )
+  {
+    db.Close();
+  } BOOST_SCOPE_EXIT_END
+  if (!IsUserDb(db))
+    return false;
+  UserDbSyllabary current;
+  current.Assign(syllabary);
+  return current.Repack(&db);
+}
+
+int UserDictManager::CompactUserDict(const std::string& dict_name,
+                                     double min_weight,
+                                     double min_dead_ratio) {
+  UserDb db(dict_name);
+  if (db.IsInUse()) {
+    EZLOGGERPRINT("user dict '%s' is in use; not compacted.",
+                  dict_name.c_str());
+    return 0;
+  }
+  if (!db.Open())
+    return -1;
+  BOOST_SCOPE_EXIT( (&db) )
+  {
+    db.Close();
+  } BOOST_SCOPE_EXIT_END
+  if (!IsUserDb(db))
+    return -1;
+  TickCount tick = GetTickCount(db);
+  std::vector<std::string> dead_keys;
+  size_t num_entries = 0;
+  {
+    std::string key, value;
+    shared_ptr<UserDbAccessor> a = db.Query("");
+    while (a->GetNextRecord(&key, &value)) {
+      if (boost::starts_with(key, "\x01/"))  // skip metadata
+        continue;
+      ++num_entries;
+      int c = 0;
+      double d = 0.0;
+      TickCount t = 0;
+      if (!UserDictionary::UnpackValues(value, &c, &d, &t))
+        continue;
+      if (c < 0) {  // deleted entry
+        dead_keys.push_back(key);
+        continue;
+      }
+      if (c > 0)  // what the user has committed is kept
+        continue;
+      // weighed as in a lookup
+      double dee = algo::formula_d(0, (double)tick, d, (double)t);
+      double weight = algo::formula_p(0, 0.0, (double)tick, dee);
+      if (weight < min_weight)
+        dead_keys.push_back(key);
+    }
+  }
+  // not worth rewriting the whole db for a few
+  if (dead_keys.empty() ||
+      dead_keys.size() < min_dead_ratio * num_entries)
+    return 0;
+  EZLOGGERPRINT("dropping %d entries from user dict '%s'.",
+                dead_keys.size(), dict_name.c_str());
+  BOOST_FOREACH(const std::string &key, dead_keys) {
+    db.Erase(key);
+  }
+  if (!db.Defragment())
+    return -1;
+  return static_cast<int>(dead_keys.size());
+}
 
 }  // namespace rime
@@ -9,6 +9,7 @@
 // 2011-07-10 GONG Chen <chen.sst@gmail.com>
 //
 #include <algorithm>
+#include <set>
 #include <boost/algorithm/string/join.hpp>
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
@@ -49,16 +50,14 @@ bool DelimitSyllablesDfs(DelimitSyllableState *state,
     return current_pos == state->end_pos;
   }
   SyllableId syllable_id = state->code->at(depth);
-  EdgeMap::const_iterator z = state->graph->edges.find(current_pos);
-  if (z == state->graph->edges.end())
-    return false;
+  const SyllableGraph &graph(*state->graph);
   // favor longer spellings
-  BOOST_REVERSE_FOREACH(const EndVertexMap::value_type &y, z->second) {
-    size_t end_vertex_pos = y.first;
+  for (size_t e = graph.edges_end(current_pos);
+       e > graph.edges_begin(current_pos); --e) {
+    size_t end_vertex_pos = graph.edges[e - 1].end;
     if (end_vertex_pos > state->end_pos)
       continue;
-    SpellingMap::const_iterator x = y.second.find(syllable_id);
-    if (x != y.second.end()) {
+    if (graph.FindSpelling(current_pos, end_vertex_pos, syllable_id)) {
       size_t len = state->output.length();
       if (depth > 0 && len > 0 &&
           state->delimiters->find(
@@ -82,19 +81,28 @@ typedef Sentence R10nSentence;
 
 class R10nTranslation : public Translation {
  public:
-  R10nTranslation(const std::string &input, size_t start,
+  R10nTranslation(const std::string &input, const Segment &segment,
                   R10nTranslator *translator)
-      : input_(input), start_(start),
+      : input_(input), start_(segment.start),
+        syllable_graphs_(segment.syllable_graphs),
         translator_(translator),
+        budget_((std::max)(translator->sentence_work_budget(), 0)),
+        longest_phrase_length_(0),
         user_phrase_index_(0) {
     set_exhausted(true);
   }
   bool Evaluate(Dictionary *dict, UserDictionary *user_dict);
   virtual bool Next();
   virtual shared_ptr<Candidate> Peek();
+  virtual bool Refine(shared_ptr<Candidate> *draft,
+                      shared_ptr<Candidate> *refined);
 
  protected:
   void CheckEmpty();
+  void DecorateSentence(R10nSentence *sentence) const;
+  const std::string NextText() const;
+  size_t NextPhraseLength() const;
+  void FetchAlternativeSentence();
   template <class CandidateT>
   const std::string GetPreeditString(const CandidateT &cand) const;
   template <class CandidateT>
@@ -104,32 +112,68 @@ class R10nTranslation : public Translation {
 
   const std::string input_;
   size_t start_;
+  shared_ptr<SyllableGraphCache> syllable_graphs_;
   R10nTranslator *translator_;
   
-  SyllableGraph syllable_graph_;
+  shared_ptr<SyllableGraph> syllable_graph_;
   shared_ptr<DictEntryCollector> phrase_;
   shared_ptr<UserDictEntryCollector> user_phrase_;
   shared_ptr<R10nSentence> sentence_;
+  // the first sentence, made within the budget, might be refined at idle
+  size_t budget_;
+  shared_ptr<R10nSentence> draft_;
+  // alternative sentences are made on demand, and offered
+  // before phrases shorter than the longest ones
+  shared_ptr<WordGraph> word_graph_;
+  Poet<R10nSentence> poet_;
+  size_t longest_phrase_length_;
   
   DictEntryCollector::reverse_iterator phrase_iter_;
   UserDictEntryCollector::reverse_iterator user_phrase_iter_;
   size_t user_phrase_index_;
-  std::set<std::string> candidate_set_;
+  // a text is taken out when the draft sentence having it is refined
+  std::multiset<std::string> candidate_set_;
 };
 
+// DictEntryPool implementation
+
+shared_ptr<DictEntry> DictEntryPool::Get() {
+  const size_t kCapacity = 4096;
+  while (next_ < pool_.size()) {
+    const shared_ptr<DictEntry> &e(pool_[next_++]);
+    if (e.unique())
+      return e;
+  }
+  shared_ptr<DictEntry> e = make_shared<DictEntry>();
+  if (pool_.size() < kCapacity) {
+    pool_.push_back(e);
+    ++next_;
+  }
+  return e;
+}
+
 // R10nTranslator implementation
 
 R10nTranslator::R10nTranslator(Engine *engine)
     : Translator(engine),
       enable_completion_(true),
-      spelling_hints_(0) {
+      spelling_hints_(0),
+      sentence_work_budget_(kDefaultSentenceWorkBudget) {
   if (!engine) return;
 
+  int max_edges_per_vertex = kDefaultMaxEdgesPerVertex;
+  int max_total_edges = kDefaultMaxTotalEdges;
+  int max_input_length = kDefaultMaxInputLength;
   Config *config = engine->schema()->config();
   if (config) {
     config->GetString("speller/delimiter", &delimiters_);
+    fuzzy_matcher_.Load(config->GetList("speller/fuzzy"));
+    config->GetInt("speller/max_edges_per_vertex", &max_edges_per_vertex);
+    config->GetInt("speller/max_total_edges", &max_total_edges);
+    config->GetInt("speller/max_input_length", &max_input_length);
     config->GetBool("translator/enable_completion", &enable_completion_);
     config->GetInt("translator/spelling_hints", &spelling_hints_);
+    config->GetInt("translator/sentence_work_budget", &sentence_work_budget_);
     preedit_formatter_.Load(config->GetList("translator/preedit_format"));
     comment_formatter_.Load(config->GetList("translator/comment_format"));
     user_dict_disabling_patterns_.Load(
@@ -138,6 +182,11 @@ R10nTranslator::R10nTranslator(Engine *engine)
   if (delimiters_.empty()) {
     delimiters_ = " ";
   }
+  syllabifier_ = Syllabifier(delimiters_, enable_completion_);
+  syllabifier_.set_fuzzy_matcher(&fuzzy_matcher_);
+  syllabifier_.set_max_edges_per_vertex((std::max)(max_edges_per_vertex, 0));
+  syllabifier_.set_max_total_edges((std::max)(max_total_edges, 0));
+  syllabifier_.set_max_input_length((std::max)(max_input_length, 0));
   
   Dictionary::Component *dictionary = Dictionary::Require("dictionary");
   if (dictionary) {
@@ -189,7 +238,7 @@ shared_ptr<Translation> R10nTranslator::Query(const std::string &input,
   }
   // the translator should survive translations it creates
   shared_ptr<R10nTranslation> result =
-      boost::make_shared<R10nTranslation>(input, segment.start, this);
+      boost::make_shared<R10nTranslation>(input, segment, this);
   if (!result ||
       !result->Evaluate(dict_.get(),
                         enable_user_dict ? user_dict_.get() : NULL)) {
@@ -299,15 +348,28 @@ void R10nTranslator::OnDeleteEntry(Context *ctx) {
 // R10nTranslation implementation
 
 bool R10nTranslation::Evaluate(Dictionary *dict, UserDictionary *user_dict) {
-  Syllabifier syllabifier(translator_->delimiters(),
-                          translator_->enable_completion());
-  size_t consumed = syllabifier.BuildSyllableGraph(input_,
-                                                   *dict->prism(),
-                                                   &syllable_graph_);
+  const Prism *prism = dict->prism().get();
+  size_t end = start_ + input_.length();
+  if (syllable_graphs_)
+    syllable_graph_ = syllable_graphs_->Find(prism, start_, end);
+  if (!syllable_graph_) {
+    syllable_graph_ = boost::make_shared<SyllableGraph>();
+    Syllabifier &syllabifier(translator_->syllabifier());
+    syllabifier.BuildSyllableGraph(input_, *dict->prism(),
+                                   syllable_graph_.get());
+    if (syllable_graphs_)
+      syllable_graphs_->Add(prism, start_, end, syllable_graph_);
+  }
+  size_t consumed = syllable_graph_->interpreted_length;
 
-  phrase_ = dict->Lookup(syllable_graph_, 0);
+  R10nLookupPools &pools(translator_->lookup_pools());
+  phrase_ = pools.phrases.Get();
+  if (!dict->Lookup(*syllable_graph_, 0, 1.0, phrase_.get()))
+    phrase_.reset();
   if (user_dict) {
-    user_phrase_ = user_dict->Lookup(syllable_graph_, 0);
+    user_phrase_ = pools.user_phrases.Get();
+    if (!user_dict->Lookup(*syllable_graph_, 0, 0, 1.0, user_phrase_.get()))
+      user_phrase_.reset();
   }
   if (!phrase_ && !user_phrase_)
     return false;
@@ -318,8 +380,13 @@ bool R10nTranslation::Evaluate(Dictionary *dict, UserDictionary *user_dict) {
   if (user_phrase_ && !user_phrase_->empty())
     translated_len = (std::max)(translated_len, user_phrase_->rbegin()->first);
   if (translated_len < consumed &&
-      syllable_graph_.edges.size() > 1) {  // at least 2 syllables required
+      !syllable_graph_->edges.empty() &&  // at least 2 syllables required
+      syllable_graph_->edges.front().start !=
+      syllable_graph_->edges.back().start) {
     sentence_ = MakeSentence(dict, user_dict);
+    longest_phrase_length_ = translated_len;
+    if (!poet_.finished())
+      draft_ = sentence_;
   }
 
   if (phrase_) phrase_iter_ = phrase_->rbegin();
@@ -334,7 +401,7 @@ const std::string R10nTranslation::GetPreeditString(
   DelimitSyllableState state;
   state.input = &input_;
   state.delimiters = &translator_->delimiters();
-  state.graph = &syllable_graph_;
+  state.graph = syllable_graph_.get();
   state.code = &cand.code();
   state.end_pos = cand.end() - start_;
   bool success = DelimitSyllablesDfs(&state, cand.start() - start_, 0);
@@ -362,6 +429,7 @@ bool R10nTranslation::Next() {
   if (sentence_) {
     candidate_set_.insert(sentence_->text());
     sentence_.reset();
+    FetchAlternativeSentence();
     CheckEmpty();
     return exhausted();
   }
@@ -385,15 +453,18 @@ bool R10nTranslation::Next() {
     }
     else if (phrase_code_length > 0) {
       DictEntryIterator &iter(phrase_iter_->second);
-      candidate_set_.insert(iter.Peek()->text);
+      DictEntryView view;
+      if (iter.Peek(&view))
+        candidate_set_.insert(std::string(view.text, view.text_length));
       if (!iter.Next()) {
         ++phrase_iter_;
       }
     }
+    FetchAlternativeSentence();
     CheckEmpty();
   }
   while (!exhausted() && /* skip duplicate candidates */
-         candidate_set_.find(Peek()->text()) != candidate_set_.end());
+         candidate_set_.find(NextText()) != candidate_set_.end());
   return exhausted();
 }
 
@@ -401,16 +472,7 @@ shared_ptr<Candidate> R10nTranslation::Peek() {
   if (exhausted())
     return shared_ptr<Candidate>();
   if (sentence_) {
-    if (sentence_->preedit().empty()) {
-      sentence_->set_preedit(GetPreeditString(*sentence_));
-    }
-    if (sentence_->comment().empty()) {
-      const std::string spelling(GetOriginalSpelling(*sentence_));
-      if (!spelling.empty() &&
-          spelling != sentence_->preedit()) {
-        sentence_->set_comment(quote_left + spelling + quote_right);
-      }
-    }
+    DecorateSentence(sentence_.get());
     return sentence_;
   }
   size_t user_phrase_code_length = 0;
@@ -434,12 +496,13 @@ shared_ptr<Candidate> R10nTranslation::Peek() {
   }
   else if (phrase_code_length > 0) {
     DictEntryIterator &iter(phrase_iter_->second);
-    const shared_ptr<DictEntry> &e(iter.Peek());
+    DictEntryView view;
+    if (!iter.Peek(&view))
+      return shared_ptr<Candidate>();
     EZDBGONLYLOGGERVAR(phrase_code_length);
-    EZDBGONLYLOGGERVAR(e->text);
     cand = make_shared<R10nCandidate>(start_,
                                       start_ + phrase_code_length,
-                                      e);
+                                      view);
   }
   if (cand && cand->preedit().empty()) {
     cand->set_preedit(GetPreeditString(*cand));
@@ -454,47 +517,161 @@ shared_ptr<Candidate> R10nTranslation::Peek() {
   return cand;
 }
 
+// each step continues the search under the budget; the best sentence
+// found so far replaces the draft, which may have been offered already
+bool R10nTranslation::Refine(shared_ptr<Candidate> *draft,
+                             shared_ptr<Candidate> *refined) {
+  if (!draft_ || !draft || !refined)
+    return false;
+  shared_ptr<R10nSentence> sentence = poet_.Resume(budget_);
+  if (!sentence) {
+    draft_.reset();
+    return false;
+  }
+  sentence->Offset(start_);
+  DecorateSentence(sentence.get());
+  SentenceMemo &memo(translator_->sentence_memo());
+  if (memo.graph == word_graph_)  // not yet superseded by another input
+    poet_.Memorize(word_graph_, &memo);
+  if (sentence->text() != draft_->text()) {
+    EZLOGGERPRINT("refined sentence: '%s' -> '%s'.",
+                  draft_->text().c_str(), sentence->text().c_str());
+  }
+  if (sentence_ == draft_) {  // yet to be offered
+    sentence_ = sentence;
+  }
+  else {
+    std::multiset<std::string>::iterator it =
+        candidate_set_.find(draft_->text());
+    if (it != candidate_set_.end())
+      candidate_set_.erase(it);
+    candidate_set_.insert(sentence->text());
+  }
+  *draft = draft_;
+  *refined = sentence;
+  if (poet_.finished())
+    draft_.reset();
+  else
+    draft_ = sentence;
+  return true;
+}
+
+// the text of the next candidate, read without making the candidate
+const std::string R10nTranslation::NextText() const {
+  if (sentence_)
+    return sentence_->text();
+  size_t user_phrase_code_length = 0;
+  if (user_phrase_ && user_phrase_iter_ != user_phrase_->rend()) {
+    user_phrase_code_length = user_phrase_iter_->first;
+  }
+  size_t phrase_code_length = 0;
+  if (phrase_ && phrase_iter_ != phrase_->rend()) {
+    phrase_code_length = phrase_iter_->first;
+  }
+  if (user_phrase_code_length > 0 &&
+      user_phrase_code_length >= phrase_code_length) {
+    return user_phrase_iter_->second[user_phrase_index_]->text;
+  }
+  DictEntryView view;
+  if (phrase_code_length > 0 && phrase_iter_->second.Peek(&view))
+    return std::string(view.text, view.text_length);
+  return std::string();
+}
+
+void R10nTranslation::DecorateSentence(R10nSentence *sentence) const {
+  if (sentence->preedit().empty()) {
+    sentence->set_preedit(GetPreeditString(*sentence));
+  }
+  if (sentence->comment().empty()) {
+    const std::string spelling(GetOriginalSpelling(*sentence));
+    if (!spelling.empty() &&
+        spelling != sentence->preedit()) {
+      sentence->set_comment(quote_left + spelling + quote_right);
+    }
+  }
+}
+
 void R10nTranslation::CheckEmpty() {
-  set_exhausted((!phrase_ || phrase_iter_ == phrase_->rend()) &&
+  set_exhausted(!sentence_ &&
+                (!phrase_ || phrase_iter_ == phrase_->rend()) &&
                 (!user_phrase_ || user_phrase_iter_ == user_phrase_->rend()));
 }
 
+size_t R10nTranslation::NextPhraseLength() const {
+  size_t length = 0;
+  if (user_phrase_ && user_phrase_iter_ != user_phrase_->rend())
+    length = user_phrase_iter_->first;
+  if (phrase_ && phrase_iter_ != phrase_->rend())
+    length = (std::max)(length, phrase_iter_->first);
+  return length;
+}
+
+void R10nTranslation::FetchAlternativeSentence() {
+  const size_t kMaxAlternativeSentences = 50;
+  if (sentence_ || !longest_phrase_length_ ||
+      NextPhraseLength() >= longest_phrase_length_)
+    return;
+  // the search for alternatives finishes that for the draft offered,
+  // which is then to be refined into the best sentence
+  shared_ptr<R10nSentence> best;
+  if (draft_)
+    best = poet_.Resume();
+  for (size_t i = 0; i < kMaxAlternativeSentences; ++i) {
+    shared_ptr<R10nSentence> sentence = poet_.NextSentence();
+    if (!sentence)
+      break;
+    // skip the best sentence and those spelled out by phrases offered
+    if (candidate_set_.find(sentence->text()) != candidate_set_.end() ||
+        (best && sentence->text() == best->text()))
+      continue;
+    sentence->Offset(start_);
+    sentence_ = sentence;
+    return;
+  }
+  longest_phrase_length_ = 0;  // no more sentences
+}
+
 const shared_ptr<R10nSentence> R10nTranslation::MakeSentence(
     Dictionary *dict, UserDictionary *user_dict) {
   const int kMaxSyllablesForUserPhraseQuery = 5;
   const double kPenaltyForAmbiguousSyllable = 1e-10;
-  WordGraph graph;
-  BOOST_FOREACH(const EdgeMap::value_type &s, syllable_graph_.edges) {
-    // discourage starting a word from an ambiguous joint
-    // bad cases include pinyin syllabification "niju'ede"
-    double credibility = 1.0;
-    if (syllable_graph_.vertices[s.first] >= kAmbiguousSpelling)
-      credibility = kPenaltyForAmbiguousSyllable;
-    shared_ptr<UserDictEntryCollector> user_phrase;
-    if (user_dict) {
-      user_phrase = user_dict->Lookup(syllable_graph_, s.first,
-                                      kMaxSyllablesForUserPhraseQuery,
-                                      credibility);
-    }
-    UserDictEntryCollector &u(graph[s.first]);
-    if (user_phrase)
-      u.swap(*user_phrase);
-    shared_ptr<DictEntryCollector> phrase =
-        dict->Lookup(syllable_graph_, s.first, credibility);
-    if (phrase) {
-      // merge lookup results
-      BOOST_FOREACH(DictEntryCollector::value_type &t, *phrase) {
-        DictEntryList &entries(u[t.first]);
-        if (entries.empty()) {
-          shared_ptr<DictEntry> e(t.second.Peek());
-          entries.push_back(e);
-        }
+  // discourage starting a word from an ambiguous joint
+  // bad cases include pinyin syllabification "niju'ede"
+  std::vector<double> credibility(syllable_graph_->interpreted_length, 1.0);
+  for (size_t i = 0; i < credibility.size(); ++i) {
+    if (syllable_graph_->vertices[i] >= kAmbiguousSpelling)
+      credibility[i] = kPenaltyForAmbiguousSyllable;
+  }
+  R10nLookupPools &pools(translator_->lookup_pools());
+  word_graph_ = pools.word_graphs.Get();
+  WordGraph &graph(*word_graph_);
+  graph.reserve(syllable_graph_->interpreted_length);
+  if (user_dict) {
+    user_dict->Lookup(*syllable_graph_, kMaxSyllablesForUserPhraseQuery,
+                      credibility, &graph);
+  }
+  shared_ptr<DictEntryLattice> lattice = pools.lattices.Get();
+  dict->Lookup(*syllable_graph_, credibility, lattice.get());
+  pools.entries.Rewind();
+  BOOST_FOREACH(DictEntryLattice::value_type &p, *lattice) {
+    UserDictEntryCollector &u(graph[p.first]);
+    // merge lookup results
+    BOOST_FOREACH(DictEntryCollector::value_type &t, p.second) {
+      DictEntryList &entries(u[t.first]);
+      DictEntryView view;
+      if (entries.empty() && t.second.Peek(&view)) {
+        shared_ptr<DictEntry> e(pools.entries.Get());
+        view.CopyTo(e.get());
+        entries.push_back(e);
       }
     }
   }
-  Poet<R10nSentence> poet;
+  poet_.set_bigram_model(dict->bigram_model());
+  SentenceMemo &memo(translator_->sentence_memo());
   shared_ptr<R10nSentence> sentence =
-      poet.MakeSentence(graph, syllable_graph_.interpreted_length);
+      poet_.MakeSentence(graph, syllable_graph_->interpreted_length, budget_,
+                         &memo);
+  poet_.Memorize(word_graph_, &memo);
   if (sentence) {
     sentence->Offset(start_);
   }
@@ -46,10 +46,12 @@ class ReverseLookupTranslation : public TableTranslation {
 shared_ptr<Candidate> ReverseLookupTranslation::Peek() {
   if (exhausted())
     return shared_ptr<Candidate>();
-  const shared_ptr<DictEntry> &e(iter_.Peek());
+  DictEntryView e;
+  iter_.Peek(&e);
+  const std::string text(e.text, e.text_length);
   std::string tips;
   if (dict_) {
-    dict_->ReverseLookup(e->text, &tips);
+    dict_->ReverseLookup(text, &tips);
     if (comment_formatter_) {
       comment_formatter_->Apply(&tips);
     }
@@ -61,8 +63,8 @@ shared_ptr<Candidate> ReverseLookupTranslation::Peek() {
       "reverse_lookup",
       start_,
       end_,
-      e->text,
-      !tips.empty() ? (quote_left + tips + quote_right) : e->comment,
+      text,
+      !tips.empty() ? (quote_left + tips + quote_right) : e.comment(),
       preedit_);
   return cand;
 }
@@ -193,11 +193,13 @@ class SentenceTranslation : public Translation {
       return shared_ptr<Candidate>();
     }
     DictEntryCollector::reverse_iterator r(collector_.rbegin());
-    shared_ptr<DictEntry> entry(r->second.Peek());
+    DictEntryView view;
+    if (!r->second.Peek(&view))
+      return shared_ptr<Candidate>();
     shared_ptr<ZhCandidate> result = boost::make_shared<ZhCandidate>(
         start_,
         start_ + r->first,
-        entry);
+        view);
     if (preedit_formatter_) {
       std::string preedit(input_.substr(0, r->first));
       preedit_formatter_->Apply(&preedit);
@@ -263,14 +265,14 @@ shared_ptr<Translation> TableTranslator::MakeSentence(const std::string& input,
       shared_ptr<Sentence> new_sentence =
           make_shared<Sentence>(*sentences[start_pos]);
       // extend the sentence with the first suitable entry
-      shared_ptr<DictEntry> entry = iter.Peek();
       if (filter_by_charset) {
-        while (!CharsetFilter::Passed(entry->text) &&
-               iter.Next()) {
-          entry = iter.Peek();
+        DictEntryView view;
+        while (iter.Peek(&view) && !CharsetFilter::Passed(view.text)) {
+          iter.Next();
         }
         if (iter.exhausted()) continue;
       }
+      shared_ptr<DictEntry> entry = iter.Peek();
       new_sentence->Extend(*entry, end_pos);
       // compare and update sentences
       if (sentences.find(end_pos) == sentences.end() ||
@@ -25,15 +25,72 @@ bool Patterns::Load(ConfigListPtr patterns) {
   return true;
 }
 
+// ZhCandidate
+
+ZhCandidate::ZhCandidate(size_t start, size_t end,
+                         const DictEntryView &view)
+    : Candidate("zh", start, end), view_(view), has_comment_(false) {
+  code_.assign(view.code, view.code + view.code_length);
+  if (view.remaining_code)
+    remaining_code_ = *view.remaining_code;
+  view_.code = NULL;
+  view_.code_length = 0;
+  view_.remaining_code = NULL;
+}
+
+const std::string& ZhCandidate::text() const {
+  if (entry_)
+    return entry_->text;
+  if (text_.empty() && view_.text)
+    text_.assign(view_.text, view_.text_length);
+  return text_;
+}
+
+const std::string ZhCandidate::comment() const {
+  if (entry_)
+    return entry_->comment;
+  if (has_comment_ || remaining_code_.empty())
+    return comment_;
+  return "~" + remaining_code_;
+}
+
+void ZhCandidate::set_comment(const std::string &comment) {
+  if (entry_) {
+    entry_->comment = comment;
+    return;
+  }
+  comment_ = comment;
+  has_comment_ = true;
+}
+
+const DictEntry& ZhCandidate::entry() const {
+  if (!entry_) {
+    shared_ptr<DictEntry> e = make_shared<DictEntry>();
+    DictEntryView view(view_);
+    view.code = code_.begin();
+    view.code_length = code_.size();
+    view.remaining_code = &remaining_code_;
+    view.CopyTo(e.get());
+    e->comment = comment();
+    e->preedit = preedit_;
+    entry_ = e;
+  }
+  return *entry_;
+}
+
 // Sentence
 
-void Sentence::Extend(const DictEntry& entry, size_t end_pos) {
+double Sentence::ExtendWeight(double weight, const DictEntry& entry) {
   const double kEpsilon = 1e-200;
   const double kPenalty = 1e-8;
+  return weight * ((std::max)(entry.weight, kEpsilon) * kPenalty);
+}
+
+void Sentence::Extend(const DictEntry& entry, size_t end_pos) {
   entry_.code.insert(entry_.code.end(),
                      entry.code.begin(), entry.code.end());
   entry_.text.append(entry.text);
-  entry_.weight *= (std::max)(entry.weight, kEpsilon) * kPenalty;
+  entry_.weight = ExtendWeight(entry_.weight, entry);
   components_.push_back(entry);
   syllable_lengths_.push_back(end_pos - end());
   set_end(end_pos);
@@ -78,16 +135,17 @@ bool TableTranslation::Next() {
 shared_ptr<Candidate> TableTranslation::Peek() {
   if (exhausted())
     return shared_ptr<Candidate>();
-  const shared_ptr<DictEntry> &e(iter_.Peek());
-  std::string comment(e->comment);
+  DictEntryView e;
+  iter_.Peek(&e);
+  std::string comment(e.comment());
   if (comment_formatter_) {
     comment_formatter_->Apply(&comment);
   }
   return boost::make_shared<SimpleCandidate>(
-      e->remaining_code_length == 0 ? "zh" : "completion",
+      e.remaining_code->empty() ? "zh" : "completion",
       start_,
       end_,
-      e->text,
+      std::string(e.text, e.text_length),
       comment,
       preedit_);
 }
@@ -123,7 +181,11 @@ bool CharsetFilter::LocateNextCandidate() {
 }
 
 bool CharsetFilter::Passed(const std::string& text) {
-  const char* p = text.c_str();
+  return Passed(text.c_str());
+}
+
+bool CharsetFilter::Passed(const char* text) {
+  const char* p = text;
   utf8::uint32_t c;
   while ((c = utf8::unchecked::next(p))) {
     if (c >= 0x3400 && c <= 0x4DBF ||    // CJK Unified Ideographs Extension A
@@ -40,11 +40,13 @@ size_t Menu::Prepare(size_t candidate_count) {
     }
     if (translations_[k]->exhausted()) {
       EZLOGGERPRINT("Warning: selected translation #%d has been exhausted!", k);
+      exhausted_translations_.push_back(translations_[k]);
       translations_.erase(translations_.begin() + k);
       continue;
     }
     CandidateList next_candidates;
     next_candidates.push_back(translations_[k]->Peek());
+    recruits_.push_back(next_candidates.back());
     if (filter_) {
       filter_(&candidates_, &next_candidates);
     }
@@ -60,12 +62,52 @@ size_t Menu::Prepare(size_t candidate_count) {
     translations_[k]->Next();
     if (translations_[k]->exhausted()) {
       EZDBGONLYLOGGERPRINT("Translation #%d has been exhausted.", k);
+      exhausted_translations_.push_back(translations_[k]);
       translations_.erase(translations_.begin() + k);
     }
   }
   return count;
 }
 
+bool Menu::Refine() {
+  std::vector<shared_ptr<Translation> > translations(translations_);
+  translations.insert(translations.end(),
+                      exhausted_translations_.begin(),
+                      exhausted_translations_.end());
+  bool refined = false;
+  bool replaced = false;
+  for (size_t i = 0; i < translations.size(); ++i) {
+    shared_ptr<Candidate> draft, better;
+    if (!translations[i]->Refine(&draft, &better))
+      continue;
+    refined = true;
+    CandidateList::iterator it =
+        std::find(recruits_.begin(), recruits_.end(), draft);
+    if (it != recruits_.end() && better) {
+      *it = better;
+      replaced = true;
+    }
+  }
+  if (replaced)
+    Refilter();
+  return refined;
+}
+
+// the filters may have changed or merged the draft candidates,
+// so the recruited ones go through them again
+void Menu::Refilter() {
+  candidates_.clear();
+  for (size_t i = 0; i < recruits_.size(); ++i) {
+    CandidateList next_candidates;
+    next_candidates.push_back(recruits_[i]);
+    if (filter_) {
+      filter_(&candidates_, &next_candidates);
+    }
+    std::copy(next_candidates.begin(), next_candidates.end(),
+              std::back_inserter(candidates_));
+  }
+}
+
 Page* Menu::CreatePage(size_t page_size, size_t page_no) {
   size_t start_pos = page_size * page_no;
   size_t end_pos = start_pos + page_size;
@@ -51,6 +51,7 @@ RIME_API Bool RimeStartMaintenance(Bool full_check) {
   }
   deployer.ScheduleTask(boost::make_shared<rime::WorkspaceUpdate>());
   deployer.ScheduleTask(boost::make_shared<rime::UserDictUpgration>());
+  deployer.ScheduleTask(boost::make_shared<rime::UserDictCompaction>());
   deployer.StartMaintenance();
   return True;
 }
@@ -95,9 +96,11 @@ RIME_API Bool RimeDeployWorkspace() {
   rime::InstallationUpdate installation;
   rime::WorkspaceUpdate update;
   rime::UserDictUpgration upgration;
+  rime::UserDictCompaction compaction;
   return Bool(installation.Run(&deployer) &&
               update.Run(&deployer) &&
-              upgration.Run(&deployer));
+              upgration.Run(&deployer) &&
+              compaction.Run(&deployer));
 }
 
 RIME_API Bool RimeDeploySchema(const char *schema_file) {
@@ -158,6 +161,13 @@ RIME_API void RimeClearComposition(RimeSessionId session_id) {
   session->ClearComposition();
 }
 
+RIME_API Bool RimeRefineComposition(RimeSessionId session_id) {
+  boost::shared_ptr<rime::Session> session(rime::Service::instance().GetSession(session_id));
+  if (!session)
+    return False;
+  return Bool(session->RefineComposition());
+}
+
 // output
 
 RIME_API Bool RimeGetContext(RimeSessionId session_id, RimeContext* context) {
@@ -51,6 +51,11 @@ void Session::ClearComposition() {
   engine_->context()->Clear();
 }
 
+bool Session::RefineComposition() {
+  Context *ctx = context();
+  return ctx && ctx->RefineComposition();
+}
+
 void Session::OnCommit(const std::string &commit_text) {
   commit_text_ += commit_text;
 }
@@ -0,0 +1,85 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <cmath>
+#include <string>
+#include <gtest/gtest.h>
+#include <rime/dict/bigram_model.h>
+
+using namespace rime;
+
+class RimeBigramModelTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    collector_.AddWord("中", 1000);
+    collector_.AddWord("國", 800);
+    collector_.AddWord("人", 900);
+    collector_.AddWord("民", 500);
+    collector_.AddWord("中國", 300);
+    collector_.AddWord("國人", 20);
+    collector_.AddWord("人民", 400);
+    collector_.AddWord("中國人", 50);
+    collector_.AddWord("中國人民", 200);
+  }
+
+  const bigram::Record* FindRecord(const std::string &left,
+                                   const std::string &right) const {
+    for (size_t i = 0; i < records_.size(); ++i) {
+      if (records_[i].left == left && records_[i].right == right)
+        return &records_[i];
+    }
+    return NULL;
+  }
+
+  BigramCollector collector_;
+  bigram::Records records_;
+};
+
+TEST_F(RimeBigramModelTest, CollectWordPairs) {
+  collector_.Collect(100, &records_);
+  // '中國人民' is split into '中國' and '人民', not '中國人' and '民'
+  const bigram::Record *r = FindRecord("中國", "人民");
+  ASSERT_TRUE(r != NULL);
+  EXPECT_LT(1.0, r->factor);
+  EXPECT_TRUE(FindRecord("中國人", "民") == NULL);
+  EXPECT_TRUE(FindRecord("人民", "中國") == NULL);
+  // the most frequent pairs are kept
+  collector_.Collect(1, &records_);
+  ASSERT_EQ(1, records_.size());
+  EXPECT_EQ("人", records_[0].left);
+  EXPECT_EQ("民", records_[0].right);
+}
+
+TEST_F(RimeBigramModelTest, UserHistory) {
+  collector_.AddPhrase("人民中國", 1000);
+  collector_.Collect(100, &records_);
+  EXPECT_TRUE(FindRecord("人民", "中國") != NULL);
+}
+
+TEST_F(RimeBigramModelTest, SaveAndLoad) {
+  collector_.Collect(100, &records_);
+  const bigram::Record *r = FindRecord("中國", "人民");
+  ASSERT_TRUE(r != NULL);
+  {
+    BigramModel model("bigram_model_test.bin");
+    model.Remove();
+    ASSERT_TRUE(model.Build(records_, 2012));
+    EXPECT_EQ(records_.size(), model.num_pairs());
+    ASSERT_TRUE(model.Save());
+  }
+  BigramModel model("bigram_model_test.bin");
+  ASSERT_TRUE(model.Load());
+  EXPECT_EQ(2012, model.source_checksum());
+  EXPECT_EQ(records_.size(), model.num_pairs());
+  // quantized to 1/8 of a bit
+  double factor = model.Query("中國", "人民");
+  EXPECT_GE(1.0 / 16, std::fabs(std::log(factor / r->factor) / std::log(2.0)));
+  EXPECT_EQ(1.0, model.Query("人民", "中國"));
+  EXPECT_EQ(1.0, model.Query("中國人", "民"));
+  model.Remove();
+}
@@ -6,11 +6,15 @@
 //
 // 2011-07-05 GONG Chen <chen.sst@gmail.com>
 //
+#include <list>
+#include <string>
+#include <vector>
 #include <gtest/gtest.h>
 #include <rime/common.h>
 #include <rime/algo/syllabifier.h>
 #include <rime/dict/dictionary.h>
 #include <rime/dict/dict_compiler.h>
+#include <rime/impl/translator_commons.h>
 
 class RimeDictionaryTest : public ::testing::Test {
  public:
@@ -68,6 +72,68 @@ TEST_F(RimeDictionaryTest, PredictiveLookup) {
   EXPECT_EQ("za", raw_code.ToString());
 }
 
+TEST_F(RimeDictionaryTest, PeekInPlace) {
+  ASSERT_TRUE(dict_->loaded());
+  rime::DictEntryIterator it;
+  dict_->LookupWords(&it, "z", true);
+  it.Sort();
+  for (int i = 0; i < 3 && !it.exhausted(); ++i, it.Next()) {
+    rime::DictEntryView view;
+    ASSERT_TRUE(it.Peek(&view));
+    rime::shared_ptr<rime::DictEntry> e(it.Peek());
+    ASSERT_TRUE(e);
+    EXPECT_EQ(e->text, std::string(view.text, view.text_length));
+    EXPECT_EQ(e->weight, view.weight);
+    EXPECT_EQ(e->comment, view.comment());
+    ASSERT_EQ(e->code.size(), view.code_length);
+    EXPECT_EQ(e->code[0], view.code[0]);
+    // copied over an entry made before
+    rime::DictEntry copy;
+    copy.text = "previous";
+    copy.preedit = "p";
+    copy.commit_count = 1;
+    view.CopyTo(&copy);
+    EXPECT_EQ(e->text, copy.text);
+    EXPECT_EQ(e->comment, copy.comment);
+    EXPECT_EQ(e->weight, copy.weight);
+    EXPECT_TRUE(copy.preedit.empty());
+    EXPECT_EQ(0, copy.commit_count);
+    EXPECT_TRUE(e->code == copy.code);
+  }
+}
+
+TEST_F(RimeDictionaryTest, CandidateInPlace) {
+  ASSERT_TRUE(dict_->loaded());
+  rime::DictEntryIterator it;
+  dict_->LookupWords(&it, "z", true);
+  it.Sort();
+  rime::DictEntryView view;
+  ASSERT_TRUE(it.Peek(&view));
+  rime::ZhCandidate cand(0, 1, view);
+  cand.set_preedit("z");
+  // the dict entry is made on demand, after the iterator has moved on
+  rime::shared_ptr<rime::DictEntry> e(it.Peek());
+  it.Next();
+  EXPECT_EQ(e->text, cand.text());
+  EXPECT_EQ(e->comment, cand.comment());
+  ASSERT_EQ(e->code.size(), cand.code().size());
+  EXPECT_EQ(e->code[0], cand.code()[0]);
+  const rime::DictEntry &entry(cand.entry());
+  EXPECT_EQ(e->text, entry.text);
+  EXPECT_EQ(e->weight, entry.weight);
+  EXPECT_EQ(e->remaining_code_length, entry.remaining_code_length);
+  EXPECT_EQ("z", entry.preedit);
+  ASSERT_EQ(e->code.size(), entry.code.size());
+  EXPECT_EQ(e->code[0], entry.code[0]);
+  // a comment set before the entry is made goes with it
+  ASSERT_TRUE(it.Peek(&view));
+  rime::ZhCandidate commented(0, 1, view);
+  commented.set_comment("c");
+  it.Next();
+  EXPECT_EQ("c", commented.comment());
+  EXPECT_EQ("c", commented.entry().comment);
+}
+
 TEST_F(RimeDictionaryTest, R10nLookup) {
   ASSERT_TRUE(dict_->loaded());
   rime::SyllableGraph g;
@@ -103,3 +169,54 @@ TEST_F(RimeDictionaryTest, R10nLookup) {
   EXPECT_EQ(9, e3->text.length());
   EXPECT_FALSE(d7.Next());
 }
+
+// the order in which entries are offered when chunks are merged by
+// sorting them all over again each time the front chunk advances
+static void MergeBySorting(std::list<rime::dictionary::Chunk> chunks,
+                           std::vector<std::string> *result) {
+  chunks.sort(rime::dictionary::compare_chunk_by_head_element);
+  while (!chunks.empty()) {
+    rime::dictionary::Chunk &chunk(chunks.front());
+    const rime::table::Entry &e(chunk.entries[chunk.cursor]);
+    result->push_back(std::string(e.text.c_str()) + "~" +
+                      chunk.remaining_code);
+    if (++chunk.cursor >= chunk.size)
+      chunks.pop_front();
+    else
+      chunks.sort(rime::dictionary::compare_chunk_by_head_element);
+  }
+}
+
+TEST_F(RimeDictionaryTest, MergeChunksInOrder) {
+  ASSERT_TRUE(dict_->loaded());
+  const double credibility[] = { 1.0, 0.5, 1.0, 2.0 };
+  const char *remaining_code[] = { "", "", "g", "" };
+  std::list<rime::dictionary::Chunk> chunks;
+  rime::DictEntryIterator it;
+  for (int syllable_id = 0;
+       dict_->table()->GetSyllableById(syllable_id); ++syllable_id) {
+    rime::TableAccessor a(dict_->table()->QueryWords(syllable_id));
+    if (a.exhausted())
+      continue;
+    // equally weighted chunks are included
+    for (size_t i = 0; i < 4; ++i) {
+      rime::dictionary::Chunk chunk(a, remaining_code[i], credibility[i]);
+      chunks.push_back(chunk);
+      it.AddChunk(chunk);
+    }
+  }
+  ASSERT_LT(4, chunks.size());
+  std::vector<std::string> expected;
+  MergeBySorting(chunks, &expected);
+  ASSERT_EQ(expected.size(), it.entry_count());
+  it.Sort();
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_FALSE(it.exhausted());
+    rime::shared_ptr<rime::DictEntry> e(it.Peek());
+    ASSERT_TRUE(e);
+    std::string comment(e->comment.empty() ? "~" : e->comment);
+    EXPECT_EQ(expected[i], e->text + comment);
+    it.Next();
+  }
+  EXPECT_TRUE(it.exhausted());
+}
@@ -79,3 +79,64 @@ TEST(RimeMenuTest, RecipeAlphaBeta) {
   scoped_ptr<Page> no_more_page(menu.CreatePage(5, 1));
   EXPECT_FALSE(no_more_page);
 }
+
+// offers a draft, to be refined in two steps
+class TranslationGamma : public Translation {
+ public:
+  TranslationGamma() : steps_(0) {
+    draft_ = boost::make_shared<SimpleCandidate>("gamma", 0, 5, "draft");
+  }
+
+  bool Next() {
+    if (exhausted())
+      return false;
+    set_exhausted(true);
+    return true;
+  }
+
+  shared_ptr<Candidate> Peek() {
+    if (exhausted())
+      return shared_ptr<Candidate>();
+    return draft_;
+  }
+
+  bool Refine(shared_ptr<Candidate> *draft, shared_ptr<Candidate> *refined) {
+    if (steps_ >= 2)
+      return false;
+    *draft = draft_;
+    draft_ = boost::make_shared<SimpleCandidate>("gamma", 0, 5,
+                                          ++steps_ < 2 ? "rough" : "fine");
+    *refined = draft_;
+    return true;
+  }
+
+ private:
+  shared_ptr<Candidate> draft_;
+  int steps_;
+};
+
+// marks the candidates, as a filter may have made new ones of them
+static void MarkCandidates(CandidateList *recruited,
+                           CandidateList *candidates) {
+  for (size_t i = 0; i < candidates->size(); ++i) {
+    shared_ptr<Candidate> &c((*candidates)[i]);
+    c = boost::make_shared<ShadowCandidate>(c, "marked", c->text() + "*");
+  }
+}
+
+TEST(RimeMenuTest, RefineDraftCandidate) {
+  Menu menu(&MarkCandidates);
+  menu.AddTranslation(make_shared<TranslationGamma>());
+  menu.AddTranslation(make_shared<TranslationBeta>());
+  ASSERT_EQ(4, menu.Prepare(5));
+  EXPECT_EQ("draft*", menu.GetCandidateAt(0)->text());
+  // the exhausted translation is refined all the same
+  EXPECT_TRUE(menu.Refine());
+  EXPECT_EQ("rough*", menu.GetCandidateAt(0)->text());
+  EXPECT_TRUE(menu.Refine());
+  EXPECT_FALSE(menu.Refine());
+  ASSERT_EQ(4, menu.candidate_count());
+  EXPECT_EQ("fine*", menu.GetCandidateAt(0)->text());
+  EXPECT_EQ("marked", menu.GetCandidateAt(0)->type());
+  EXPECT_EQ("Beta-1*", menu.GetCandidateAt(1)->text());
+}
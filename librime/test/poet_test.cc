@@ -0,0 +1,178 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <string>
+#include <gtest/gtest.h>
+#include <rime/common.h>
+#include <rime/algo/poet.h>
+#include <rime/dict/bigram_model.h>
+#include <rime/impl/translator_commons.h>
+
+static void AddWord(rime::WordGraph *graph, int start, size_t end,
+                    const std::string &text, double weight) {
+  rime::shared_ptr<rime::DictEntry> e(new rime::DictEntry);
+  e->text = text;
+  e->weight = weight;
+  (*graph)[start][end].push_back(e);
+}
+
+class RimePoetTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    AddWord(&graph_, 0, 1, "a", 0.5);
+    AddWord(&graph_, 0, 2, "AB", 0.6);
+    AddWord(&graph_, 0, 3, "ABC", 1.0);  // single word; not a sentence
+    AddWord(&graph_, 1, 2, "x", 0.9);
+    AddWord(&graph_, 1, 3, "bc", 0.4);
+    AddWord(&graph_, 2, 3, "c", 0.1);
+  }
+
+  rime::WordGraph graph_;
+};
+
+TEST_F(RimePoetTest, MakeSentence) {
+  rime::Poet<rime::Sentence> poet;
+  rime::shared_ptr<rime::Sentence> s = poet.MakeSentence(graph_, 3);
+  ASSERT_TRUE(s);
+  EXPECT_EQ("abc", s->text());
+  ASSERT_EQ(2, s->components().size());
+  ASSERT_EQ(2, s->syllable_lengths().size());
+  EXPECT_EQ(1, s->syllable_lengths()[0]);
+  EXPECT_EQ(2, s->syllable_lengths()[1]);
+  EXPECT_FALSE(poet.MakeSentence(graph_, 4));
+}
+
+TEST_F(RimePoetTest, KBestSentences) {
+  rime::Poet<rime::Sentence> poet;
+  rime::shared_ptr<rime::Sentence> best = poet.MakeSentence(graph_, 3);
+  ASSERT_TRUE(best);
+  const char *expected[] = { "abc", "ABc", "axc" };
+  double last_weight = best->weight();
+  for (size_t i = 0; i < 3; ++i) {
+    rime::shared_ptr<rime::Sentence> s = poet.NextSentence();
+    ASSERT_TRUE(s);
+    EXPECT_EQ(expected[i], s->text());
+    EXPECT_EQ(3, s->end());
+    EXPECT_GE(last_weight, s->weight());
+    last_weight = s->weight();
+  }
+  EXPECT_FALSE(poet.NextSentence());
+}
+
+TEST_F(RimePoetTest, WorkBudget) {
+  rime::Poet<rime::Sentence> poet;
+  // runs out of budget after the words at the first position
+  rime::shared_ptr<rime::Sentence> s = poet.MakeSentence(graph_, 3, 1);
+  ASSERT_TRUE(s);
+  EXPECT_FALSE(poet.finished());
+  EXPECT_EQ("ABc", s->text());
+  s = poet.Resume();
+  ASSERT_TRUE(s);
+  EXPECT_TRUE(poet.finished());
+  EXPECT_EQ("abc", s->text());
+}
+
+TEST_F(RimePoetTest, SentenceMemo) {
+  rime::SentenceMemo memo;
+  rime::shared_ptr<rime::WordGraph> graph(new rime::WordGraph(graph_));
+  rime::Poet<rime::Sentence> poet;
+  ASSERT_TRUE(poet.MakeSentence(*graph, 3, 0, &memo));
+  poet.Memorize(graph, &memo);
+  EXPECT_EQ(3, memo.settled_length);
+  // a syllable is typed
+  rime::shared_ptr<rime::WordGraph> next(new rime::WordGraph(graph_));
+  AddWord(next.get(), 2, 4, "cd", 0.5);
+  AddWord(next.get(), 3, 4, "d", 0.5);
+  rime::Poet<rime::Sentence> fresh;
+  ASSERT_TRUE(fresh.MakeSentence(*next, 4, 5));
+  EXPECT_FALSE(fresh.finished());
+  // the search resumes at the first changed word
+  rime::Poet<rime::Sentence> resumed;
+  rime::shared_ptr<rime::Sentence> s = resumed.MakeSentence(*next, 4, 5, &memo);
+  ASSERT_TRUE(s);
+  EXPECT_TRUE(resumed.finished());
+  EXPECT_EQ("ABCd", s->text());
+  EXPECT_EQ(fresh.Resume()->text(), s->text());
+  resumed.Memorize(next, &memo);
+  EXPECT_EQ(4, memo.settled_length);
+  // and is taken back
+  rime::Poet<rime::Sentence> undone;
+  s = undone.MakeSentence(*graph, 3, 0, &memo);
+  ASSERT_TRUE(s);
+  EXPECT_EQ("abc", s->text());
+}
+
+TEST_F(RimePoetTest, BigramModel) {
+  rime::bigram::Records records(1);
+  records[0].left = "AB";
+  records[0].right = "c";
+  records[0].factor = 4.0;
+  rime::shared_ptr<rime::BigramModel> model(
+      new rime::BigramModel("poet_test.bigram.bin"));
+  model->Remove();
+  ASSERT_TRUE(model->Build(records));
+  rime::Poet<rime::Sentence> poet;
+  poet.set_bigram_model(model);
+  rime::shared_ptr<rime::Sentence> s = poet.MakeSentence(graph_, 3);
+  ASSERT_TRUE(s);
+  EXPECT_EQ("ABc", s->text());
+  s = poet.NextSentence();
+  ASSERT_TRUE(s);
+  EXPECT_EQ("ABc", s->text());
+  model->Remove();
+}
+
+TEST_F(RimePoetTest, BigramFlipsHomophones) {
+  rime::WordGraph graph;
+  AddWord(&graph, 0, 1, "x", 0.6);
+  AddWord(&graph, 0, 1, "y", 0.5);  // a homophone of x
+  AddWord(&graph, 1, 2, "z", 0.5);
+  rime::Poet<rime::Sentence> poet;
+  rime::shared_ptr<rime::Sentence> s = poet.MakeSentence(graph, 2);
+  ASSERT_TRUE(s);
+  EXPECT_EQ("xz", s->text());
+  rime::bigram::Records records(1);
+  records[0].left = "y";
+  records[0].right = "z";
+  records[0].factor = 2.0;
+  rime::shared_ptr<rime::BigramModel> model(
+      new rime::BigramModel("poet_test.bigram.bin"));
+  model->Remove();
+  ASSERT_TRUE(model->Build(records));
+  poet.set_bigram_model(model);
+  s = poet.MakeSentence(graph, 2);
+  ASSERT_TRUE(s);
+  EXPECT_EQ("yz", s->text());
+  s = poet.NextSentence();
+  ASSERT_TRUE(s);
+  EXPECT_EQ("yz", s->text());
+  s = poet.NextSentence();
+  ASSERT_TRUE(s);
+  EXPECT_EQ("xz", s->text());
+  model->Remove();
+}
+
+TEST_F(RimePoetTest, RecallMissingWords) {
+  rime::SentenceMemo memo;
+  rime::shared_ptr<rime::WordGraph> graph(new rime::WordGraph(graph_));
+  rime::Poet<rime::Sentence> poet;
+  ASSERT_TRUE(poet.MakeSentence(*graph, 3, 0, &memo));
+  poet.Memorize(graph, &memo);
+  ASSERT_EQ(4, memo.nodes.size());
+  ASSERT_FALSE(memo.nodes[2].empty());
+  // words of the memo that the graph lacks are searched for again
+  memo.nodes[2][0].homophone = 1;
+  rime::Poet<rime::Sentence> recalled;
+  rime::shared_ptr<rime::Sentence> s = recalled.MakeSentence(*graph, 3, 0, &memo);
+  ASSERT_TRUE(s);
+  EXPECT_EQ("abc", s->text());
+  memo.nodes[1][0].start_pos = 5;
+  s = recalled.MakeSentence(*graph, 3, 0, &memo);
+  ASSERT_TRUE(s);
+  EXPECT_EQ("abc", s->text());
+}
@@ -0,0 +1,70 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <rime/common.h>
+#include <rime/dict/position_map.h>
+
+typedef rime::PositionMap<std::vector<std::string> > TestMap;
+
+TEST(RimePositionMapTest, OrderedByPosition) {
+  TestMap m;
+  m.reserve(8);
+  EXPECT_TRUE(m.empty());
+  m[5].push_back("five");
+  m[2].push_back("two");
+  m[7].push_back("seven");
+  EXPECT_EQ(3, m.size());
+  TestMap::iterator i = m.begin();
+  ASSERT_TRUE(i != m.end());
+  EXPECT_EQ(2, i->first);
+  EXPECT_EQ(5, (++i)->first);
+  EXPECT_EQ(7, (++i)->first);
+  EXPECT_TRUE(++i == m.end());
+  TestMap::reverse_iterator r = m.rbegin();
+  EXPECT_EQ(7, r->first);
+  EXPECT_EQ("seven", r->second.front());
+  EXPECT_EQ(5, (++r)->first);
+  EXPECT_TRUE(m.find(3) == m.end());
+  ASSERT_TRUE(m.find(5) != m.end());
+  EXPECT_EQ("five", m.find(5)->second.front());
+  EXPECT_EQ(5, m.upper_bound(2)->first);
+  EXPECT_TRUE(m.upper_bound(7) == m.end());
+  EXPECT_EQ(1, m.erase(5));
+  EXPECT_EQ(0, m.erase(5));
+  EXPECT_EQ(7, m.upper_bound(2)->first);
+  // grows beyond the reserved positions
+  m[20].push_back("twenty");
+  EXPECT_EQ(20, m.rbegin()->first);
+  EXPECT_EQ("seven", m.find(7)->second.front());
+}
+
+TEST(RimePositionMapTest, ClearedForReuse) {
+  TestMap m;
+  m[1].push_back("one");
+  m.clear();
+  EXPECT_TRUE(m.empty());
+  EXPECT_TRUE(m.begin() == m.end());
+  EXPECT_TRUE(m[1].empty());
+}
+
+TEST(RimePositionMapTest, RecycledByPool) {
+  rime::PositionMapPool<TestMap> pool(1);
+  rime::shared_ptr<TestMap> a = pool.Get();
+  (*a)[1].push_back("one");
+  rime::shared_ptr<TestMap> b = pool.Get();
+  EXPECT_NE(a, b);  // a is in use
+  TestMap *p = a.get();
+  a.reset();
+  b.reset();
+  rime::shared_ptr<TestMap> c = pool.Get();
+  EXPECT_EQ(p, c.get());
+  EXPECT_TRUE(c->empty());
+}
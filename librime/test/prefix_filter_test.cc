@@ -0,0 +1,48 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <string>
+#include <gtest/gtest.h>
+#include <rime/dict/prefix_filter.h>
+
+TEST(RimePrefixFilterTest, PrefixesOfAddedCodes) {
+  rime::PrefixFilter filter(2, 2);
+  EXPECT_FALSE(filter.ready());
+  EXPECT_TRUE(filter.MayContain("ab"));  // lets everything through
+  filter.Reset(2);
+  EXPECT_TRUE(filter.ready());
+  filter.Add("abcdef");
+  filter.Add("xy");
+  EXPECT_TRUE(filter.MayContain("ab"));
+  EXPECT_TRUE(filter.MayContain("abcd"));
+  EXPECT_TRUE(filter.MayContain("xy"));
+  // deeper than the filter goes
+  EXPECT_TRUE(filter.MayContain("abcdzz"));
+  EXPECT_FALSE(filter.full());
+}
+
+TEST(RimePrefixFilterTest, FewFalsePositives) {
+  rime::PrefixFilter filter(2, 1);
+  filter.Reset(500);
+  std::string code(2, '\0');
+  for (int i = 0; i < 500; ++i) {
+    code[0] = static_cast<char>(0x80 | (i >> 7));
+    code[1] = static_cast<char>(0x80 | (i & 0x7f));
+    filter.Add(code);
+  }
+  int false_positives = 0;
+  for (int i = 500; i < 10000; ++i) {
+    code[0] = static_cast<char>(0x80 | (i >> 7));
+    code[1] = static_cast<char>(0x80 | (i & 0x7f));
+    if (filter.MayContain(code))
+      ++false_positives;
+  }
+  EXPECT_GT(200, false_positives);  // around 1%
+  filter.Clear();
+  EXPECT_FALSE(filter.ready());
+}
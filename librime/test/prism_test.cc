@@ -94,3 +94,73 @@ TEST_F(RimePrismTest, ExpandSearch) {
   EXPECT_EQ(result[2].value, 3);  // goodbye
   EXPECT_EQ(result[2].length, 7);  // goodbye
 }
+
+class RimeDawgPrismTest : public RimePrismTest {
+ protected:
+  virtual void SetUp() {
+    RimePrismTest::SetUp();
+    dawg_prism_.reset(new Prism("dawg_prism_test.bin"));
+    dawg_prism_->Remove();
+    dawg_prism_->set_backend(Prism::kDawg);
+
+    std::set<std::string> keyset;
+    keyset.insert("google");
+    keyset.insert("good");
+    keyset.insert("goodbye");
+    keyset.insert("microsoft");
+    keyset.insert("macrosoft");
+    keyset.insert("adobe");
+    keyset.insert("yahoo");
+    keyset.insert("baidu");
+
+    dawg_prism_->Build(keyset);
+  }
+
+  scoped_ptr<Prism> dawg_prism_;
+};
+
+TEST_F(RimeDawgPrismTest, SaveAndLoad) {
+  EXPECT_TRUE(dawg_prism_->Save());
+
+  Prism test(dawg_prism_->file_name());
+  EXPECT_TRUE(test.Load());
+  EXPECT_EQ(Prism::kDawg, test.backend());
+  EXPECT_EQ(dawg_prism_->array_size(), test.array_size());
+
+  int value = -1;
+  EXPECT_TRUE(test.GetValue("goodbye", &value));
+  EXPECT_EQ(3, value);
+}
+
+TEST_F(RimeDawgPrismTest, AgreesWithDoubleArray) {
+  const char *inputs[] = {
+    "adobe", "baidu", "good", "goodbye", "google", "macrosoft",
+    "microsoft", "yahoo", "go", "goodbyes", "soft", "",
+  };
+  const size_t num_inputs = sizeof(inputs) / sizeof(inputs[0]);
+  for (size_t i = 0; i < num_inputs; ++i) {
+    std::string key(inputs[i]);
+    EXPECT_EQ(prism_->HasKey(key), dawg_prism_->HasKey(key));
+    int expected = -1, actual = -1;
+    EXPECT_EQ(prism_->GetValue(key, &expected),
+              dawg_prism_->GetValue(key, &actual));
+    EXPECT_EQ(expected, actual);
+
+    std::vector<Prism::Match> r1, r2;
+    prism_->CommonPrefixSearch(key, &r1);
+    dawg_prism_->CommonPrefixSearch(key, &r2);
+    ASSERT_EQ(r1.size(), r2.size());
+    for (size_t j = 0; j < r1.size(); ++j) {
+      EXPECT_EQ(r1[j].value, r2[j].value);
+      EXPECT_EQ(r1[j].length, r2[j].length);
+    }
+
+    prism_->ExpandSearch(key, &r1, 0);
+    dawg_prism_->ExpandSearch(key, &r2, 0);
+    ASSERT_EQ(r1.size(), r2.size());
+    for (size_t j = 0; j < r1.size(); ++j) {
+      EXPECT_EQ(r1[j].value, r2[j].value);
+      EXPECT_EQ(r1[j].length, r2[j].length);
+    }
+  }
+}
@@ -0,0 +1,112 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <string>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <rime/candidate.h>
+#include <rime/common.h>
+#include <rime/composition.h>
+#include <rime/config.h>
+#include <rime/context.h>
+#include <rime/engine.h>
+#include <rime/menu.h>
+#include <rime/schema.h>
+#include <rime/dict/dictionary.h>
+#include <rime/dict/dict_compiler.h>
+
+using namespace rime;
+
+class RimeR10nTranslatorTest : public ::testing::Test {
+ public:
+  virtual void SetUp() {
+    if (!boost::filesystem::exists("dictionary_test.table.bin") ||
+        !boost::filesystem::exists("dictionary_test.prism.bin")) {
+      Dictionary dict("dictionary_test",
+                      make_shared<Table>("dictionary_test.table.bin"),
+                      make_shared<Prism>("dictionary_test.prism.bin"));
+      DictCompiler dict_compiler(&dict);
+      dict_compiler.Compile("dictionary_test.yaml", "dictionary_test.yaml");
+    }
+  }
+
+ protected:
+  // an engine translating pinyin with dictionary_test, making sentences
+  // under the given work budget; 0 stands for no budget at all
+  static Engine* CreateEngine(int sentence_work_budget) {
+    Config *config = new Config;
+    ConfigListPtr segmentors = make_shared<ConfigList>();
+    segmentors->Append(make_shared<ConfigValue>("abc_segmentor"));
+    config->SetItem("engine/segmentors", segmentors);
+    ConfigListPtr translators = make_shared<ConfigList>();
+    translators->Append(make_shared<ConfigValue>("r10n_translator"));
+    config->SetItem("engine/translators", translators);
+    config->SetString("translator/dictionary", "dictionary_test");
+    config->SetBool("translator/enable_user_dict", false);
+    config->SetInt("translator/sentence_work_budget", sentence_work_budget);
+    return Engine::Create(new Schema("r10n_translator_test", config));
+  }
+
+  static shared_ptr<Candidate> FirstCandidate(Context *ctx) {
+    Composition *comp = ctx->composition();
+    if (comp->empty() || !comp->back().menu)
+      return shared_ptr<Candidate>();
+    return comp->back().menu->GetCandidateAt(0);
+  }
+};
+
+TEST_F(RimeR10nTranslatorTest, RefineComposition) {
+  // 我们现在工作
+  const std::string input("womenxianzaigongzuo");
+  scoped_ptr<Engine> unhurried(CreateEngine(0));
+  unhurried->context()->set_input(input);
+  shared_ptr<Candidate> best = FirstCandidate(unhurried->context());
+  ASSERT_TRUE(best);
+  EXPECT_EQ("sentence", best->type());
+  EXPECT_FALSE(unhurried->context()->RefineComposition());
+
+  scoped_ptr<Engine> engine(CreateEngine(1));
+  Context *ctx = engine->context();
+  ctx->set_input(input);
+  shared_ptr<Candidate> draft = FirstCandidate(ctx);
+  ASSERT_TRUE(draft);
+  EXPECT_EQ("sentence", draft->type());
+  // candidates after the draft have been offered, so that it is
+  // refined in the menu, not before it is offered
+  Menu *menu = ctx->composition()->back().menu.get();
+  size_t count = menu->Prepare(10);
+  ASSERT_LT(1, count);
+  int steps = 0;
+  while (ctx->RefineComposition()) {
+    ASSERT_GT(100, ++steps);
+  }
+  EXPECT_LT(0, steps);
+  shared_ptr<Candidate> refined = FirstCandidate(ctx);
+  ASSERT_TRUE(refined);
+  EXPECT_NE(draft, refined);
+  EXPECT_EQ(best->text(), refined->text());
+  EXPECT_EQ(count, menu->candidate_count());
+  // the refined text is offered only once
+  for (size_t i = 1; i < menu->candidate_count(); ++i) {
+    EXPECT_NE(refined->text(), menu->GetCandidateAt(i)->text());
+  }
+}
+
+TEST_F(RimeR10nTranslatorTest, SelectedDraftStaysTheSame) {
+  scoped_ptr<Engine> engine(CreateEngine(1));
+  Context *ctx = engine->context();
+  ctx->set_input("womenxianzaigongzuo");
+  shared_ptr<Candidate> draft = FirstCandidate(ctx);
+  ASSERT_TRUE(draft);
+  EXPECT_EQ("sentence", draft->type());
+  ASSERT_TRUE(ctx->Select(0));
+  Segment &seg(ctx->composition()->at(0));
+  ASSERT_LE(Segment::kSelected, seg.status);
+  EXPECT_FALSE(ctx->RefineComposition());
+  EXPECT_EQ(draft, seg.GetSelectedCandidate());
+}
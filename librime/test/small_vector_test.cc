@@ -0,0 +1,60 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <gtest/gtest.h>
+#include <rime/dict/small_vector.h>
+#include <rime/dict/vocabulary.h>
+
+typedef rime::SmallVector<int, 4> TestVector;
+
+TEST(RimeSmallVectorTest, GrowBeyondInlineStorage) {
+  TestVector v;
+  EXPECT_TRUE(v.empty());
+  EXPECT_EQ(4, v.capacity());
+  for (int i = 0; i < 10; ++i)
+    v.push_back(i);
+  ASSERT_EQ(10, v.size());
+  EXPECT_LE(10, v.capacity());
+  for (int i = 0; i < 10; ++i)
+    EXPECT_EQ(i, v[i]);
+  TestVector w(v);
+  v.resize(2);
+  EXPECT_EQ(10, w.size());
+  EXPECT_EQ(9, w.back());
+  w = v;
+  ASSERT_EQ(2, w.size());
+  EXPECT_EQ(1, w.back());
+}
+
+TEST(RimeSmallVectorTest, InsertAndErase) {
+  TestVector v(2, 7);
+  v.insert(v.begin(), 1);
+  v.insert(v.end(), v.begin(), v.end());  // appends a copy of itself
+  ASSERT_EQ(6, v.size());
+  const int expected[] = { 1, 7, 7, 1, 7, 7 };
+  for (size_t i = 0; i < v.size(); ++i)
+    EXPECT_EQ(expected[i], v[i]);
+  v.erase(v.begin() + 1, v.begin() + 3);
+  ASSERT_EQ(4, v.size());
+  EXPECT_EQ(1, v[1]);
+  v.pop_back();
+  EXPECT_EQ(7, *v.rbegin());
+}
+
+TEST(RimeSmallVectorTest, Code) {
+  rime::Code a;
+  a.push_back(1);
+  a.push_back(2);
+  rime::Code b(a);
+  EXPECT_TRUE(a == b);
+  b.push_back(0);
+  EXPECT_TRUE(a < b);
+  rime::Code index;
+  b.CreateIndex(&index);
+  EXPECT_EQ(3, index.size());  // kIndexCodeMaxLength
+}
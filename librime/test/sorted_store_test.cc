@@ -0,0 +1,209 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <gtest/gtest.h>
+#include <rime/common.h>
+#include <rime/dict/sorted_store.h>
+#include <rime/dict/user_db.h>
+
+static const char file_name[] = "sorted_store_test.bin";
+
+static void RemoveFiles() {
+  boost::filesystem::remove(file_name);
+  boost::filesystem::remove(std::string(file_name) + ".log");
+  boost::filesystem::remove(std::string(file_name) + ".old");
+  boost::filesystem::remove(std::string(file_name) + ".tmp");
+  boost::filesystem::remove(std::string(file_name) + ".snapshot");
+  boost::filesystem::remove(std::string(file_name) + ".snapshot.delta");
+}
+
+TEST(RimeSortedStoreTest, UpdateAndErase) {
+  RemoveFiles();
+  {
+    rime::SortedStore store;
+    ASSERT_TRUE(store.Open(file_name, false));
+    EXPECT_TRUE(rime::SortedTable::IsSortedTable(file_name));
+    EXPECT_TRUE(store.Set("abc", "ZYX"));
+    EXPECT_TRUE(store.Set("zyx", "CBA"));
+    EXPECT_TRUE(store.Set("zyx", "ABC"));
+    EXPECT_TRUE(store.Set("wvu", std::string("\0DEF", 4)));
+    EXPECT_TRUE(store.Remove("abc"));
+    EXPECT_FALSE(store.Remove("abc"));
+    EXPECT_TRUE(store.Close());
+  }
+  // the updates are replayed from the log
+  rime::SortedStore store;
+  ASSERT_TRUE(store.Open(file_name, true));
+  std::string value;
+  EXPECT_FALSE(store.Get("abc", &value));
+  EXPECT_TRUE(store.Get("zyx", &value));
+  EXPECT_EQ("ABC", value);
+  EXPECT_TRUE(store.Get("wvu", &value));
+  EXPECT_EQ(std::string("\0DEF", 4), value);
+  EXPECT_FALSE(store.Set("abc", "ZYX"));
+  store.Close();
+}
+
+TEST(RimeSortedStoreTest, CompactInTheBackground) {
+  RemoveFiles();
+  const int kNumRecords = 5000;
+  {
+    rime::SortedStore store;
+    ASSERT_TRUE(store.Open(file_name, false));
+    for (int i = 0; i < kNumRecords; ++i) {
+      std::string key(boost::lexical_cast<std::string>(10000 + i));
+      ASSERT_TRUE(store.Set(key, key));
+    }
+    for (int i = 0; i < kNumRecords; i += 2) {
+      std::string key(boost::lexical_cast<std::string>(10000 + i));
+      ASSERT_TRUE(store.Remove(key));
+    }
+    store.Close();
+  }
+  rime::SortedStore store;
+  ASSERT_TRUE(store.Open(file_name, false));
+  rime::scoped_ptr<rime::DbCursor> cursor(store.NewCursor());
+  ASSERT_TRUE(cursor);
+  std::string key, value;
+  int count = 0;
+  for (cursor->Jump(""); cursor->Get(&key, &value); cursor->Step()) {
+    EXPECT_EQ(boost::lexical_cast<std::string>(10001 + 2 * count), key);
+    EXPECT_EQ(key, value);
+    ++count;
+  }
+  EXPECT_EQ(kNumRecords / 2, count);
+  // the last record before an erased one
+  ASSERT_TRUE(cursor->JumpBack("10004"));
+  EXPECT_TRUE(cursor->GetKey(&key));
+  EXPECT_EQ("10003", key);
+  EXPECT_FALSE(cursor->JumpBack("10000"));
+  store.Close();
+}
+
+// waits for the compaction going on in the background
+class CompactionTestStore : public rime::SortedStore {
+ public:
+  bool compacting() const { return bool(frozen_); }
+  bool WaitForCompaction() { return FinishCompaction(true); }
+};
+
+TEST(RimeSortedStoreTest, RetryFailedCompaction) {
+  RemoveFiles();
+  // as many records as trigger a compaction
+  const int kMaxMemtableRecords = 2000;
+  CompactionTestStore store;
+  ASSERT_TRUE(store.Open(file_name, false));
+  // the new table cannot be written in place of a directory
+  boost::filesystem::create_directory(store.temp_file_name());
+  for (int i = 0; i < kMaxMemtableRecords; ++i) {
+    std::string key(boost::lexical_cast<std::string>(10000 + i));
+    ASSERT_TRUE(store.Set(key, key));
+  }
+  EXPECT_TRUE(store.compacting());
+  EXPECT_TRUE(store.WaitForCompaction());
+  EXPECT_FALSE(store.compacting());
+  // the records stay in the memtable, till as many again are added
+  EXPECT_TRUE(store.Set("abc", "ZYX"));
+  EXPECT_FALSE(store.compacting());
+  boost::filesystem::remove(store.temp_file_name());
+  // "abc" counts toward the next compaction, which is started by the last
+  // record added, not to be finished by another update before it is checked
+  for (int i = 0; i < kMaxMemtableRecords - 1; ++i) {
+    std::string key(boost::lexical_cast<std::string>(20000 + i));
+    ASSERT_TRUE(store.Set(key, key));
+  }
+  EXPECT_TRUE(store.compacting());
+  EXPECT_TRUE(store.WaitForCompaction());
+  std::string value;
+  EXPECT_TRUE(store.Get("10000", &value));
+  EXPECT_TRUE(store.Get("abc", &value));
+  EXPECT_TRUE(store.Get("21998", &value));
+  store.Close();
+}
+
+TEST(RimeSortedStoreTest, Snapshot) {
+  RemoveFiles();
+  std::string snapshot_file(std::string(file_name) + ".snapshot");
+  rime::SortedStore store;
+  ASSERT_TRUE(store.Open(file_name, false));
+  EXPECT_TRUE(store.Set("abc", "ZYX"));
+  EXPECT_TRUE(store.Set("zyx", "ABC"));
+  EXPECT_TRUE(store.DumpSnapshot(snapshot_file));
+  EXPECT_TRUE(store.Set("zyx", "CBA"));
+  EXPECT_TRUE(store.Remove("abc"));
+  EXPECT_TRUE(store.Set("wvu", "DEF"));
+  ASSERT_TRUE(store.LoadSnapshot(snapshot_file));
+  std::string value;
+  EXPECT_TRUE(store.Get("abc", &value));
+  EXPECT_EQ("ZYX", value);
+  EXPECT_TRUE(store.Get("zyx", &value));
+  EXPECT_EQ("ABC", value);
+  EXPECT_TRUE(store.Get("wvu", &value));
+  EXPECT_EQ("DEF", value);
+  store.Close();
+}
+
+TEST(RimeSortedStoreTest, RebuildFromSnapshot) {
+  RemoveFiles();
+  rime::TreeDb db(file_name, rime::kSortedEngine);
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("abc", "ZYX"));
+  EXPECT_TRUE(db.Backup());
+  EXPECT_TRUE(db.Update("abc", "CBA"));
+  EXPECT_TRUE(db.Update("zyx", "ABC"));
+  EXPECT_FALSE(db.Rebuild(db.snapshot_file_name()));
+  db.Close();
+  ASSERT_TRUE(db.Rebuild(db.snapshot_file_name()));
+  // the log of the replaced table is not replayed
+  ASSERT_TRUE(db.Open());
+  std::string value;
+  EXPECT_TRUE(db.Fetch("abc", &value));
+  EXPECT_EQ("ZYX", value);
+  EXPECT_FALSE(db.Fetch("zyx", &value));
+  db.Close();
+}
+
+TEST(RimeSortedStoreTest, OpenForWritingOnce) {
+  RemoveFiles();
+  rime::TreeDb db(file_name, rime::kSortedEngine);
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Backup());
+  // another process, or another db object, cannot write or replace it
+  rime::TreeDb other(file_name, rime::kSortedEngine);
+  EXPECT_FALSE(other.Open());
+  EXPECT_FALSE(other.Rebuild(db.snapshot_file_name()));
+  EXPECT_TRUE(other.OpenReadOnly());
+  other.Close();
+  db.Close();
+  EXPECT_TRUE(other.Open());
+  other.Close();
+}
+
+TEST(RimeSortedStoreTest, ConvertFromKyotoCabinet) {
+  RemoveFiles();
+  {
+    rime::TreeDb db(file_name, rime::kKyotoCabinetEngine);
+    ASSERT_TRUE(db.Open());
+    EXPECT_TRUE(db.Update("abc", "ZYX"));
+    EXPECT_TRUE(db.Update("zyx", "ABC"));
+    db.Close();
+  }
+  EXPECT_FALSE(rime::SortedTable::IsSortedTable(file_name));
+  rime::TreeDb db(file_name, rime::kSortedEngine);
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(rime::SortedTable::IsSortedTable(file_name));
+  std::string value;
+  EXPECT_TRUE(db.Fetch("abc", &value));
+  EXPECT_EQ("ZYX", value);
+  EXPECT_TRUE(db.Fetch("zyx", &value));
+  EXPECT_EQ("ABC", value);
+  db.Close();
+  RemoveFiles();
+}
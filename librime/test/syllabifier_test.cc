@@ -13,6 +13,7 @@
 #include <vector>
 #include <gtest/gtest.h>
 #include <rime/dict/prism.h>
+#include <rime/algo/fuzzy.h>
 #include <rime/algo/syllabifier.h>
 
 class RimeSyllabifierTest : public ::testing::Test {
@@ -49,6 +50,14 @@ class RimeSyllabifierTest : public ::testing::Test {
   boost::scoped_ptr<rime::Prism> prism_;
 };
 
+static size_t NumSpellings(const rime::SyllableGraph &g,
+                           size_t start, size_t end) {
+  const rime::SyllableEdge *e = g.FindEdge(start, end);
+  if (!e) return 0;
+  size_t k = e - &g.edges[0];
+  return g.spellings_end(k) - g.spellings_begin(k);
+}
+
 TEST_F(RimeSyllabifierTest, CaseAlpha) {
   rime::Syllabifier s;
   rime::SyllableGraph g;
@@ -56,14 +65,15 @@ TEST_F(RimeSyllabifierTest, CaseAlpha) {
   s.BuildSyllableGraph(input, *prism_, &g);
   EXPECT_EQ(input.length(), g.input_length);
   EXPECT_EQ(input.length(), g.interpreted_length);
-  EXPECT_EQ(2, g.vertices.size());
-  ASSERT_FALSE(g.vertices.end() == g.vertices.find(1));
+  EXPECT_EQ(2, g.num_vertices());
+  ASSERT_TRUE(g.HasVertex(1));
   EXPECT_EQ(rime::kNormalSpelling, g.vertices[1]);
-  rime::SpellingMap &sp(g.edges[0][1]);
-  EXPECT_EQ(1, sp.size());
-  ASSERT_FALSE(sp.end() == sp.find(syllable_id_["a"]));
-  EXPECT_EQ(rime::kNormalSpelling, sp[0].type);
-  EXPECT_EQ(1.0, sp[0].credibility);
+  EXPECT_EQ(1, NumSpellings(g, 0, 1));
+  const rime::SpellingProperties *props =
+      g.FindSpelling(0, 1, syllable_id_["a"]);
+  ASSERT_FALSE(NULL == props);
+  EXPECT_EQ(rime::kNormalSpelling, props->type);
+  EXPECT_EQ(1.0, props->credibility);
 }
 
 TEST_F(RimeSyllabifierTest, CaseFailure) {
@@ -73,13 +83,12 @@ TEST_F(RimeSyllabifierTest, CaseFailure) {
   s.BuildSyllableGraph(input, *prism_, &g);
   EXPECT_EQ(input.length(), g.input_length);
   EXPECT_EQ(input.length() - 1, g.interpreted_length);
-  EXPECT_EQ(2, g.vertices.size());
-  ASSERT_TRUE(g.vertices.end() == g.vertices.find(1));
-  ASSERT_FALSE(g.vertices.end() == g.vertices.find(2));
+  EXPECT_EQ(2, g.num_vertices());
+  ASSERT_FALSE(g.HasVertex(1));
+  ASSERT_TRUE(g.HasVertex(2));
   EXPECT_EQ(rime::kNormalSpelling, g.vertices[2]);
-  rime::SpellingMap &sp(g.edges[0][2]);
-  EXPECT_EQ(1, sp.size());
-  ASSERT_FALSE(sp.end() == sp.find(syllable_id_["an"]));
+  EXPECT_EQ(1, NumSpellings(g, 0, 2));
+  ASSERT_FALSE(NULL == g.FindSpelling(0, 2, syllable_id_["an"]));
 }
 
 TEST_F(RimeSyllabifierTest, CaseChangan) {
@@ -89,30 +98,27 @@ TEST_F(RimeSyllabifierTest, CaseChangan) {
   s.BuildSyllableGraph(input, *prism_, &g);
   EXPECT_EQ(input.length(), g.input_length);
   EXPECT_EQ(input.length(), g.interpreted_length);
-  EXPECT_EQ(4, g.vertices.size());
+  EXPECT_EQ(4, g.num_vertices());
   // not c'han'gan or c'hang'an
-  EXPECT_TRUE(g.vertices.end() == g.vertices.find(1));
-  ASSERT_FALSE(g.vertices.end() == g.vertices.find(4));
-  ASSERT_FALSE(g.vertices.end() == g.vertices.find(5));
+  EXPECT_FALSE(g.HasVertex(1));
+  ASSERT_TRUE(g.HasVertex(4));
+  ASSERT_TRUE(g.HasVertex(5));
   EXPECT_EQ(rime::kNormalSpelling, g.vertices[4]);
   EXPECT_EQ(rime::kNormalSpelling, g.vertices[5]);
   // chan, chang but not cha
-  rime::EndVertexMap &e0(g.edges[0]);
-  EXPECT_EQ(2, e0.size());
-  ASSERT_FALSE(e0.end() == e0.find(4));
-  ASSERT_FALSE(e0.end() == e0.find(5));
-  EXPECT_FALSE(e0[4].end() == e0[4].find(syllable_id_["chan"]));
-  EXPECT_FALSE(e0[5].end() == e0[5].find(syllable_id_["chang"]));
+  EXPECT_EQ(2, g.num_edges(0));
+  ASSERT_FALSE(NULL == g.FindEdge(0, 4));
+  ASSERT_FALSE(NULL == g.FindEdge(0, 5));
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 4, syllable_id_["chan"]));
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 5, syllable_id_["chang"]));
   // gan$
-  rime::EndVertexMap &e4(g.edges[4]);
-  EXPECT_EQ(1, e4.size());
-  ASSERT_FALSE(e4.end() == e4.find(7));
-  EXPECT_FALSE(e4[7].end() == e4[7].find(syllable_id_["gan"]));
+  EXPECT_EQ(1, g.num_edges(4));
+  ASSERT_FALSE(NULL == g.FindEdge(4, 7));
+  EXPECT_FALSE(NULL == g.FindSpelling(4, 7, syllable_id_["gan"]));
   // an$
-  rime::EndVertexMap &e5(g.edges[5]);
-  EXPECT_EQ(1, e5.size());
-  ASSERT_FALSE(e5.end() == e5.find(7));
-  EXPECT_FALSE(e5[7].end() == e5[7].find(syllable_id_["an"]));
+  EXPECT_EQ(1, g.num_edges(5));
+  ASSERT_FALSE(NULL == g.FindEdge(5, 7));
+  EXPECT_FALSE(NULL == g.FindSpelling(5, 7, syllable_id_["an"]));
 }
 
 TEST_F(RimeSyllabifierTest, CaseTuan) {
@@ -122,23 +128,21 @@ TEST_F(RimeSyllabifierTest, CaseTuan) {
   s.BuildSyllableGraph(input, *prism_, &g);
   EXPECT_EQ(input.length(), g.input_length);
   EXPECT_EQ(input.length(), g.interpreted_length);
-  EXPECT_EQ(3, g.vertices.size());
+  EXPECT_EQ(3, g.num_vertices());
   // both tu'an and tuan
-  ASSERT_FALSE(g.vertices.end() == g.vertices.find(2));
-  ASSERT_FALSE(g.vertices.end() == g.vertices.find(4));
+  ASSERT_TRUE(g.HasVertex(2));
+  ASSERT_TRUE(g.HasVertex(4));
   EXPECT_EQ(rime::kAmbiguousSpelling, g.vertices[2]);
   EXPECT_EQ(rime::kNormalSpelling, g.vertices[4]);
-  rime::EndVertexMap &e0(g.edges[0]);
-  EXPECT_EQ(2, e0.size());
-  ASSERT_FALSE(e0.end() == e0.find(2));
-  ASSERT_FALSE(e0.end() == e0.find(4));
-  EXPECT_FALSE(e0[2].end() == e0[2].find(syllable_id_["tu"]));
-  EXPECT_FALSE(e0[4].end() == e0[4].find(syllable_id_["tuan"]));
+  EXPECT_EQ(2, g.num_edges(0));
+  ASSERT_FALSE(NULL == g.FindEdge(0, 2));
+  ASSERT_FALSE(NULL == g.FindEdge(0, 4));
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 2, syllable_id_["tu"]));
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 4, syllable_id_["tuan"]));
   // an$
-  rime::EndVertexMap &e2(g.edges[2]);
-  EXPECT_EQ(1, e2.size());
-  ASSERT_FALSE(e2.end() == e2.find(4));
-  EXPECT_FALSE(e2[4].end() == e2[4].find(syllable_id_["an"]));
+  EXPECT_EQ(1, g.num_edges(2));
+  ASSERT_FALSE(NULL == g.FindEdge(2, 4));
+  EXPECT_FALSE(NULL == g.FindSpelling(2, 4, syllable_id_["an"]));
 }
 
 TEST_F(RimeSyllabifierTest, CaseChainingAmbiguity) {
@@ -148,7 +152,7 @@ TEST_F(RimeSyllabifierTest, CaseChainingAmbiguity) {
   s.BuildSyllableGraph(input, *prism_, &g);
   EXPECT_EQ(input.length(), g.input_length);
   EXPECT_EQ(input.length(), g.interpreted_length);
-  EXPECT_EQ(input.length() + 1, g.vertices.size());
+  EXPECT_EQ(input.length() + 1, g.num_vertices());
 }
 
 TEST_F(RimeSyllabifierTest, TransposedSyllableGraph) {
@@ -156,11 +160,214 @@ TEST_F(RimeSyllabifierTest, TransposedSyllableGraph) {
   rime::SyllableGraph g;
   const std::string input("changan");
   s.BuildSyllableGraph(input, *prism_, &g);
-  ASSERT_FALSE(g.indices.end() == g.indices.find(0));
-  EXPECT_EQ(2, g.indices[0].size());
-  EXPECT_FALSE(g.indices[0].end() == g.indices[0].find(syllable_id_["chan"]));
-  EXPECT_FALSE(g.indices[0].end() == g.indices[0].find(syllable_id_["chang"]));
-  ASSERT_EQ(1, g.indices[0][syllable_id_["chan"]].size());
-  ASSERT_FALSE(NULL == g.indices[0][syllable_id_["chan"]][0]);
-  EXPECT_EQ(4, g.indices[0][syllable_id_["chan"]][0]->end_pos);
+  ASSERT_EQ(2, g.index_end(0) - g.index_begin(0));
+  // ordered by syllable id
+  const rime::SyllableSpelling &chan(g.indexed_spelling(g.index_begin(0)));
+  const rime::SyllableSpelling &chang(g.indexed_spelling(g.index_begin(0) + 1));
+  EXPECT_EQ(syllable_id_["chan"], chan.syllable_id);
+  EXPECT_EQ(syllable_id_["chang"], chang.syllable_id);
+  EXPECT_EQ(4, chan.properties.end_pos);
+  EXPECT_EQ(5, chang.properties.end_pos);
+}
+
+TEST_F(RimeSyllabifierTest, CaseFuzzySpelling) {
+  rime::FuzzyMatcher fuzzy;
+  ASSERT_TRUE(fuzzy.AddRule("fuzz/^ch/c/"));
+  ASSERT_TRUE(fuzzy.AddRule("fuzz/ng$/n/"));
+  rime::Syllabifier s;
+  s.set_fuzzy_matcher(&fuzzy);
+  rime::SyllableGraph g;
+  const std::string input("canhan");
+  s.BuildSyllableGraph(input, *prism_, &g);
+  EXPECT_EQ(input.length(), g.input_length);
+  EXPECT_EQ(input.length(), g.interpreted_length);
+  EXPECT_EQ(3, g.num_vertices());
+  EXPECT_EQ(1, g.num_edges(0));
+  EXPECT_EQ(2, NumSpellings(g, 0, 3));
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 3, syllable_id_["chan"]));
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 3, syllable_id_["chang"]));
+  EXPECT_EQ(1, g.num_edges(3));
+  EXPECT_EQ(2, NumSpellings(g, 3, 6));
+  EXPECT_FALSE(NULL == g.FindSpelling(3, 6, syllable_id_["han"]));
+  EXPECT_FALSE(NULL == g.FindSpelling(3, 6, syllable_id_["hang"]));
+}
+
+TEST_F(RimeSyllabifierTest, CaseFuzzySyllableInitial) {
+  rime::FuzzyMatcher fuzzy;
+  ASSERT_TRUE(fuzzy.AddRule("fuzz/^h/g/"));
+  rime::Syllabifier s;
+  s.set_fuzzy_matcher(&fuzzy);
+  rime::SyllableGraph g;
+  s.BuildSyllableGraph("gang", *prism_, &g);
+  EXPECT_EQ(4, g.interpreted_length);
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 4, syllable_id_["hang"]));
+  // 'h' in 'chang' is not a syllable initial
+  rime::SyllableGraph g2;
+  s.BuildSyllableGraph("cgang", *prism_, &g2);
+  EXPECT_EQ(0, g2.interpreted_length);
+}
+
+TEST_F(RimeSyllabifierTest, CaseFuzzySpellingType) {
+  rime::FuzzyMatcher fuzzy;
+  ASSERT_TRUE(fuzzy.AddRule("fuzz/^ch/c/"));
+  ASSERT_TRUE(fuzzy.AddRule("fuzz/ng$/n/"));
+  rime::Syllabifier s;
+  s.set_fuzzy_matcher(&fuzzy);
+  rime::SyllableGraph g;
+  s.BuildSyllableGraph("canhan", *prism_, &g);
+  const rime::SpellingProperties *props =
+      g.FindSpelling(0, 3, syllable_id_["chan"]);
+  ASSERT_FALSE(NULL == props);
+  EXPECT_EQ(rime::kFuzzySpelling, props->type);
+  EXPECT_DOUBLE_EQ(0.5, props->credibility);
+  EXPECT_EQ(rime::kFuzzySpelling, g.vertices[3]);
+  props = g.FindSpelling(3, 6, syllable_id_["han"]);
+  ASSERT_FALSE(NULL == props);
+  EXPECT_EQ(rime::kNormalSpelling, props->type);
+  EXPECT_DOUBLE_EQ(1.0, props->credibility);
+  props = g.FindSpelling(3, 6, syllable_id_["hang"]);
+  ASSERT_FALSE(NULL == props);
+  EXPECT_EQ(rime::kFuzzySpelling, props->type);
+  // a fuzzy spelling gives way to an exact one
+  rime::SyllableGraph g2;
+  s.BuildSyllableGraph("han", *prism_, &g2);
+  EXPECT_EQ(1, NumSpellings(g2, 0, 3));
+  EXPECT_FALSE(NULL == g2.FindSpelling(0, 3, syllable_id_["han"]));
+}
+
+static bool SameSyllableGraph(const rime::SyllableGraph &g1,
+                              const rime::SyllableGraph &g2) {
+  if (g1.input_length != g2.input_length ||
+      g1.interpreted_length != g2.interpreted_length ||
+      g1.vertices != g2.vertices ||
+      g1.edge_offsets != g2.edge_offsets ||
+      g1.spelling_offsets != g2.spelling_offsets ||
+      g1.index_offsets != g2.index_offsets ||
+      g1.index != g2.index)
+    return false;
+  for (size_t i = 0; i < g1.edges.size(); ++i) {
+    if (g1.edges[i].start != g2.edges[i].start ||
+        g1.edges[i].end != g2.edges[i].end)
+      return false;
+  }
+  for (size_t i = 0; i < g1.spellings.size(); ++i) {
+    const rime::SyllableSpelling &x(g1.spellings[i]);
+    const rime::SyllableSpelling &y(g2.spellings[i]);
+    if (x.syllable_id != y.syllable_id ||
+        x.properties.type != y.properties.type ||
+        x.properties.end_pos != y.properties.end_pos)
+      return false;
+  }
+  return true;
+}
+
+TEST_F(RimeSyllabifierTest, IncrementalSyllableGraph) {
+  const char *inputs[] = {
+    "c", "ch", "cha", "chan", "chang", "changa", "changan", "changant",
+    "changantu", "changantua", "changantuan", "changantua", "changan",
+    "changan", "changnan", "ch'ang", "ch'", "tuan", "tuant", "tuantu",
+    "tuantuan", "tuantuanchan", "tuantuancha", "tuantuanchang", "tuantuancan",
+    "tuantuanc", "tuanchang'an", "tuanchang'a", "tuanchang'",
+  };
+  rime::Syllabifier incremental("'", true);
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+    rime::SyllableGraph g1, g2;
+    incremental.BuildSyllableGraph(inputs[i], *prism_, &g1);
+    rime::Syllabifier("'", true).BuildSyllableGraph(inputs[i], *prism_, &g2);
+    EXPECT_TRUE(SameSyllableGraph(g1, g2)) << "input: " << inputs[i];
+  }
+}
+
+TEST_F(RimeSyllabifierTest, ReloadedPrism) {
+  rime::Syllabifier s;
+  rime::SyllableGraph g;
+  s.BuildSyllableGraph("tuan", *prism_, &g);
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 4, syllable_id_["tuan"]));
+  // the prism file is rebuilt without "tuan", and loaded again in place
+  prism_->Close();
+  {
+    std::set<std::string> keyset;
+    keyset.insert("an");  // 0 == id
+    keyset.insert("tu");  // 1
+    rime::Prism prism("syllabifier_test.bin");
+    ASSERT_TRUE(prism.Build(keyset));
+    ASSERT_TRUE(prism.Save());
+  }
+  ASSERT_TRUE(prism_->Load());
+  s.BuildSyllableGraph("tuan", *prism_, &g);
+  EXPECT_EQ(4, g.interpreted_length);
+  EXPECT_EQ(1, NumSpellings(g, 0, 2));
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 2, 1));
+  EXPECT_FALSE(NULL == g.FindSpelling(2, 4, 0));
+  EXPECT_TRUE(NULL == g.FindEdge(0, 4));
+}
+
+class CountingSyllabifier : public rime::Syllabifier {
+ public:
+  CountingSyllabifier() : rime::Syllabifier("'") {}
+  // number of prism lookups done for the last input
+  size_t num_explored() const {
+    size_t count = 0;
+    for (size_t i = 0; i < explored_.size(); ++i) {
+      if (explored_[i].explored)
+        ++count;
+    }
+    return count;
+  }
+};
+
+TEST_F(RimeSyllabifierTest, BoundedEdgesPerVertex) {
+  CountingSyllabifier s;
+  s.set_max_edges_per_vertex(1);
+  rime::SyllableGraph g;
+  const std::string input("changan");
+  s.BuildSyllableGraph(input, *prism_, &g);
+  EXPECT_EQ(input.length(), g.interpreted_length);
+  // chang'an is kept; chan'gan is not
+  EXPECT_EQ(1, g.num_edges(0));
+  EXPECT_FALSE(NULL == g.FindSpelling(0, 5, syllable_id_["chang"]));
+  for (size_t i = 0; i <= input.length(); ++i) {
+    EXPECT_GE(1, g.index_end(i) - g.index_begin(i));
+  }
+}
+
+TEST_F(RimeSyllabifierTest, BoundedTotalEdges) {
+  CountingSyllabifier s;
+  s.set_max_total_edges(20);
+  rime::SyllableGraph g;
+  std::string input;
+  for (int i = 0; i < 100; ++i)
+    input += "tuan";
+  s.BuildSyllableGraph(input, *prism_, &g);
+  EXPECT_EQ(input.length(), g.input_length);
+  EXPECT_LT(0, g.interpreted_length);
+  EXPECT_GT(input.length(), g.interpreted_length);
+  EXPECT_GE(20, g.spellings.size());
+  EXPECT_GE(20, s.num_explored());
+}
+
+TEST_F(RimeSyllabifierTest, BoundedInputLength) {
+  CountingSyllabifier s;
+  s.set_max_total_edges(0);
+  s.set_max_input_length(64);
+  rime::SyllableGraph g;
+  std::string input;
+  for (int i = 0; i < 500; ++i)
+    input += "an";
+  s.BuildSyllableGraph(input, *prism_, &g);
+  EXPECT_EQ(input.length(), g.input_length);
+  EXPECT_EQ(64, g.interpreted_length);
+  EXPECT_GE(64 + 1, s.num_explored());
+  EXPECT_GE(64 * 2, g.spellings.size());
+}
+
+TEST_F(RimeSyllabifierTest, SyllableGraphCache) {
+  rime::SyllableGraphCache cache;
+  EXPECT_FALSE(cache.Find(prism_.get(), 0, 7));
+  rime::shared_ptr<rime::SyllableGraph> g(new rime::SyllableGraph);
+  rime::Syllabifier().BuildSyllableGraph("changan", *prism_, g.get());
+  cache.Add(prism_.get(), 0, 7, g);
+  EXPECT_EQ(g, cache.Find(prism_.get(), 0, 7));
+  EXPECT_FALSE(cache.Find(prism_.get(), 0, 5));
+  EXPECT_FALSE(cache.Find(NULL, 0, 7));
 }
@@ -6,8 +6,10 @@
 //
 // 2011-07-03 GONG Chen <chen.sst@gmail.com>
 //
+#include <boost/foreach.hpp>
 #include <gtest/gtest.h>
 #include <rime/algo/syllabifier.h>
+#include <rime/dict/prism.h>
 #include <rime/dict/table.h>
 
 
@@ -159,26 +161,26 @@ TEST_F(RimeTableTest, SimpleQuery) {
 
 TEST_F(RimeTableTest, QueryWithSyllableGraph) {
   const std::string input("yiersansi");
+  // yi'er'san'si, a syllable on each edge
+  const size_t kVertices[] = {0, 2, 4, 7, 9};
   rime::SyllableGraph g;
-  g.input_length = input.length();
-  g.interpreted_length = g.input_length;
+  g.input_length = g.interpreted_length = input.length();
+  g.vertices.resize(input.length() + 1, rime::kInvalidSpelling);
+  g.edge_offsets.resize(input.length() + 2, 0);
+  g.spelling_offsets.push_back(0);
   g.vertices[0] = rime::kNormalSpelling;
-  g.vertices[2] = rime::kNormalSpelling;
-  g.vertices[4] = rime::kNormalSpelling;
-  g.vertices[7] = rime::kNormalSpelling;
-  g.vertices[9] = rime::kNormalSpelling;
-  g.edges[0][2][1].type = rime::kNormalSpelling;
-  g.edges[0][2][1].end_pos = 2;
-  g.edges[2][4][2].type = rime::kNormalSpelling;
-  g.edges[2][4][2].end_pos = 4;
-  g.edges[4][7][3].type = rime::kNormalSpelling;
-  g.edges[4][7][3].end_pos = 7;
-  g.edges[7][9][4].type = rime::kNormalSpelling;
-  g.edges[7][9][4].end_pos = 9;
-  g.indices[0][1].push_back(&g.edges[0][2][1]);
-  g.indices[2][2].push_back(&g.edges[2][4][2]);
-  g.indices[4][3].push_back(&g.edges[4][7][3]);
-  g.indices[7][4].push_back(&g.edges[7][9][4]);
+  for (size_t i = 1; i < 5; ++i) {
+    g.vertices[kVertices[i]] = rime::kNormalSpelling;
+    rime::SpellingProperties props;
+    props.end_pos = kVertices[i];
+    g.edges.push_back(rime::SyllableEdge(kVertices[i - 1], kVertices[i]));
+    g.spellings.push_back(rime::SyllableSpelling(i, props));
+    g.spelling_offsets.push_back(g.spellings.size());
+    // counts the edge as starting before any later position
+    for (size_t j = kVertices[i - 1] + 1; j < g.edge_offsets.size(); ++j)
+      ++g.edge_offsets[j];
+  }
+  g.Transpose();
 
   rime::TableQueryResult result;
   ASSERT_TRUE(table_->Query(g, 0, &result));
@@ -205,4 +207,55 @@ TEST_F(RimeTableTest, QueryWithSyllableGraph) {
   EXPECT_TRUE(result[4].front().Next());
   EXPECT_STREQ("lia", result[4].front().entry()->text.c_str());
   EXPECT_FALSE(result[4].front().Next());
+
+  // a single traversal from all vertices finds the same
+  rime::TableQueryLattice lattice;
+  ASSERT_TRUE(table_->Query(g, &lattice));
+  for (size_t start = 0; start < input.length(); ++start) {
+    rime::TableQueryResult expected;
+    if (!table_->Query(g, start, &expected)) {
+      EXPECT_TRUE(lattice.find(start) == lattice.end());
+      continue;
+    }
+    ASSERT_TRUE(lattice.find(start) != lattice.end());
+    rime::TableQueryResult &r(lattice[start]);
+    ASSERT_EQ(expected.size(), r.size());
+    BOOST_FOREACH(rime::TableQueryResult::value_type &x, expected) {
+      ASSERT_EQ(x.second.size(), r[x.first].size());
+      for (size_t i = 0; i < x.second.size(); ++i) {
+        EXPECT_EQ(x.second[i].entry(), r[x.first][i].entry());
+      }
+    }
+  }
+}
+
+TEST_F(RimeTableTest, QueryBoundedSyllableGraph) {
+  rime::Prism prism("table_test.prism.bin");
+  rime::Syllabary syllabary;
+  for (int i = 0; i < 5; ++i)
+    syllabary.insert(table_->GetSyllableById(i));
+  ASSERT_TRUE(prism.Build(syllabary));
+  std::string input;
+  for (int i = 0; i < 200; ++i)
+    input += "1232";
+  rime::Syllabifier s;
+  s.set_max_total_edges(20);
+  rime::SyllableGraph g;
+  s.BuildSyllableGraph(input, prism, &g);
+  ASSERT_LT(0, g.interpreted_length);
+  ASSERT_GE(20, g.spellings.size());
+  rime::TableQueryLattice lattice;
+  ASSERT_TRUE(table_->Query(g, &lattice));
+  // a walk from each spelling goes no deeper than the table's index
+  size_t num_accessors = 0;
+  BOOST_FOREACH(const rime::TableQueryLattice::value_type &r, lattice) {
+    EXPECT_GT(g.interpreted_length, r.first);
+    BOOST_FOREACH(const rime::TableQueryResult::value_type &x, r.second) {
+      EXPECT_GE(g.interpreted_length, x.first);
+      num_accessors += x.second.size();
+    }
+  }
+  EXPECT_LT(0, num_accessors);
+  EXPECT_GE((rime::Code::kIndexCodeMaxLength + 1) * g.spellings.size(),
+            num_accessors);
 }
@@ -6,9 +6,20 @@
 //
 // 2011-07-03 GONG Chen <chen.sst@gmail.com>
 //
+#include <fstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/lexical_cast.hpp>
 #include <gtest/gtest.h>
+#include <rime/deployer.h>
 #include <rime/algo/syllabifier.h>
+#include <rime/dict/dictionary.h>
+#include <rime/dict/dict_compiler.h>
 #include <rime/dict/user_db.h>
+#include <rime/dict/user_dictionary.h>
+#include <rime/expl/user_dict_manager.h>
 
 TEST(RimeUserDbTest, AccessRecordByKey) {
   rime::UserDb db("user_db_test");
@@ -84,3 +95,613 @@ TEST(RimeUserDbTest, Query) {
   }
   db.Close();
 }
+
+TEST(RimeUserDbTest, PackValues) {
+  std::string value(rime::UserDictionary::PackValues(-3, 0.25, 12345678901ULL));
+  EXPECT_EQ(17, value.length());
+  int c = 0;
+  double d = 0.0;
+  rime::TickCount t = 0;
+  ASSERT_TRUE(rime::UserDictionary::UnpackValues(value, &c, &d, &t));
+  EXPECT_EQ(-3, c);
+  EXPECT_EQ(0.25, d);
+  EXPECT_EQ(12345678901ULL, t);
+  // text records written by earlier versions
+  ASSERT_TRUE(rime::UserDictionary::UnpackValues("c=5 d=1.5 t=42", &c, &d, &t));
+  EXPECT_EQ(5, c);
+  EXPECT_EQ(1.5, d);
+  EXPECT_EQ(42, t);
+}
+
+TEST(RimeUserDbTest, PackKeys) {
+  rime::Syllabary syllabary;
+  syllabary.insert("a");
+  syllabary.insert("ab");
+  syllabary.insert("b");
+  rime::UserDbSyllabary s;
+  s.Assign(syllabary);
+  std::string a_b, ab, spelled;
+  ASSERT_TRUE(s.PackKey("a b \tAB", &a_b));
+  ASSERT_TRUE(s.PackKey("ab \tAb", &ab));
+  EXPECT_EQ(7, a_b.length());
+  EXPECT_TRUE(rime::UserDbSyllabary::IsPackedKey(a_b));
+  EXPECT_FALSE(rime::UserDbSyllabary::IsPackedKey("a b \tAB"));
+  // in the same order as spelled keys
+  EXPECT_LT(a_b, ab);
+  EXPECT_EQ(4, a_b.find('\t'));
+  ASSERT_TRUE(s.SpellKey(a_b, &spelled));
+  EXPECT_EQ("a b \tAB", spelled);
+  EXPECT_FALSE(s.PackKey("c \tC", &spelled));
+  // ids of a rebuilt syllabary
+  syllabary.insert("aa");
+  rime::UserDbSyllabary t;
+  t.Assign(syllabary);
+  EXPECT_TRUE(s != t);
+  std::string repacked;
+  ASSERT_TRUE(t.PackKey("a b \tAB", &repacked));
+  EXPECT_NE(a_b, repacked);
+}
+
+TEST(RimeUserDbTest, WriteBehind) {
+  rime::UserDb db("user_db_test");
+  if (db.Exists())
+    db.Remove();
+  db.EnableWriteBehind();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a", "1"));
+  EXPECT_TRUE(db.Update("c", "3"));
+  EXPECT_TRUE(db.Flush());
+  EXPECT_TRUE(db.Update("b", "2"));
+  EXPECT_TRUE(db.Update("c", "33"));
+  std::string key, value;
+  EXPECT_TRUE(db.Fetch("b", &value));
+  EXPECT_EQ("2", value);
+  {
+    // pending updates are merged into query results
+    boost::shared_ptr<rime::UserDbAccessor> accessor = db.Query("");
+    ASSERT_TRUE(accessor);
+    accessor->Forward("a");
+    const char *expected[][2] = { {"a", "1"}, {"b", "2"}, {"c", "33"} };
+    for (int i = 0; i < 3; ++i) {
+      ASSERT_TRUE(accessor->GetNextRecord(&key, &value));
+      EXPECT_EQ(expected[i][0], key);
+      EXPECT_EQ(expected[i][1], value);
+    }
+    EXPECT_TRUE(accessor->exhausted());
+    EXPECT_TRUE(accessor->Backward("bb"));
+    ASSERT_TRUE(accessor->GetNextRecord(&key, &value));
+    EXPECT_EQ("b", key);
+  }
+  EXPECT_TRUE(boost::filesystem::exists(db.journal_file_name()));
+  db.Close();
+  EXPECT_FALSE(boost::filesystem::exists(db.journal_file_name()));
+  ASSERT_TRUE(db.OpenReadOnly());
+  EXPECT_TRUE(db.Fetch("b", &value));
+  EXPECT_EQ("2", value);
+  db.Close();
+}
+
+TEST(RimeUserDbTest, JournalSize) {
+  rime::UserDb db("user_db_test");
+  if (db.Exists())
+    db.Remove();
+  db.EnableWriteBehind();
+  ASSERT_TRUE(db.Open());
+  // a record rewritten again and again is flushed all the same
+  for (int i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(db.Update("\x01/tick", boost::lexical_cast<std::string>(i)));
+  }
+  EXPECT_GT(128 * 1024, boost::filesystem::exists(db.journal_file_name()) ?
+            boost::filesystem::file_size(db.journal_file_name()) : 0);
+  db.Close();
+}
+
+TEST(RimeUserDbTest, RecoverWithJournal) {
+  rime::UserDb db("user_db_test");
+  if (db.Exists())
+    db.Remove();
+  std::string delta_file(db.snapshot_file_name() + ".delta");
+  boost::filesystem::remove(delta_file);
+  db.EnableWriteBehind();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a", "1"));
+  ASSERT_TRUE(db.Backup());
+  EXPECT_TRUE(db.Update("a", "2"));
+  EXPECT_TRUE(db.Update("b", "2"));
+  std::string crash_journal(db.journal_file_name() + ".crash");
+  boost::filesystem::remove(crash_journal);
+  boost::filesystem::copy_file(db.journal_file_name(), crash_journal);
+  db.Close();
+  // as if crashed before the updates in the journal were flushed
+  boost::filesystem::remove(delta_file);
+  boost::filesystem::rename(crash_journal, db.journal_file_name());
+  // the journal is newer than the snapshot
+  ASSERT_TRUE(db.RecoverFromSnapshot());
+  EXPECT_FALSE(boost::filesystem::exists(db.journal_file_name()));
+  std::string value;
+  EXPECT_TRUE(db.Fetch("a", &value));
+  EXPECT_EQ("2", value);
+  EXPECT_TRUE(db.Fetch("b", &value));
+  EXPECT_EQ("2", value);
+  db.Close();
+  boost::filesystem::remove(db.file_name() + ".old");
+}
+
+TEST(RimeUserDbTest, IncrementalSnapshot) {
+  rime::UserDb db("user_db_test");
+  if (db.Exists())
+    db.Remove();
+  boost::filesystem::remove(db.snapshot_file_name() + ".delta");
+  db.EnableWriteBehind();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a", "1"));
+  ASSERT_TRUE(db.Backup());
+  EXPECT_FALSE(boost::filesystem::exists(db.snapshot_file_name() + ".delta"));
+  EXPECT_TRUE(db.Update("b", "2"));
+  EXPECT_TRUE(db.Update("a", "11"));
+  // only the changes are written
+  ASSERT_TRUE(db.UpdateSnapshot());
+  EXPECT_TRUE(boost::filesystem::exists(db.snapshot_file_name() + ".delta"));
+  db.Close();
+  rime::UserDb restored("user_db_test_restored");
+  if (restored.Exists())
+    restored.Remove();
+  ASSERT_TRUE(restored.Open());
+  ASSERT_TRUE(restored.Restore(db.snapshot_file_name()));
+  std::string value;
+  EXPECT_TRUE(restored.Fetch("a", &value));
+  EXPECT_EQ("11", value);
+  EXPECT_TRUE(restored.Fetch("b", &value));
+  EXPECT_EQ("2", value);
+  restored.Close();
+  restored.Remove();
+}
+
+// waits for the snapshot dumped in the background, and tells if it is
+// up to date with the db
+class SnapshotTestDb : public rime::UserDb {
+ public:
+  SnapshotTestDb(const std::string &name) : rime::UserDb(name) {}
+  bool WaitForSnapshot() { return FinishSnapshot(true); }
+  bool snapshot_synced() const { return snapshot_synced_; }
+};
+
+TEST(RimeUserDbTest, EraseDuringSnapshot) {
+  SnapshotTestDb db("user_db_test");
+  if (db.Exists())
+    db.Remove();
+  boost::filesystem::remove(db.snapshot_file_name() + ".delta");
+  db.EnableWriteBehind();
+  ASSERT_TRUE(db.Open());
+  EXPECT_TRUE(db.Update("a", "1"));
+  EXPECT_TRUE(db.Update("b", "2"));
+  // updates while the snapshot is being dumped go into the delta
+  ASSERT_TRUE(db.UpdateSnapshot());
+  EXPECT_TRUE(db.Update("c", "3"));
+  EXPECT_TRUE(db.Flush());
+  ASSERT_TRUE(db.WaitForSnapshot());
+  EXPECT_TRUE(db.snapshot_synced());
+  // an erasure has the next snapshot dumped in full,
+  EXPECT_TRUE(db.Erase("b"));
+  ASSERT_TRUE(db.UpdateSnapshot());
+  // while one during the dump might be missed by it
+  EXPECT_TRUE(db.Erase("a"));
+  ASSERT_TRUE(db.WaitForSnapshot());
+  EXPECT_FALSE(db.snapshot_synced());
+  // so the next one is dumped in full again
+  ASSERT_TRUE(db.UpdateSnapshot());
+  ASSERT_TRUE(db.WaitForSnapshot());
+  EXPECT_TRUE(db.snapshot_synced());
+  db.Close();
+  rime::UserDb restored("user_db_test_restored");
+  if (restored.Exists())
+    restored.Remove();
+  ASSERT_TRUE(restored.Open());
+  ASSERT_TRUE(restored.Restore(db.snapshot_file_name()));
+  std::string value;
+  EXPECT_FALSE(restored.Fetch("a", &value));
+  EXPECT_FALSE(restored.Fetch("b", &value));
+  EXPECT_TRUE(restored.Fetch("c", &value));
+  EXPECT_EQ("3", value);
+  restored.Close();
+  restored.Remove();
+}
+
+TEST(RimeUserDbTest, CompactUserDict) {
+  {
+    rime::UserDb db("user_db_test");
+    if (db.Exists())
+      db.Remove();
+    ASSERT_TRUE(db.Open());
+    using rime::UserDictionary;
+    EXPECT_TRUE(db.Update("\x01/tick", "10000"));
+    EXPECT_TRUE(db.Update("a \tA", UserDictionary::PackValues(-1, 1.0, 9990)));
+    EXPECT_TRUE(db.Update("b \tB", UserDictionary::PackValues(0, 0.1, 5000)));
+    EXPECT_TRUE(db.Update("c \tC", UserDictionary::PackValues(0, 0.1, 9990)));
+    EXPECT_TRUE(db.Update("d \tD", UserDictionary::PackValues(1, 1.0, 10)));
+    db.Close();
+  }
+  rime::Deployer deployer;
+  rime::UserDictManager manager(&deployer);
+  boost::filesystem::remove(rime::UserDb("user_db_test").snapshot_file_name());
+  {
+    // not while the db is open for writing
+    rime::UserDb db("user_db_test");
+    ASSERT_TRUE(db.Open());
+    EXPECT_EQ(0, manager.CompactUserDict("user_db_test", 1e-9));
+    db.Close();
+  }
+  // nor for too few dead entries
+  EXPECT_EQ(0, manager.CompactUserDict("user_db_test", 1e-9, 0.6));
+  // the deleted entry and the one not seen for 5000 commits
+  EXPECT_EQ(2, manager.CompactUserDict("user_db_test", 1e-9, 0.5));
+  EXPECT_EQ(0, manager.CompactUserDict("user_db_test", 1e-9));
+  rime::UserDb db("user_db_test");
+  // the snapshot is left alone
+  EXPECT_FALSE(boost::filesystem::exists(db.snapshot_file_name()));
+  ASSERT_TRUE(db.OpenReadOnly());
+  std::string value;
+  EXPECT_FALSE(db.Fetch("a \tA", &value));
+  EXPECT_FALSE(db.Fetch("b \tB", &value));
+  EXPECT_TRUE(db.Fetch("c \tC", &value));
+  EXPECT_TRUE(db.Fetch("d \tD", &value));
+  EXPECT_TRUE(db.Fetch("\x01/tick", &value));
+  EXPECT_EQ("10000", value);
+  db.Close();
+}
+
+TEST(RimeUserDbTest, MergeUserDict) {
+  using rime::UserDictionary;
+  {
+    rime::UserDb db("user_db_test");
+    if (db.Exists())
+      db.Remove();
+    ASSERT_TRUE(db.Open());
+    EXPECT_TRUE(db.Update("\x01/tick", "10"));
+    EXPECT_TRUE(db.Update("a \tA", UserDictionary::PackValues(2, 1.0, 5)));
+    EXPECT_TRUE(db.Update("c \tC", UserDictionary::PackValues(1, 1.0, 5)));
+    EXPECT_TRUE(db.Backup());
+    db.Close();
+  }
+  std::string text_file("user_db_test.txt");
+  {
+    std::ofstream fout(text_file.c_str());
+    fout << "# comment" << std::endl
+         << "A\ta\t5" << std::endl
+         << "B\tb\t1" << std::endl
+         << "C\tc\t-1" << std::endl
+         << "D\td" << std::endl
+         << "E\te\t-1" << std::endl
+         << "E\te\t3" << std::endl;
+  }
+  rime::Deployer deployer;
+  rime::UserDictManager manager(&deployer);
+  EXPECT_EQ(6, manager.Import("user_db_test", text_file));
+  boost::filesystem::remove(text_file);
+  {
+    rime::UserDb db("user_db_test");
+    ASSERT_TRUE(db.OpenReadOnly());
+    std::string value;
+    int c = 0;
+    double d = 0.0;
+    rime::TickCount t = 0;
+    ASSERT_TRUE(db.Fetch("a \tA", &value));
+    UserDictionary::UnpackValues(value, &c, &d, &t);
+    EXPECT_EQ(5, c);
+    EXPECT_EQ(5, t);
+    ASSERT_TRUE(db.Fetch("b \tB", &value));
+    UserDictionary::UnpackValues(value, &c, &d, &t);
+    EXPECT_EQ(1, c);
+    ASSERT_TRUE(db.Fetch("c \tC", &value));
+    UserDictionary::UnpackValues(value, &c, &d, &t);
+    EXPECT_EQ(-1, c);
+    ASSERT_TRUE(db.Fetch("d \tD", &value));
+    UserDictionary::UnpackValues(value, &c, &d, &t);
+    EXPECT_EQ(0, c);
+    ASSERT_TRUE(db.Fetch("e \tE", &value));
+    UserDictionary::UnpackValues(value, &c, &d, &t);
+    EXPECT_EQ(3, c);
+    db.Close();
+  }
+  // entries in the snapshot taken before the import are merged back
+  rime::UserDb db("user_db_test");
+  ASSERT_TRUE(manager.Restore(db.snapshot_file_name()));
+  ASSERT_TRUE(db.OpenReadOnly());
+  std::string value;
+  int c = 0;
+  double d = 0.0;
+  rime::TickCount t = 0;
+  ASSERT_TRUE(db.Fetch("c \tC", &value));
+  UserDictionary::UnpackValues(value, &c, &d, &t);
+  EXPECT_EQ(1, c);
+  EXPECT_EQ(10, t);
+  ASSERT_TRUE(db.Fetch("e \tE", &value));
+  UserDictionary::UnpackValues(value, &c, &d, &t);
+  EXPECT_EQ(3, c);
+  db.Close();
+}
+
+// user dicts on the db, attached to the table and prism of dictionary_test
+class RimeUserDictionaryTest : public ::testing::Test {
+ public:
+  virtual void SetUp() {
+    dict_.reset(new rime::Dictionary(
+        "dictionary_test",
+        boost::make_shared<rime::Table>("dictionary_test.table.bin"),
+        boost::make_shared<rime::Prism>("dictionary_test.prism.bin")));
+    if (!dict_->Exists()) {
+      rime::DictCompiler dict_compiler(dict_.get());
+      dict_compiler.Compile("dictionary_test.yaml", "dictionary_test.yaml");
+    }
+    ASSERT_TRUE(dict_->Load());
+    // named after the dictionary, whose table the db is packed with
+    db_ = boost::make_shared<rime::UserDb>("dictionary_test");
+    if (db_->Exists())
+      db_->Remove();
+  }
+  virtual void TearDown() {
+    db_->Close();
+    db_->Remove();
+  }
+
+ protected:
+  // as the translator does, the db being opened by the first one of them
+  rime::UserDictionary* CreateUserDict() {
+    rime::UserDictionary *user_dict = new rime::UserDictionary(db_);
+    user_dict->Load();
+    user_dict->Attach(dict_->table(), dict_->prism());
+    return user_dict;
+  }
+  // fills the db with packed keys, and a syllabary saved along with them
+  void CreateUserDb(const rime::UserDbSyllabary &syllabary,
+                    const std::vector<std::string> &spelled_keys) {
+    ASSERT_TRUE(db_->Open());
+    ASSERT_TRUE(db_->Update("\x01/tick", "1"));
+    // no syllabary in a db of an earlier version
+    if (!syllabary.empty())
+      ASSERT_TRUE(syllabary.Save(db_.get()));
+    BOOST_FOREACH(const std::string &spelled_key, spelled_keys) {
+      std::string key;
+      if (!syllabary.PackKey(spelled_key, &key))
+        key = spelled_key;
+      ASSERT_TRUE(db_->Update(
+          key, rime::UserDictionary::PackValues(1, 1.0, 1)));
+    }
+    db_->Close();
+  }
+  // the syllabary of an earlier build of the table
+  static rime::UserDbSyllabary StaleSyllabary() {
+    rime::Syllabary syllabary;
+    syllabary.insert("a");
+    syllabary.insert("guo");
+    syllabary.insert("zhong");
+    rime::UserDbSyllabary s;
+    s.Assign(syllabary);
+    return s;
+  }
+  // an entry made of the given syllables, for the first word of each
+  rime::DictEntry MakeEntry(const std::string &text,
+                            const std::string &syllables) {
+    rime::DictEntry entry;
+    entry.text = text;
+    std::vector<std::string> spellings;
+    boost::split(spellings, syllables, boost::is_any_of(" "));
+    BOOST_FOREACH(const std::string &s, spellings) {
+      rime::DictEntryIterator it;
+      dict_->LookupWords(&it, s, false);
+      if (!it.exhausted())
+        entry.code.push_back(it.Peek()->code[0]);
+    }
+    return entry;
+  }
+  // texts of the entries found in the user dict over the input
+  std::string Lookup(rime::UserDictionary *user_dict,
+                     const std::string &input) {
+    rime::SyllableGraph g;
+    rime::Syllabifier().BuildSyllableGraph(input, *dict_->prism(), &g);
+    rime::shared_ptr<rime::UserDictEntryCollector> c(user_dict->Lookup(g, 0));
+    std::string result;
+    if (!c)
+      return result;
+    BOOST_FOREACH(rime::UserDictEntryCollector::value_type &v, *c) {
+      BOOST_FOREACH(const rime::shared_ptr<rime::DictEntry> &e, v.second) {
+        if (!result.empty())
+          result += ' ';
+        result += e->text;
+      }
+    }
+    return result;
+  }
+
+  boost::scoped_ptr<rime::Dictionary> dict_;
+  rime::shared_ptr<rime::UserDb> db_;
+};
+
+TEST_F(RimeUserDictionaryTest, LookupAfterUpdate) {
+  boost::scoped_ptr<rime::UserDictionary> user_dict(CreateUserDict());
+  ASSERT_TRUE(user_dict->loaded());
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("Zhong", "zhong"), 1));
+  // the cache now has it that no longer code starts with zhong
+  EXPECT_EQ("Zhong", Lookup(user_dict.get(), "zhongguo"));
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("ZhongGuo", "zhong guo"), 1));
+  EXPECT_EQ("Zhong ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("ZhongGuo", "zhong guo"), 1));
+  EXPECT_EQ("Zhong ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+}
+
+TEST_F(RimeUserDictionaryTest, LookupAfterDeletion) {
+  boost::scoped_ptr<rime::UserDictionary> user_dict(CreateUserDict());
+  ASSERT_TRUE(user_dict->loaded());
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("Zhong", "zhong"), 1));
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("ZhongGuo", "zhong guo"), 1));
+  EXPECT_EQ("Zhong ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("ZhongGuo", "zhong guo"), -1));
+  EXPECT_EQ("Zhong", Lookup(user_dict.get(), "zhongguo"));
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("Zhong", "zhong"), -1));
+  EXPECT_EQ("", Lookup(user_dict.get(), "zhongguo"));
+}
+
+TEST_F(RimeUserDictionaryTest, SeeUpdatesOnSharedDb) {
+  boost::scoped_ptr<rime::UserDictionary> user_dict(CreateUserDict());
+  boost::scoped_ptr<rime::UserDictionary> other(CreateUserDict());
+  ASSERT_TRUE(user_dict->loaded());
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("Zhong", "zhong"), 1));
+  EXPECT_EQ("Zhong", Lookup(user_dict.get(), "zhongguo"));
+  EXPECT_EQ("Zhong", Lookup(other.get(), "zhongguo"));
+  // changes made by the other one to the db outdate the cache
+  ASSERT_TRUE(other->UpdateEntry(MakeEntry("ZhongGuo", "zhong guo"), 1));
+  EXPECT_EQ("Zhong ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  EXPECT_EQ(other->tick(), user_dict->tick());
+  ASSERT_TRUE(other->UpdateEntry(MakeEntry("Zhong", "zhong"), -1));
+  EXPECT_EQ("ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+}
+
+TEST_F(RimeUserDictionaryTest, LookupBeforeRepacking) {
+  std::vector<std::string> keys;
+  keys.push_back("zhong guo \tZhongGuo");
+  CreateUserDb(StaleSyllabary(), keys);
+  boost::scoped_ptr<rime::UserDictionary> user_dict(CreateUserDict());
+  ASSERT_TRUE(user_dict->loaded());
+  EXPECT_EQ("ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("Zhong", "zhong"), 1));
+  EXPECT_EQ("Zhong ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  // a syllable missing from the db's syllabary is spelled out
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("ZhongBa", "zhong ba"), 1));
+  EXPECT_EQ("Zhong ZhongBa", Lookup(user_dict.get(), "zhongba"));
+  std::string value;
+  EXPECT_TRUE(db_->Fetch("zhong ba \tZhongBa", &value));
+  // the keys are left to be repacked by the deployment task
+  rime::UserDbSyllabary saved;
+  ASSERT_TRUE(saved.Load(db_.get()));
+  EXPECT_TRUE(saved == StaleSyllabary());
+}
+
+TEST_F(RimeUserDictionaryTest, LookupBeforePacking) {
+  std::vector<std::string> keys;
+  keys.push_back("zhong guo \tZhongGuo");
+  CreateUserDb(rime::UserDbSyllabary(), keys);
+  boost::scoped_ptr<rime::UserDictionary> user_dict(CreateUserDict());
+  ASSERT_TRUE(user_dict->loaded());
+  EXPECT_EQ("ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  // new entries are spelled as well
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("Zhong", "zhong"), 1));
+  EXPECT_EQ("Zhong ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  std::string value;
+  EXPECT_TRUE(db_->Fetch("zhong \tZhong", &value));
+  // the db is left to be packed by the deployment task
+  rime::UserDbSyllabary saved;
+  EXPECT_FALSE(saved.Load(db_.get()));
+  user_dict.reset();
+  db_->Close();
+  rime::Deployer deployer;
+  rime::UserDictManager manager(&deployer);
+  EXPECT_TRUE(manager.UpgradeUserDict("dictionary_test"));
+  user_dict.reset(CreateUserDict());
+  ASSERT_TRUE(user_dict->loaded());
+  ASSERT_TRUE(saved.Load(db_.get()));
+  EXPECT_FALSE(db_->Fetch("zhong \tZhong", &value));
+  EXPECT_EQ("Zhong ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+}
+
+TEST_F(RimeUserDictionaryTest, RepackUserDict) {
+  std::vector<std::string> keys;
+  keys.push_back("zhong guo \tZhongGuo");
+  keys.push_back("zhong ba \tZhongBa");
+  CreateUserDb(StaleSyllabary(), keys);
+  rime::Deployer deployer;
+  rime::UserDictManager manager(&deployer);
+  {
+    // not while the db is in use
+    boost::scoped_ptr<rime::UserDictionary> user_dict(CreateUserDict());
+    ASSERT_TRUE(user_dict->loaded());
+    EXPECT_TRUE(manager.SyncSyllabary("dictionary_test"));
+    rime::UserDbSyllabary saved;
+    ASSERT_TRUE(saved.Load(db_.get()));
+    EXPECT_TRUE(saved == StaleSyllabary());
+    db_->Close();
+  }
+  EXPECT_TRUE(manager.UpgradeUserDict("dictionary_test"));
+  boost::scoped_ptr<rime::UserDictionary> user_dict(CreateUserDict());
+  ASSERT_TRUE(user_dict->loaded());
+  rime::Syllabary syllabary;
+  ASSERT_TRUE(dict_->table()->GetSyllabary(&syllabary));
+  rime::UserDbSyllabary current;
+  current.Assign(syllabary);
+  rime::UserDbSyllabary saved;
+  ASSERT_TRUE(saved.Load(db_.get()));
+  EXPECT_TRUE(saved == current);
+  EXPECT_EQ("ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  EXPECT_EQ("ZhongBa", Lookup(user_dict.get(), "zhongba"));
+}
+
+TEST_F(RimeUserDictionaryTest, LookupBoundedSyllableGraph) {
+  boost::scoped_ptr<rime::UserDictionary> user_dict(CreateUserDict());
+  ASSERT_TRUE(user_dict->loaded());
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("ZhongGuo", "zhong guo"), 1));
+  ASSERT_TRUE(user_dict->UpdateEntry(
+      MakeEntry("ZhongGuoZhongGuo", "zhong guo zhong guo"), 1));
+  std::string input;
+  for (int i = 0; i < 200; ++i)
+    input += "zhongguo";
+  rime::Syllabifier s;
+  s.set_max_total_edges(20);
+  rime::SyllableGraph g;
+  s.BuildSyllableGraph(input, *dict_->prism(), &g);
+  ASSERT_LT(0, g.interpreted_length);
+  ASSERT_GT(input.length(), g.interpreted_length);
+  const size_t kDepthLimit = 3;
+  std::vector<double> credibility(g.interpreted_length, 1.0);
+  rime::WordGraph graph;
+  ASSERT_TRUE(user_dict->Lookup(g, kDepthLimit, credibility, &graph));
+  size_t num_entries = 0;
+  BOOST_FOREACH(const rime::WordGraph::value_type &w, graph) {
+    EXPECT_GT(g.interpreted_length, static_cast<size_t>(w.first));
+    BOOST_FOREACH(const rime::UserDictEntryCollector::value_type &v,
+                  w.second) {
+      EXPECT_GE(g.interpreted_length, v.first);
+      BOOST_FOREACH(const rime::shared_ptr<rime::DictEntry> &e, v.second) {
+        EXPECT_GE(kDepthLimit, e->code.size());
+        ++num_entries;
+      }
+    }
+  }
+  EXPECT_LT(0, num_entries);
+}
+
+TEST_F(RimeUserDictionaryTest, BuildPrefixFilter) {
+  rime::Syllabary syllabary;
+  ASSERT_TRUE(dict_->table()->GetSyllabary(&syllabary));
+  rime::UserDbSyllabary current;
+  current.Assign(syllabary);
+  std::vector<std::string> keys;
+  keys.push_back("zhong guo \tZhongGuo");
+  CreateUserDb(current, keys);
+  rime::shared_ptr<rime::UserDictFilter> filter(
+      boost::make_shared<rime::UserDictFilter>(3));
+  boost::scoped_ptr<rime::UserDictionary> user_dict(
+      new rime::UserDictionary(db_, filter));
+  ASSERT_TRUE(user_dict->Load());
+  // the db is scanned in the background
+  user_dict->Attach(dict_->table(), dict_->prism());
+  ASSERT_TRUE(filter->FinishBuilding(true));
+  ASSERT_TRUE(filter->ready());
+  EXPECT_EQ("ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  // new entries get past the filter
+  ASSERT_TRUE(user_dict->UpdateEntry(MakeEntry("ZhongBa", "zhong ba"), 1));
+  EXPECT_EQ("ZhongBa", Lookup(user_dict.get(), "zhongba"));
+  // filled up with entries, it is rebuilt with room for more
+  rime::DictEntry entry;
+  entry.text = "X";
+  entry.code.resize(2);
+  int n = static_cast<int>(syllabary.size());
+  for (int i = 0; i < n * n && !filter->full(); ++i) {
+    entry.code[0] = i / n;
+    entry.code[1] = i % n;
+    ASSERT_TRUE(user_dict->UpdateEntry(entry, 1));
+  }
+  ASSERT_TRUE(filter->full());
+  ASSERT_TRUE(filter->FinishBuilding(true));
+  EXPECT_FALSE(filter->full());
+  EXPECT_EQ("ZhongGuo", Lookup(user_dict.get(), "zhongguo"));
+  EXPECT_EQ("ZhongBa", Lookup(user_dict.get(), "zhongba"));
+}
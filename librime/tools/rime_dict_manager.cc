@@ -6,6 +6,7 @@
 //
 // 2012-03-24 GONG Chen <chen.sst@gmail.com>
 //
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <boost/foreach.hpp>
@@ -27,6 +28,7 @@ int main(int argc, char *argv[]) {
               << "\t-r|--restore xxx.userdb.kct.snapshot" << std::endl
               << "\t-e|--export dict_name export.txt" << std::endl
               << "\t-i|--import dict_name import.txt" << std::endl
+              << "\t-c|--compact dict_name [min_weight]" << std::endl
         ;
     return 0;
   }
@@ -66,6 +68,13 @@ int main(int argc, char *argv[]) {
     std::cout << "imported " << n << " entries." << std::endl;
     return 0;
   }
+  if ((argc == 3 || argc == 4) && (option == "-c" || option == "--compact")) {
+    double min_weight = arg2.empty() ? 1e-9 : std::atof(arg2.c_str());
+    int n = mgr.CompactUserDict(arg1, min_weight);
+    if (n == -1) return 1;
+    std::cout << "dropped " << n << " entries." << std::endl;
+    return 0;
+  }
   std::cerr << "invalid arguments." << std::endl;
   return 1;
 }
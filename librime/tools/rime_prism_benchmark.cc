@@ -0,0 +1,107 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/foreach.hpp>
+#include <rime/config.h>
+#include <rime/algo/algebra.h>
+#include <rime/dict/prism.h>
+#include <rime/dict/table.h>
+
+static const int kRounds = 100;
+
+static bool BuildPrism(rime::Prism *prism,
+                       rime::Prism::Backend backend,
+                       const rime::Syllabary &syllabary,
+                       const rime::Script *script) {
+  prism->Remove();
+  prism->set_backend(backend);
+  return prism->Build(syllabary, script) && prism->Save() && prism->Load();
+}
+
+static void Benchmark(const char *name, rime::Prism *prism,
+                      const std::vector<std::string> &keys) {
+  size_t num_matches = 0;
+  std::vector<rime::Prism::Match> matches;
+  std::clock_t start = std::clock();
+  for (int i = 0; i < kRounds; ++i) {
+    BOOST_FOREACH(const std::string &key, keys) {
+      prism->CommonPrefixSearch(key + key, &matches);
+      num_matches += matches.size();
+    }
+  }
+  double prefix_search_time = double(std::clock() - start) / CLOCKS_PER_SEC;
+  start = std::clock();
+  for (int i = 0; i < kRounds; ++i) {
+    BOOST_FOREACH(const std::string &key, keys) {
+      prism->ExpandSearch(key.substr(0, 1), &matches, 512);
+      num_matches += matches.size();
+    }
+  }
+  double expand_search_time = double(std::clock() - start) / CLOCKS_PER_SEC;
+  std::cout << name << ":" << std::endl
+            << "\ttrie image: " << prism->image_size() << " bytes" << std::endl
+            << "\tprism file: " << prism->file_size() << " bytes" << std::endl
+            << "\tcommon prefix search: " << prefix_search_time << " s" << std::endl
+            << "\texpand search: " << expand_search_time << " s" << std::endl
+            << "\t(" << num_matches << " matches)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cout << "usage: " << argv[0]
+              << " dict_name [xxx.schema.yaml]" << std::endl;
+    return 0;
+  }
+  std::string dict_name(argv[1]);
+  rime::Table table(dict_name + ".table.bin");
+  rime::Syllabary syllabary;
+  if (!table.Load() || !table.GetSyllabary(&syllabary) || syllabary.empty()) {
+    std::cerr << "error loading table for '" << dict_name << "'." << std::endl;
+    return 1;
+  }
+  rime::Script script;
+  if (argc >= 3) {
+    rime::Projection p;
+    rime::Config config(argv[2]);
+    if (p.Load(config.GetList("speller/algebra"))) {
+      BOOST_FOREACH(const std::string &x, syllabary) {
+        script.AddSyllable(x);
+      }
+      if (!p.Apply(&script))
+        script.clear();
+    }
+  }
+  std::vector<std::string> keys;
+  if (script.empty()) {
+    keys.assign(syllabary.begin(), syllabary.end());
+  }
+  else {
+    BOOST_FOREACH(const rime::Script::value_type &x, script) {
+      keys.push_back(x.first);
+    }
+  }
+  std::cout << keys.size() << " spellings, "
+            << syllabary.size() << " syllables." << std::endl;
+  const rime::Script *s = script.empty() ? NULL : &script;
+  rime::Prism darts(dict_name + ".darts.prism.bin");
+  rime::Prism dawg(dict_name + ".dawg.prism.bin");
+  if (!BuildPrism(&darts, rime::Prism::kDoubleArray, syllabary, s) ||
+      !BuildPrism(&dawg, rime::Prism::kDawg, syllabary, s)) {
+    std::cerr << "error building prism." << std::endl;
+    return 1;
+  }
+  Benchmark("double array", &darts, keys);
+  Benchmark("dawg", &dawg, keys);
+  darts.Remove();
+  dawg.Remove();
+  return 0;
+}
@@ -0,0 +1,179 @@
+// vim: set sts=2 sw=2 et:
+// encoding: utf-8
+//
+// Copyleft 2026 RIME Developers
+// License: GPLv3
+//
+// 2026-10-18 agent <agent@local>
+//
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <rime/deployer.h>
+#include <rime/service.h>
+#include <rime/algo/dynamics.h>
+#include <rime/dict/user_db.h>
+#include <rime/dict/user_dictionary.h>
+#include <rime/expl/user_dict_manager.h>
+
+static const char kDictName[] = "benchmark";
+static const char kBaselineDictName[] = "benchmark_baseline";
+
+static double Elapsed(const boost::posix_time::ptime &start) {
+  boost::posix_time::ptime now(
+      boost::posix_time::microsec_clock::universal_time());
+  return (now - start).total_microseconds() / 1e6;
+}
+
+static const std::string MakeKey(int i) {
+  static const char *syllables[] = {
+    "bai", "cheng", "da", "fei", "guang", "hua", "jian", "kong",
+    "liu", "ming", "ning", "qing", "shan", "tian", "xue", "yun",
+  };
+  std::string code;
+  for (int n = i; ; n /= 16) {
+    code += syllables[n % 16];
+    code += ' ';
+    if (n < 16)
+      break;
+  }
+  return code + "\t" + boost::lexical_cast<std::string>(i);
+}
+
+// the user dict has entries [0, num_entries), of which the snapshot
+// taken from another machine shares half, along with as many of its own
+static bool CreateUserDicts(int num_entries, std::string *snapshot_file) {
+  using rime::UserDictionary;
+  rime::UserDb remote(".remote");
+  if (remote.Exists())
+    remote.Remove();
+  if (!remote.Open())
+    return false;
+  remote.Update("\x01/db_name", std::string(kDictName) + ".userdb.kct");
+  remote.Update("\x01/tick",
+                boost::lexical_cast<std::string>(num_entries * 2));
+  for (int i = num_entries / 2; i < num_entries * 3 / 2; ++i) {
+    remote.Update(MakeKey(i), UserDictionary::PackValues(2, 1.0, i * 2));
+  }
+  *snapshot_file = remote.snapshot_file_name();
+  bool success = remote.Backup();
+  remote.Close();
+  remote.Remove();
+  const char *names[] = { kDictName, kBaselineDictName };
+  for (int k = 0; k < 2 && success; ++k) {
+    rime::UserDb db(names[k]);
+    if (db.Exists())
+      db.Remove();
+    if (!db.Open())
+      return false;
+    db.Update("\x01/tick", boost::lexical_cast<std::string>(num_entries));
+    for (int i = 0; i < num_entries; ++i) {
+      db.Update(MakeKey(i), UserDictionary::PackValues(1, 1.0, i));
+    }
+    db.Close();
+  }
+  return success;
+}
+
+// merges the snapshot by a Fetch() and an Update() for every key,
+// as UserDictManager::Restore() used to do
+static int MergeByKey(const std::string &snapshot_file) {
+  using rime::UserDictionary;
+  rime::UserDb temp(".temp");
+  if (temp.Exists())
+    temp.Remove();
+  if (!temp.Open() || !temp.Restore(snapshot_file))
+    return -1;
+  rime::UserDb dest(kBaselineDictName);
+  if (!dest.Open())
+    return -1;
+  rime::TickCount tick = 0;
+  std::string value;
+  if (temp.Fetch("\x01/tick", &value))
+    tick = boost::lexical_cast<rime::TickCount>(value);
+  rime::shared_ptr<rime::UserDbAccessor> a = temp.Query("");
+  std::string key, left;
+  int num_entries = 0;
+  while (a->GetNextRecord(&key, &value)) {
+    if (key.compare(0, 2, "\x01/") == 0)
+      continue;
+    int c = 0;
+    double d = 0.0;
+    rime::TickCount t = 0;
+    UserDictionary::UnpackValues(value, &c, &d, &t);
+    if (dest.Fetch(key, &left)) {
+      int c0 = 0;
+      double d0 = 0.0;
+      rime::TickCount t0 = 0;
+      UserDictionary::UnpackValues(left, &c0, &d0, &t0);
+      if (t0 < tick)
+        d0 = rime::algo::formula_d(0, (double)tick, d0, (double)t0);
+      c = (std::max)(c, c0);
+      d = (std::max)(d, d0);
+    }
+    if (dest.Update(key, UserDictionary::PackValues(c, d, tick)))
+      ++num_entries;
+  }
+  dest.Close();
+  temp.Close();
+  temp.Remove();
+  return num_entries;
+}
+
+int main(int argc, char *argv[]) {
+  int num_entries = 100000;
+  if (argc >= 2)
+    num_entries = std::atoi(argv[1]);
+  if (num_entries <= 0) {
+    std::cout << "usage: " << argv[0]
+              << " [num_entries] [kyotocabinet|sorted]" << std::endl;
+    return 0;
+  }
+  rime::Deployer &deployer(rime::Service::instance().deployer());
+  if (argc >= 3)
+    deployer.user_db_engine = argv[2];
+  std::cout << num_entries << " entries in each of the user dict "
+            << "and the snapshot, half of them shared; "
+            << deployer.user_db_engine << " engine." << std::endl;
+  std::string snapshot_file;
+  if (!CreateUserDicts(num_entries, &snapshot_file)) {
+    std::cerr << "error creating user dicts." << std::endl;
+    return 1;
+  }
+  rime::UserDictManager manager(&deployer);
+  boost::posix_time::ptime start(
+      boost::posix_time::microsec_clock::universal_time());
+  if (MergeByKey(snapshot_file) < 0) {
+    std::cerr << "error merging the snapshot by key." << std::endl;
+    return 1;
+  }
+  double by_key_time = Elapsed(start);
+  start = boost::posix_time::microsec_clock::universal_time();
+  if (!manager.Restore(snapshot_file)) {
+    std::cerr << "error restoring the snapshot." << std::endl;
+    return 1;
+  }
+  double restore_time = Elapsed(start);
+  std::string text_file(std::string(kDictName) + ".txt");
+  int num_exported = manager.Export(kDictName, text_file);
+  start = boost::posix_time::microsec_clock::universal_time();
+  int num_imported = manager.Import(kDictName, text_file);
+  double import_time = Elapsed(start);
+  std::cout << "fetch and update by key: " << by_key_time << " s" << std::endl
+            << "streaming restore: " << restore_time << " s" << std::endl
+            << "streaming import: " << import_time << " s"
+            << " (" << num_imported << " of " << num_exported << " entries)"
+            << std::endl;
+  boost::filesystem::remove(text_file);
+  boost::filesystem::remove(snapshot_file);
+  const char *names[] = { kDictName, kBaselineDictName };
+  for (int k = 0; k < 2; ++k) {
+    rime::UserDb db(names[k]);
+    db.Remove();
+  }
+  return 0;
+}